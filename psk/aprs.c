@@ -0,0 +1,567 @@
+/*
+ * Decode 1200 baud AFSK (Bell 202) AX.25 frames, as APRS sends them, from
+ * audio or I/Q recordings: to check what goes on air, and for the receive
+ * path.
+ *
+ * I/Q is FM demodulated first. The audio goes through correlators for mark
+ * (1200 Hz) and space (2200 Hz), over sliding windows of a few lengths, the
+ * filters. Every filter feeds slicers that weigh mark against space
+ * differently, for the tilt that pre-emphasis and the audio path give the
+ * tones. Every slicer recovers the bit clock with its own PLL, and has its
+ * own NRZI decoder and HDLC deframer; a frame with a good CRC counts once,
+ * for all the slicers that got it.
+ *
+ * The files are shared out between threads, a file to a thread at a time.
+ * The frames are printed in the TNC2 monitor format, with how many every
+ * slicer got, so a change on the TX side can be checked against the same
+ * recordings.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+
+#define AFSK_BAUD       1200
+#define AFSK_MARK       1200
+#define AFSK_SPACE      2200
+#define FILTERS_MAX     3
+#define SLICERS_MAX     9
+#define SLICER_TILT_DB  6       /* Of the outer slicers */
+#define PLL_INERTIA     0.75    /* Of the bit clock at a transition */
+#define FRAME_MIN       17      /* Two addresses, control and FCS */
+#define FRAME_MAX       340     /* Ten addresses, control, PID, 256 info and FCS */
+#define CRC_GOOD        0xf0b8  /* Left by a frame and its FCS */
+#define DUP_S           0.1     /* The same frame from another slicer */
+#define DUP_RECENT      16
+#define BLOCK           4096    /* Frames read at a time */
+
+enum {
+	FORMAT_S16,
+	FORMAT_F32,
+};
+
+// A frame with a good CRC
+typedef struct {
+	uint64_t sample;        /* Of its closing flag */
+	uint16_t crc;
+	uint16_t len;
+	uint32_t slicers;       /* Bit per slicer that got it */
+	uint8_t *data;
+} frame_t;
+
+// Bit clock, NRZI decoder and HDLC deframer behind a filter
+typedef struct {
+	float gain;             /* Of mark against space, in power */
+	int32_t pll;
+	int level;              /* Of the demodulator, mark 1 */
+	int last;               /* Level at the last bit */
+	int ones;
+	int in_frame;
+	int len, bits;          /* Bytes and bits of the frame so far */
+	uint8_t frame[FRAME_MAX + 1];
+	unsigned good, bad;
+} slicer_t;
+
+typedef struct {
+	const char *path;
+	unsigned rate;
+	double seconds;
+	double ms;
+	frame_t *frames;
+	int frame_count;
+	unsigned good[FILTERS_MAX * SLICERS_MAX];       /* Per slicer */
+	unsigned bad;           /* CRC errors */
+	char error[96];
+} file_t;
+
+static const struct option long_options[] = {
+	{"expect", required_argument, NULL, 'e'},
+	{"filters", required_argument, NULL, 'F'},
+	{"format", required_argument, NULL, 'f'},
+	{"help", no_argument, NULL, 'h'},
+	{"iq", no_argument, NULL, 'q'},
+	{"quiet", no_argument, NULL, 'Q'},
+	{"rate", required_argument, NULL, 'r'},
+	{"slicers", required_argument, NULL, 's'},
+	{"threads", required_argument, NULL, 'T'},
+	{NULL, 0, NULL, 0}
+};
+
+static int in_format = FORMAT_S16;
+static unsigned in_rate = 48000;
+static int in_iq;
+static int filters = 2, slicers = 5;
+static uint16_t crc_table[256];
+
+static file_t *files;
+static int file_count;
+static int file_next;
+
+static double now_ms(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+// CRC-16-CCITT as AX.25 sends it, low bit first
+static void crc_init(void) {
+	uint16_t c;
+	int i, k;
+
+	for (i = 0; i < 256; i++) {
+		for (c = i, k = 0; k < 8; k++)
+			c = c & 1 ? (c >> 1) ^ 0x8408 : c >> 1;
+		crc_table[i] = c;
+	}
+}
+
+static uint16_t crc_run(const uint8_t *p, int n) {
+	uint16_t crc = 0xffff;
+
+	while (n--)
+		crc = (crc >> 8) ^ crc_table[(crc ^ *p++) & 0xff];
+	return crc;
+}
+
+static double slicer_gain_db(int k) {
+	return slicers > 1 ? -SLICER_TILT_DB + 2.0 * SLICER_TILT_DB * k / (slicers - 1) : 0;
+}
+
+// Windows from a bit down, in bits
+static double filter_bits(int f) {
+	return 1.0 - 0.25 * f;
+}
+
+// A frame from slicer k, kept once however many slicers got it
+static void frame_add(file_t *fi, int k, uint64_t sample, const uint8_t *data, int len, unsigned rate) {
+	uint16_t crc = crc_run(data, len);
+	frame_t *fr;
+	int i;
+
+	for (i = fi->frame_count - 1; i >= 0 && i >= fi->frame_count - DUP_RECENT; i--) {
+		fr = &fi->frames[i];
+		if (fr->crc == crc && fr->len == len && sample - fr->sample < DUP_S * rate &&
+				memcmp(fr->data, data, len) == 0) {
+			fr->slicers |= 1u << k;
+			return;
+		}
+	}
+	if (fi->frame_count % 64 == 0) {
+		fr = realloc(fi->frames, (fi->frame_count + 64) * sizeof(*fr));
+		if (!fr)
+			return;
+		fi->frames = fr;
+	}
+	fr = &fi->frames[fi->frame_count];
+	if (!(fr->data = malloc(len)))
+		return;
+	memcpy(fr->data, data, len);
+	fr->sample = sample;
+	fr->crc = crc;
+	fr->len = len;
+	fr->slicers = 1u << k;
+	fi->frame_count++;
+}
+
+/*
+ * One bit out of the NRZI: no change is a 1. After five 1s a 0 is stuffed,
+ * six of them are the flag and seven an abort. The flag has put its first
+ * seven bits into the frame by the time it is seen.
+ */
+static void slicer_bit(slicer_t *sl, file_t *fi, int k, uint64_t sample, unsigned rate) {
+	int bit = sl->level == sl->last;
+	int n;
+
+	sl->last = sl->level;
+	if (bit) {
+		if (++sl->ones == 7) {
+			sl->in_frame = 0;
+			return;
+		}
+	} else {
+		if (sl->ones == 5) {
+			sl->ones = 0;
+			return;
+		}
+		if (sl->ones == 6) {
+			sl->ones = 0;
+			n = sl->len * 8 + sl->bits - 7;
+			if (sl->in_frame && n % 8 == 0 && n / 8 >= FRAME_MIN) {
+				if (crc_run(sl->frame, n / 8) == CRC_GOOD) {
+					sl->good++;
+					frame_add(fi, k, sample, sl->frame, n / 8 - 2, rate);
+				} else {
+					sl->bad++;
+				}
+			}
+			sl->in_frame = 1;
+			sl->len = sl->bits = 0;
+			sl->frame[0] = 0;
+			return;
+		}
+		sl->ones = 0;
+	}
+	if (!sl->in_frame)
+		return;
+	sl->frame[sl->len] |= bit << sl->bits;
+	if (++sl->bits == 8) {
+		sl->bits = 0;
+		if (++sl->len > FRAME_MAX)
+			sl->in_frame = 0;
+		else
+			sl->frame[sl->len] = 0;
+	}
+}
+
+/*
+ * WAV header, if there is one: its rate, format and channels replace the
+ * settings, and the file is left at the samples. 0 for raw files.
+ */
+static int wav_header(FILE *f, unsigned *rate, int *format, int *channels) {
+	uint8_t h[12], c[8], fmt[16];
+	uint32_t len;
+
+	if (fread(h, 1, 12, f) != 12 || memcmp(h, "RIFF", 4) || memcmp(h + 8, "WAVE", 4)) {
+		rewind(f);
+		return 0;
+	}
+	while (fread(c, 1, 8, f) == 8) {
+		len = c[4] | c[5] << 8 | c[6] << 16 | (uint32_t)c[7] << 24;
+		if (!memcmp(c, "data", 4))
+			return 1;
+		if (!memcmp(c, "fmt ", 4) && len >= 16) {
+			if (fread(fmt, 1, 16, f) != 16)
+				return -1;
+			len -= 16;
+			*channels = fmt[2] | fmt[3] << 8;
+			*rate = fmt[4] | fmt[5] << 8 | fmt[6] << 16 | (uint32_t)fmt[7] << 24;
+			if ((fmt[0] | fmt[1] << 8) == 1 && fmt[14] == 16)
+				*format = FORMAT_S16;
+			else if ((fmt[0] | fmt[1] << 8) == 3 && fmt[14] == 32)
+				*format = FORMAT_F32;
+			else
+				return -1;
+		}
+		if (fseek(f, len + (len & 1), SEEK_CUR) < 0)
+			return -1;
+	}
+	return -1;
+}
+
+static void decode_file(file_t *fi) {
+	slicer_t sl[FILTERS_MAX * SLICERS_MAX];
+	float *ring, *in = NULL, x, y, dc_x = 0, dc_y = 0, prev_i = 0, prev_q = 0, mark, space, d;
+	double sum[FILTERS_MAX][4], mark_re = 1, mark_im = 0, space_re = 1, space_im = 0, t, ms;
+	double mark_w_re, mark_w_im, space_w_re, space_w_im;
+	unsigned rate = in_rate, win[FILTERS_MAX], ring_len, pos = 0;
+	int format = in_format, channels = in_iq ? 2 : 1;
+	uint32_t step;
+	uint64_t sample = 0;
+	size_t n, i;
+	int f, k, j, level;
+	FILE *fp;
+	float *p, *old;
+
+	ms = now_ms();
+	if (!(fp = fopen(fi->path, "r"))) {
+		snprintf(fi->error, sizeof(fi->error), "%m");
+		return;
+	}
+	if (wav_header(fp, &rate, &format, &channels) < 0 || rate < 4 * AFSK_SPACE || channels < 1 ||
+			(in_iq && channels != 2)) {
+		snprintf(fi->error, sizeof(fi->error), "not a 16 bit or float %s WAV of 8800 Hz or more",
+			in_iq ? "I/Q" : "audio");
+		fclose(fp);
+		return;
+	}
+
+	/* Products of the tones, in a ring longer than the longest window */
+	for (f = 0; f < filters; f++) {
+		win[f] = lrint(rate * filter_bits(f) / AFSK_BAUD);
+		memset(sum[f], 0, sizeof(sum[f]));
+	}
+	for (ring_len = 1; ring_len < win[0] + 1; ring_len <<= 1)
+		;
+	ring = calloc(ring_len * 4, sizeof(float));
+	in = malloc(BLOCK * channels * (format == FORMAT_S16 ? sizeof(int16_t) : sizeof(float)));
+	if (!ring || !in) {
+		snprintf(fi->error, sizeof(fi->error), "out of memory");
+		goto out;
+	}
+	mark_w_re = cos(2 * M_PI * AFSK_MARK / rate);
+	mark_w_im = sin(2 * M_PI * AFSK_MARK / rate);
+	space_w_re = cos(2 * M_PI * AFSK_SPACE / rate);
+	space_w_im = sin(2 * M_PI * AFSK_SPACE / rate);
+	step = (uint32_t)(4294967296.0 * AFSK_BAUD / rate);
+	memset(sl, 0, sizeof(sl));
+	for (f = 0; f < filters; f++)
+		for (k = 0; k < slicers; k++)
+			sl[f * slicers + k].gain = pow(10, slicer_gain_db(k) / 10);
+
+	while ((n = fread(in, format == FORMAT_S16 ? sizeof(int16_t) : sizeof(float), BLOCK * channels, fp) /
+			channels) > 0) {
+		for (i = 0; i < n; i++, sample++) {
+			if (format == FORMAT_S16) {
+				x = ((int16_t *)in)[i * channels] / 32767.0f;
+				y = channels == 2 ? ((int16_t *)in)[i * channels + 1] / 32767.0f : 0;
+			} else {
+				x = in[i * channels];
+				y = channels == 2 ? in[i * channels + 1] : 0;
+			}
+			/* FM: the phase step from the last I/Q */
+			if (in_iq) {
+				d = atan2f(y * prev_i - x * prev_q, x * prev_i + y * prev_q);
+				prev_i = x;
+				prev_q = y;
+				x = d;
+			}
+			/* DC off, for the offset of an FM carrier */
+			dc_y = x - dc_x + 0.999f * dc_y;
+			dc_x = x;
+			x = dc_y;
+
+			p = &ring[(pos & (ring_len - 1)) * 4];
+			p[0] = x * mark_re;
+			p[1] = x * mark_im;
+			p[2] = x * space_re;
+			p[3] = x * space_im;
+			t = mark_re * mark_w_re - mark_im * mark_w_im;
+			mark_im = mark_re * mark_w_im + mark_im * mark_w_re;
+			mark_re = t;
+			t = space_re * space_w_re - space_im * space_w_im;
+			space_im = space_re * space_w_im + space_im * space_w_re;
+			space_re = t;
+			if ((pos & 1023) == 0) {
+				t = 1 / sqrt(mark_re * mark_re + mark_im * mark_im);
+				mark_re *= t;
+				mark_im *= t;
+				t = 1 / sqrt(space_re * space_re + space_im * space_im);
+				space_re *= t;
+				space_im *= t;
+			}
+
+			for (f = 0; f < filters; f++) {
+				old = &ring[((pos - win[f]) & (ring_len - 1)) * 4];
+				for (j = 0; j < 4; j++)
+					sum[f][j] += p[j] - old[j];
+				mark = sum[f][0] * sum[f][0] + sum[f][1] * sum[f][1];
+				space = sum[f][2] * sum[f][2] + sum[f][3] * sum[f][3];
+				for (k = f * slicers; k < (f + 1) * slicers; k++) {
+					level = mark * sl[k].gain > space;
+					/* A transition pulls the bit clock towards it */
+					if (level != sl[k].level) {
+						sl[k].level = level;
+						sl[k].pll = sl[k].pll * PLL_INERTIA;
+					}
+					/* The middle of a bit when the clock wraps */
+					if ((int32_t)((uint32_t)sl[k].pll + step) < sl[k].pll)
+						slicer_bit(&sl[k], fi, k, sample, rate);
+					sl[k].pll = (int32_t)((uint32_t)sl[k].pll + step);
+				}
+			}
+			pos++;
+		}
+	}
+	fi->rate = rate;
+	fi->seconds = (double)sample / rate;
+	for (k = 0; k < filters * slicers; k++)
+		fi->bad += sl[k].bad;
+	for (j = 0; j < fi->frame_count; j++)
+		for (k = 0; k < filters * slicers; k++)
+			if (fi->frames[j].slicers & (1u << k))
+				fi->good[k]++;
+out:
+	free(ring);
+	free(in);
+	fclose(fp);
+	fi->ms = now_ms() - ms;
+}
+
+static void *decode_job(void *arg) {
+	int i;
+
+	while ((i = __atomic_fetch_add(&file_next, 1, __ATOMIC_RELAXED)) < file_count)
+		decode_file(&files[i]);
+	return NULL;
+}
+
+// An address as CALL-SSID; 1 for the last one
+static int print_address(const uint8_t *a) {
+	int i;
+
+	for (i = 0; i < 6 && (a[i] >> 1) != ' '; i++)
+		putchar(a[i] >> 1);
+	if ((a[6] >> 1) & 0xf)
+		printf("-%d", (a[6] >> 1) & 0xf);
+	return a[6] & 1;
+}
+
+// TNC2 monitor format: source>destination,digipeaters:info
+static void print_frame(const file_t *fi, const frame_t *fr) {
+	const uint8_t *d = fr->data;
+	int n, i, k;
+
+	printf("%s %9.3fs ", fi->path, (double)fr->sample / fi->rate);
+	for (n = 7; n < fr->len && !(d[n - 1] & 1); n += 7)
+		;
+	if (n < 14 || n >= fr->len) {
+		printf("(not AX.25, %d bytes)\n", fr->len);
+		return;
+	}
+	print_address(d + 7);
+	putchar('>');
+	print_address(d);
+	for (k = 14; k < n; k += 7) {
+		putchar(',');
+		print_address(d + k);
+		if (d[k + 6] & 0x80)
+			putchar('*');
+	}
+	putchar(':');
+	/* UI frames have a PID before the info */
+	i = n + 1 + (d[n] == 0x03 && n + 1 < fr->len);
+	for (; i < fr->len; i++)
+		if (d[i] >= ' ' && d[i] < 127)
+			putchar(d[i]);
+		else
+			printf("<0x%02x>", d[i]);
+	putchar('\n');
+}
+
+int main(int argc, char **argv) {
+	pthread_t *thread;
+	unsigned total = 0, bad = 0, good[FILTERS_MAX * SLICERS_MAX] = {0}, expect = 0;
+	double seconds = 0, t_ms;
+	int threads = 0, quiet = 0, failed = 0;
+	int i, j, k;
+
+	while (1) {
+		int opt;
+		int opt_index;
+
+		opt_index = 0;
+		opt = getopt_long(argc, argv, "", long_options, &opt_index);
+		if (opt == -1)
+			break;
+		switch (opt) {
+			case 'e':
+				expect = strtoul(optarg, NULL, 0);
+				break;
+			case 'f':
+				if (strcmp(optarg, "s16") == 0)
+					in_format = FORMAT_S16;
+				else if (strcmp(optarg, "f32") == 0)
+					in_format = FORMAT_F32;
+				else {
+					fprintf(stderr, "aprs: invalid format %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'F':
+				filters = atoi(optarg);
+				break;
+			case 'h':
+				fprintf(stderr,
+					"Usage: aprs [options] <file> ...\n"
+					"Options:\n"
+					"  --expect=<n>        Fail unless at least <n> frames are decoded\n"
+					"  --filters=<n>       Correlator windows, from a bit down [1 .. %d, 2]\n"
+					"  --format=<f>        s16 or f32, of raw files [s16]\n"
+					"  --help              Show this help\n"
+					"  --iq                The files are I/Q, FM demodulated first\n"
+					"  --quiet             Only the counts, not the frames\n"
+					"  --rate=<n>          Samples per second of raw files [48000]\n"
+					"  --slicers=<n>       Slicers per filter, mark from -%d to +%d dB [1 .. %d, 5]\n"
+					"  --threads=<n>       Files decoded at once [number of CPUs]\n"
+					"WAV files bring their own rate and format.\n",
+					FILTERS_MAX, SLICER_TILT_DB, SLICER_TILT_DB, SLICERS_MAX);
+				return 0;
+			case 'q':
+				in_iq = 1;
+				break;
+			case 'Q':
+				quiet = 1;
+				break;
+			case 'r':
+				in_rate = strtoul(optarg, NULL, 0);
+				break;
+			case 's':
+				slicers = atoi(optarg);
+				break;
+			case 'T':
+				threads = atoi(optarg);
+				break;
+			default:
+				fprintf(stderr, "aprs: invalid options\n");
+				return 1;
+		}
+	}
+	if (optind == argc) {
+		fprintf(stderr, "aprs: no files\n");
+		return 1;
+	}
+	if (filters < 1 || filters > FILTERS_MAX || slicers < 1 || slicers > SLICERS_MAX) {
+		fprintf(stderr, "aprs: invalid filters or slicers\n");
+		return 1;
+	}
+	if (in_rate < 4 * AFSK_SPACE) {
+		fprintf(stderr, "aprs: rate %u too low\n", in_rate);
+		return 1;
+	}
+	crc_init();
+	file_count = argc - optind;
+	if (!(files = calloc(file_count, sizeof(*files))))
+		return 1;
+	for (i = 0; i < file_count; i++)
+		files[i].path = argv[optind + i];
+
+	if (threads <= 0)
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (threads < 1)
+		threads = 1;
+	if (threads > file_count)
+		threads = file_count;
+	if (!(thread = calloc(threads, sizeof(*thread))))
+		return 1;
+	t_ms = now_ms();
+	for (i = 1; i < threads; i++)
+		if (pthread_create(&thread[i], NULL, decode_job, NULL) != 0)
+			thread[i] = 0;
+	decode_job(NULL);
+	for (i = 1; i < threads; i++)
+		if (thread[i])
+			pthread_join(thread[i], NULL);
+	t_ms = now_ms() - t_ms;
+
+	for (i = 0; i < file_count; i++) {
+		if (files[i].error[0]) {
+			fprintf(stderr, "aprs: %s: %s\n", files[i].path, files[i].error);
+			failed = 1;
+			continue;
+		}
+		if (!quiet)
+			for (j = 0; j < files[i].frame_count; j++)
+				print_frame(&files[i], &files[i].frames[j]);
+		printf("File:                 %s, %.1f s, %d frames, %u CRC errors, %.0fx real time\n",
+			files[i].path, files[i].seconds, files[i].frame_count, files[i].bad,
+			files[i].seconds * 1000 / (files[i].ms > 0 ? files[i].ms : 1e-3));
+		total += files[i].frame_count;
+		bad += files[i].bad;
+		seconds += files[i].seconds;
+		for (k = 0; k < filters * slicers; k++)
+			good[k] += files[i].good[k];
+	}
+	for (k = 0; k < filters * slicers; k++)
+		printf("Slicer:               %.2f bit %+5.1f dB, %u frames, %.1f%%\n", filter_bits(k / slicers),
+			slicer_gain_db(k % slicers), good[k], total ? 100.0 * good[k] / total : 0);
+	printf("Decoded:              %u frames, %u CRC errors, %.1f s in %.1f ms on %d threads, %.0fx real time\n",
+		total, bad, seconds, t_ms, threads, seconds * 1000 / (t_ms > 0 ? t_ms : 1e-3));
+	return failed || total < expect;
+}
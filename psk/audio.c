@@ -0,0 +1,297 @@
+/*
+ * I/Q output through an audio codec. See audio.h.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sound/asound.h>
+#include "audio.h"
+
+#define FRAME_SIZE      (2 * sizeof(int16_t))
+
+static double now_us(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+// As ALSA does: the largest multiple of the buffer that cannot overflow
+static void set_boundary(audio_t *a) {
+	for (a->boundary = a->buffer; a->boundary * 2 <= LONG_MAX - a->buffer; a->boundary *= 2)
+		;
+}
+
+static void param_mask(struct snd_pcm_hw_params *p, int n, unsigned bit) {
+	struct snd_mask *m = &p->masks[n - SNDRV_PCM_HW_PARAM_FIRST_MASK];
+
+	memset(m, 0, sizeof(*m));
+	m->bits[bit >> 5] |= 1u << (bit & 31);
+}
+
+static void param_int(struct snd_pcm_hw_params *p, int n, unsigned v) {
+	struct snd_interval *i = &p->intervals[n - SNDRV_PCM_HW_PARAM_FIRST_INTERVAL];
+
+	i->min = i->max = v;
+	i->integer = 1;
+}
+
+static unsigned param_get(const struct snd_pcm_hw_params *p, int n) {
+	return p->intervals[n - SNDRV_PCM_HW_PARAM_FIRST_INTERVAL].max;
+}
+
+// "hw:<card>,<device>"
+static int alsa_open(audio_t *a, const char *dev, unsigned periods) {
+	struct snd_pcm_hw_params hw;
+	struct snd_pcm_sw_params sw;
+	unsigned card, device;
+	char path[32];
+	int n;
+
+	if (sscanf(dev, "hw:%u,%u", &card, &device) != 2) {
+		errno = EINVAL;
+		return -1;
+	}
+	snprintf(path, sizeof(path), "/dev/snd/pcmC%uD%up", card, device);
+	if ((a->fd = open(path, O_RDWR)) < 0)
+		return -1;
+
+	memset(&hw, 0, sizeof(hw));
+	for (n = SNDRV_PCM_HW_PARAM_FIRST_MASK; n <= SNDRV_PCM_HW_PARAM_LAST_MASK; n++)
+		memset(&hw.masks[n - SNDRV_PCM_HW_PARAM_FIRST_MASK], 0xff, sizeof(struct snd_mask));
+	for (n = SNDRV_PCM_HW_PARAM_FIRST_INTERVAL; n <= SNDRV_PCM_HW_PARAM_LAST_INTERVAL; n++)
+		hw.intervals[n - SNDRV_PCM_HW_PARAM_FIRST_INTERVAL].max = ~0u;
+	hw.rmask = ~0u;
+	hw.info = ~0u;
+	param_mask(&hw, SNDRV_PCM_HW_PARAM_ACCESS, SNDRV_PCM_ACCESS_MMAP_INTERLEAVED);
+	param_mask(&hw, SNDRV_PCM_HW_PARAM_FORMAT, SNDRV_PCM_FORMAT_S16_LE);
+	param_mask(&hw, SNDRV_PCM_HW_PARAM_SUBFORMAT, SNDRV_PCM_SUBFORMAT_STD);
+	param_int(&hw, SNDRV_PCM_HW_PARAM_SAMPLE_BITS, 16);
+	param_int(&hw, SNDRV_PCM_HW_PARAM_FRAME_BITS, 32);
+	param_int(&hw, SNDRV_PCM_HW_PARAM_CHANNELS, 2);
+	param_int(&hw, SNDRV_PCM_HW_PARAM_RATE, a->rate);
+	param_int(&hw, SNDRV_PCM_HW_PARAM_PERIOD_SIZE, a->period);
+	param_int(&hw, SNDRV_PCM_HW_PARAM_PERIODS, periods);
+	if (ioctl(a->fd, SNDRV_PCM_IOCTL_HW_PARAMS, &hw) < 0)
+		return -1;
+	a->period = param_get(&hw, SNDRV_PCM_HW_PARAM_PERIOD_SIZE);
+	a->buffer = param_get(&hw, SNDRV_PCM_HW_PARAM_BUFFER_SIZE);
+	set_boundary(a);
+
+	memset(&sw, 0, sizeof(sw));
+	sw.tstamp_mode = SNDRV_PCM_TSTAMP_NONE;
+	sw.period_step = 1;
+	sw.avail_min = a->period;
+	/* Started by hand once the buffer is full, stopped when it runs empty */
+	sw.start_threshold = a->buffer;
+	sw.stop_threshold = a->buffer;
+	sw.boundary = a->boundary;
+	sw.proto = SNDRV_PCM_VERSION;
+	if (ioctl(a->fd, SNDRV_PCM_IOCTL_SW_PARAMS, &sw) < 0)
+		return -1;
+	a->boundary = sw.boundary;
+
+	a->data = mmap(NULL, a->buffer * FRAME_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, a->fd,
+		SNDRV_PCM_MMAP_OFFSET_DATA);
+	if (a->data == MAP_FAILED) {
+		a->data = NULL;
+		return -1;
+	}
+	return ioctl(a->fd, SNDRV_PCM_IOCTL_PREPARE);
+}
+
+// Exchange the pointers with the driver; -1 after an xrun
+static int alsa_sync(audio_t *a, unsigned flags) {
+	struct snd_pcm_sync_ptr sp;
+
+	memset(&sp, 0, sizeof(sp));
+	sp.flags = flags;
+	sp.c.control.appl_ptr = a->appl_ptr;
+	sp.c.control.avail_min = a->period;
+	if (ioctl(a->fd, SNDRV_PCM_IOCTL_SYNC_PTR, &sp) < 0)
+		return errno == EPIPE ? -1 : -2;
+	a->hw_ptr = sp.s.status.hw_ptr;
+	if (flags & SNDRV_PCM_SYNC_PTR_APPL)
+		a->appl_ptr = sp.c.control.appl_ptr;
+	return sp.s.status.state == SNDRV_PCM_STATE_XRUN ? -1 : 0;
+}
+
+int audio_open(audio_t *a, const char *dev, unsigned rate, unsigned period, unsigned periods) {
+	memset(a, 0, sizeof(*a));
+	a->fd = -1;
+	a->rate = rate;
+	a->period = period;
+	a->buffer = period * periods;
+	a->latency_min_us = 1e12;
+	if (!period || periods < 2) {
+		errno = EINVAL;
+		return -1;
+	}
+	set_boundary(a);
+	if (strcmp(dev, "null") == 0) {
+		a->kind = AUDIO_NULL;
+	} else if (strncmp(dev, "file:", 5) == 0) {
+		a->kind = AUDIO_FILE;
+		if ((a->fd = open(dev + 5, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+			return -1;
+	} else {
+		a->kind = AUDIO_ALSA;
+		if (alsa_open(a, dev, periods) < 0) {
+			audio_close(a);
+			return -1;
+		}
+		return 0;
+	}
+	if (!(a->data = calloc(a->buffer, FRAME_SIZE)))
+		return -1;
+	return 0;
+}
+
+// Frames queued and not played yet
+static unsigned long queued(const audio_t *a) {
+	return (a->appl_ptr + a->boundary - a->hw_ptr) % a->boundary;
+}
+
+static void xrun(audio_t *a) {
+	a->xruns++;
+	a->running = 0;
+	if (a->kind == AUDIO_ALSA) {
+		ioctl(a->fd, SNDRV_PCM_IOCTL_PREPARE);
+		alsa_sync(a, SNDRV_PCM_SYNC_PTR_HWSYNC | SNDRV_PCM_SYNC_PTR_APPL);
+	} else {
+		a->hw_ptr = a->appl_ptr;
+	}
+}
+
+// Where the codec is; -1 after an xrun
+static int update(audio_t *a) {
+	double played;
+
+	switch (a->kind) {
+		case AUDIO_ALSA:
+			return alsa_sync(a, SNDRV_PCM_SYNC_PTR_HWSYNC);
+		case AUDIO_NULL:
+			if (!a->running)
+				return 0;
+			played = (now_us() - (a->t_start.tv_sec * 1000000.0 + a->t_start.tv_nsec / 1000.0)) * a->rate / 1e6;
+			if (played >= a->frames)
+				return -1;
+			a->hw_ptr = (unsigned long)played % a->boundary;
+			return 0;
+		default:
+			a->hw_ptr = a->appl_ptr;
+			return 0;
+	}
+}
+
+// Room for up to *frames frames, at most a period, in the buffer
+int16_t *audio_begin(audio_t *a, unsigned *frames) {
+	struct pollfd pfd;
+	unsigned long avail, off;
+	int r;
+
+	for (;;) {
+		if ((r = update(a)) == -2)
+			return NULL;
+		if (r == -1)
+			xrun(a);
+		avail = a->buffer - queued(a);
+		if (avail >= a->period || (!a->running && avail > 0))
+			break;
+		if (a->kind == AUDIO_ALSA) {
+			pfd.fd = a->fd;
+			pfd.events = POLLOUT;
+			if (poll(&pfd, 1, 1000) < 0 && errno != EINTR)
+				return NULL;
+		} else {
+			usleep((a->period - avail) * 1000000ULL / a->rate);
+		}
+	}
+	off = a->appl_ptr % a->buffer;
+	if (avail > a->buffer - off)
+		avail = a->buffer - off;
+	if (avail > a->period)
+		avail = a->period;
+	*frames = avail;
+	return a->data + off * 2;
+}
+
+// Hand over frames written at what audio_begin returned
+int audio_commit(audio_t *a, unsigned frames) {
+	long delay;
+
+	if (a->kind == AUDIO_FILE &&
+			write(a->fd, a->data + (a->appl_ptr % a->buffer) * 2, frames * FRAME_SIZE) != frames * FRAME_SIZE)
+		return -1;
+	a->appl_ptr = (a->appl_ptr + frames) % a->boundary;
+	a->frames += frames;
+	if (a->kind == AUDIO_ALSA && alsa_sync(a, 0) == -2)
+		return -1;
+	if (a->kind == AUDIO_FILE)
+		return 0;
+
+	/* Start with a full buffer, after an xrun too */
+	if (!a->running && queued(a) >= a->buffer) {
+		if (a->kind == AUDIO_ALSA && ioctl(a->fd, SNDRV_PCM_IOCTL_START) < 0) {
+			if (errno != EPIPE)
+				return -1;
+			xrun(a);
+			return 0;
+		}
+		if (a->kind == AUDIO_NULL) {
+			clock_gettime(CLOCK_MONOTONIC, &a->t_start);
+			/* What is queued is played from now on */
+			a->t_start.tv_sec -= (time_t)((a->frames - a->buffer) / a->rate);
+			a->t_start.tv_nsec -= (long)((a->frames - a->buffer) % a->rate * 1000000000ULL / a->rate);
+			while (a->t_start.tv_nsec < 0) {
+				a->t_start.tv_nsec += 1000000000;
+				a->t_start.tv_sec--;
+			}
+			a->hw_ptr = (a->frames - a->buffer) % a->boundary;
+		}
+		a->running = 1;
+		return 0;
+	}
+	if (!a->running)
+		return 0;
+
+	/* Output latency: what the codec has still to play */
+	if (a->kind == AUDIO_ALSA) {
+		if (ioctl(a->fd, SNDRV_PCM_IOCTL_DELAY, &delay) < 0)
+			return 0;
+	} else {
+		update(a);
+		delay = queued(a);
+	}
+	a->latency_us = delay * 1e6 / a->rate;
+	if (a->latency_us < a->latency_min_us)
+		a->latency_min_us = a->latency_us;
+	if (a->latency_us > a->latency_max_us)
+		a->latency_max_us = a->latency_us;
+	a->latency_sum_us += a->latency_us;
+	a->latency_count++;
+	return 0;
+}
+
+void audio_close(audio_t *a) {
+	if (a->kind == AUDIO_ALSA) {
+		if (a->fd >= 0)
+			ioctl(a->fd, SNDRV_PCM_IOCTL_DROP);
+		if (a->data)
+			munmap(a->data, a->buffer * FRAME_SIZE);
+	} else {
+		free(a->data);
+	}
+	a->data = NULL;
+	if (a->fd >= 0)
+		close(a->fd);
+	a->fd = -1;
+}
@@ -0,0 +1,54 @@
+/*
+ * I/Q output through an audio codec, left I and right Q, 16 bit.
+ *
+ * The ALSA sink talks to the kernel PCM device directly, in mmap mode: the
+ * producer is handed a piece of the DMA buffer of the codec and renders into
+ * it, nothing is copied on the way. The buffer is a number of periods; the
+ * stream starts once the buffer has been filled, and an underrun (xrun) is
+ * counted, the stream prepared again and restarted the same way. The delay
+ * of the codec is measured at every period, which is the output latency.
+ *
+ * The null sink plays at the sample rate into nowhere, and the file sink
+ * writes the samples as fast as they come, for tests without a codec.
+ */
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <stdint.h>
+#include <time.h>
+
+enum {
+	AUDIO_ALSA,
+	AUDIO_NULL,
+	AUDIO_FILE,
+};
+
+typedef struct {
+	int kind;
+	int fd;
+	unsigned rate;
+	unsigned period;        /* Frames */
+	unsigned buffer;        /* Frames, a number of periods */
+	int16_t *data;          /* The buffer, mapped from the codec or allocated */
+	/* Stream */
+	unsigned long boundary; /* Where the pointers wrap */
+	unsigned long appl_ptr;
+	unsigned long hw_ptr;
+	int running;
+	struct timespec t_start;        /* Null sink clock */
+	/* Statistics */
+	uint64_t frames;
+	unsigned xruns;
+	double latency_us;      /* Of the last period */
+	double latency_min_us;
+	double latency_max_us;
+	double latency_sum_us;
+	unsigned latency_count;
+} audio_t;
+
+int audio_open(audio_t *a, const char *dev, unsigned rate, unsigned period, unsigned periods);
+int16_t *audio_begin(audio_t *a, unsigned *frames);
+int audio_commit(audio_t *a, unsigned frames);
+void audio_close(audio_t *a);
+
+#endif
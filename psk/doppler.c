@@ -0,0 +1,258 @@
+/*
+ * Predict the passes of a satellite over a ground station and write the
+ * Doppler correction trajectory that psk31 --doppler applies to the carrier.
+ *
+ * Each line of the trajectory is "<unix time> <factor>". The carrier is
+ * multiplied by factor = 1 / (1 - range_rate / c), so the far end receives the
+ * nominal frequency. Passes are separated by an empty line; outside a pass
+ * no correction is applied.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <getopt.h>
+#include "sgp4.h"
+
+#define C_KM_S          299792.458
+#define COARSE_STEP     30.0
+
+static const struct option long_options[] = {
+	{"altitude", required_argument, NULL, 'a'},
+	{"frequency", required_argument, NULL, 'f'},
+	{"help", no_argument, NULL, 'h'},
+	{"hours", required_argument, NULL, 'H'},
+	{"latitude", required_argument, NULL, 'l'},
+	{"longitude", required_argument, NULL, 'L'},
+	{"min-elevation", required_argument, NULL, 'e'},
+	{"name", required_argument, NULL, 'n'},
+	{"output", required_argument, NULL, 'o'},
+	{"start", required_argument, NULL, 's'},
+	{"step", required_argument, NULL, 'S'},
+	{"tle", required_argument, NULL, 't'},
+	{NULL, 0, NULL, 0}
+};
+
+static double now_ms(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void chomp(char *s) {
+	size_t n = strlen(s);
+
+	while (n && (s[n - 1] == '\n' || s[n - 1] == '\r' || s[n - 1] == ' '))
+		s[--n] = 0;
+}
+
+// Find a satellite by name in a 2 or 3 line element file, the first one if no name
+static int load_tle(sgp4_t *sat, const char *fn, const char *name) {
+	char l0[128], l1[128], l2[128];
+	FILE *f;
+
+	if (!(f = fopen(fn, "r")))
+		return -1;
+	l0[0] = 0;
+	while (fgets(l1, sizeof(l1), f)) {
+		chomp(l1);
+		if (l1[0] != '1') {
+			strcpy(l0, l1);
+			continue;
+		}
+		if (!fgets(l2, sizeof(l2), f))
+			break;
+		chomp(l2);
+		if (name && !strstr(l0, name))
+			continue;
+		memset(sat, 0, sizeof(*sat));
+		snprintf(sat->name, sizeof(sat->name), "%s", l0);
+		fclose(f);
+		if (sgp4_parse_tle(sat, l1, l2) < 0 || sgp4_init(sat) < 0)
+			return -1;
+		return 0;
+	}
+	fclose(f);
+	return -1;
+}
+
+int main(int argc, char **argv) {
+	const char *tle_fn = NULL;
+	const char *name = NULL;
+	const char *out_fn = NULL;
+	double lat = 0, lon = 0, alt = 0;
+	double start = 0, hours = 24, step = 1.0;
+	double min_el = 0, frequency = 0;
+	sgp4_t sat;
+	sgp4_site_t site;
+	sgp4_look_t *coarse, *fine;
+	int n_coarse, n_fine, fine_max;
+	int i, j, passes, steps;
+	double t0, ms, ms_prop;
+	FILE *out;
+
+	while (1) {
+		int opt;
+		int opt_index;
+
+		opt_index = 0;
+		opt = getopt_long(argc, argv, "o:t:", long_options, &opt_index);
+		if (opt == -1)
+			break;
+		switch (opt) {
+			case 'a':
+				alt = atof(optarg);
+				break;
+			case 'e':
+				min_el = atof(optarg);
+				break;
+			case 'f':
+				frequency = atof(optarg);
+				break;
+			case 'h':
+				fprintf(stderr,
+					"Options:\n"
+					"  --altitude=<m>      Ground station altitude [0]\n"
+					"  --frequency=<f>     Nominal carrier, in MHz, to show the shift in Hz\n"
+					"  --help              Show this help\n"
+					"  --hours=<n>         Length of the prediction [24]\n"
+					"  --latitude=<deg>    Ground station latitude, north positive\n"
+					"  --longitude=<deg>   Ground station longitude, east positive\n"
+					"  --min-elevation=<deg> Lowest elevation of a pass [0]\n"
+					"  --name=<s>          Satellite name in the TLE file [first one]\n"
+					"  --output=<file>     Trajectory file [stdout]\n"
+					"  --start=<t>         Start, in unix time [now]\n"
+					"  --step=<s>          Trajectory time step [1]\n"
+					"  --tle=<file>        Two or three line element file\n");
+				return 0;
+			case 'H':
+				hours = atof(optarg);
+				break;
+			case 'l':
+				lat = atof(optarg);
+				break;
+			case 'L':
+				lon = atof(optarg);
+				break;
+			case 'n':
+				name = optarg;
+				break;
+			case 'o':
+				out_fn = optarg;
+				break;
+			case 's':
+				start = atof(optarg);
+				break;
+			case 'S':
+				step = atof(optarg);
+				break;
+			case 't':
+				tle_fn = optarg;
+				break;
+			default:
+				fprintf(stderr, "doppler: invalid options\n");
+				return 1;
+		}
+	}
+	if (!tle_fn || step <= 0 || hours <= 0) {
+		fprintf(stderr, "doppler: a TLE file and a positive step and length are needed\n");
+		return 1;
+	}
+	if (load_tle(&sat, tle_fn, name) < 0) {
+		fprintf(stderr, "doppler: no usable near earth element set in %s\n", tle_fn);
+		return 1;
+	}
+	if (start == 0)
+		start = time(NULL);
+	sgp4_site(&site, lat, lon, alt);
+	out = stdout;
+	if (out_fn && !(out = fopen(out_fn, "w"))) {
+		fprintf(stderr, "doppler: cannot create %s: %m\n", out_fn);
+		return 1;
+	}
+
+	/* Coarse scan for the passes */
+	n_coarse = (int)(hours * 3600.0 / COARSE_STEP) + 1;
+	fine_max = (int)(2 * COARSE_STEP / step) + 2;
+	coarse = malloc(n_coarse * sizeof(*coarse));
+	fine = malloc(fine_max * sizeof(*fine));
+	if (!coarse || !fine) {
+		fprintf(stderr, "doppler: out of memory\n");
+		return 1;
+	}
+	ms = now_ms();
+	steps = n_coarse;
+	if (sgp4_look_batch(&sat, &site, start, COARSE_STEP, n_coarse, coarse) < 0) {
+		fprintf(stderr, "doppler: propagation failed\n");
+		return 1;
+	}
+	ms_prop = now_ms() - ms;
+
+	fprintf(out, "# psk31 doppler trajectory\n");
+	fprintf(out, "# sat %s site %f %f %f\n", sat.name, lat, lon, alt);
+	passes = 0;
+	for (i = 0; i < n_coarse; i++) {
+		double aos, los, max_el;
+		int k;
+
+		if (coarse[i].el * 180.0 / M_PI < min_el)
+			continue;
+		/* Extend by a coarse step on either side and refine */
+		for (j = i; j + 1 < n_coarse && coarse[j + 1].el * 180.0 / M_PI >= min_el; j++)
+			;
+		t0 = coarse[i].t - COARSE_STEP;
+		n_fine = (int)((coarse[j].t + COARSE_STEP - t0) / step) + 1;
+		if (n_fine > fine_max) {
+			fine_max = n_fine;
+			if (!(fine = realloc(fine, fine_max * sizeof(*fine)))) {
+				fprintf(stderr, "doppler: out of memory\n");
+				return 1;
+			}
+		}
+		ms = now_ms();
+		if (sgp4_look_batch(&sat, &site, t0, step, n_fine, fine) < 0) {
+			fprintf(stderr, "doppler: propagation failed\n");
+			return 1;
+		}
+		ms_prop += now_ms() - ms;
+		steps += n_fine;
+		aos = los = max_el = 0;
+		for (k = 0; k < n_fine; k++) {
+			if (fine[k].el * 180.0 / M_PI < min_el)
+				continue;
+			if (aos == 0)
+				aos = fine[k].t;
+			los = fine[k].t;
+			if (fine[k].el > max_el)
+				max_el = fine[k].el;
+		}
+		if (aos != 0) {
+			if (passes)
+				fprintf(out, "\n");
+			fprintf(out, "# pass %.0f %.0f %.1f\n", aos, los, max_el * 180.0 / M_PI);
+			for (k = 0; k < n_fine; k++) {
+				double factor;
+
+				if (fine[k].t < aos || fine[k].t > los)
+					continue;
+				factor = 1.0 / (1.0 - fine[k].range_rate / C_KM_S);
+				if (frequency > 0)
+					fprintf(out, "%.3f %.12f %.1f\n", fine[k].t, factor, (factor - 1.0) * frequency * 1e6);
+				else
+					fprintf(out, "%.3f %.12f\n", fine[k].t, factor);
+			}
+			passes++;
+		}
+		i = j;
+	}
+	fprintf(stderr, "doppler: %s, %d passes, %d steps propagated in %.2fms (%.0f steps/ms)\n",
+		sat.name, passes, steps, ms_prop, steps / (ms_prop > 0 ? ms_prop : 1e-3));
+	if (out != stdout)
+		fclose(out);
+	free(coarse);
+	free(fine);
+	return 0;
+}
@@ -0,0 +1,77 @@
+/*
+ * Radix 2 FFT. See fft.h.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include "fft.h"
+
+int fft_init(fft_t *f, unsigned n) {
+	unsigned i, j, k;
+
+	memset(f, 0, sizeof(*f));
+	if (n < 2 || (n & (n - 1))) {
+		errno = EINVAL;
+		return -1;
+	}
+	f->n = n;
+	f->twiddle = malloc(n * sizeof(float));
+	f->swap = malloc(n * sizeof(unsigned));
+	if (!f->twiddle || !f->swap) {
+		fft_free(f);
+		errno = ENOMEM;
+		return -1;
+	}
+	for (i = 0; i < n / 2; i++) {
+		f->twiddle[i * 2] = cos(-2 * M_PI * i / n);
+		f->twiddle[i * 2 + 1] = sin(-2 * M_PI * i / n);
+	}
+	for (i = 1, j = 0; i < n; i++) {
+		for (k = n >> 1; j & k; k >>= 1)
+			j ^= k;
+		j |= k;
+		if (i < j) {
+			f->swap[f->swaps * 2] = i;
+			f->swap[f->swaps * 2 + 1] = j;
+			f->swaps++;
+		}
+	}
+	return 0;
+}
+
+void fft_run(const fft_t *f, float *x, int inverse) {
+	unsigned i, j, k, len, half, step;
+	float wr, wi, tr, ti, t;
+	float sign = inverse ? -1 : 1;
+
+	for (i = 0; i < f->swaps; i++) {
+		j = f->swap[i * 2] * 2;
+		k = f->swap[i * 2 + 1] * 2;
+		t = x[j]; x[j] = x[k]; x[k] = t;
+		t = x[j + 1]; x[j + 1] = x[k + 1]; x[k + 1] = t;
+	}
+	for (len = 2; len <= f->n; len <<= 1) {
+		half = len / 2;
+		step = f->n / len;
+		for (i = 0; i < f->n; i += len)
+			for (k = 0; k < half; k++) {
+				wr = f->twiddle[k * step * 2];
+				wi = sign * f->twiddle[k * step * 2 + 1];
+				j = (i + k + half) * 2;
+				tr = x[j] * wr - x[j + 1] * wi;
+				ti = x[j] * wi + x[j + 1] * wr;
+				x[j] = x[(i + k) * 2] - tr;
+				x[j + 1] = x[(i + k) * 2 + 1] - ti;
+				x[(i + k) * 2] += tr;
+				x[(i + k) * 2 + 1] += ti;
+			}
+	}
+}
+
+void fft_free(fft_t *f) {
+	free(f->twiddle);
+	free(f->swap);
+	f->twiddle = NULL;
+	f->swap = NULL;
+}
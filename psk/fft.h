@@ -0,0 +1,22 @@
+/*
+ * Radix 2 FFT of interleaved complex floats, in place, with the twiddles and
+ * the bit reversal worked out once for a size.
+ */
+#ifndef FFT_H
+#define FFT_H
+
+typedef struct {
+	unsigned n;             /* A power of 2 */
+	float *twiddle;         /* n / 2 of them, I/Q */
+	unsigned *swap;         /* Pairs to exchange for the bit reversal */
+	unsigned swaps;
+} fft_t;
+
+int fft_init(fft_t *f, unsigned n);
+
+// Forward, or inverse without the 1 / n
+void fft_run(const fft_t *f, float *x, int inverse);
+
+void fft_free(fft_t *f);
+
+#endif
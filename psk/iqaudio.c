@@ -0,0 +1,305 @@
+/*
+ * Play I/Q through an audio codec (see audio.h), I on the left and Q on the
+ * right: from an I/Q ring (see iqring.h), PSK31 from text, or a test tone.
+ *
+ * The samples are converted straight into the buffer of the codec. A ring at
+ * another rate, and the PSK31 modulator, which works at 1 kHz, go through
+ * the resampler (see resample.h) first. When the ring runs dry the codec gets
+ * silence rather than stopping, and the missing frames are counted. The
+ * latency and the xruns are shown every few seconds and when stopped.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <signal.h>
+#include <getopt.h>
+#include "audio.h"
+#include "iqring.h"
+#include "resample.h"
+#include "varicode.h"
+
+#define IQAUDIO_REPORT_S 5
+#define IQAUDIO_BLOCK   1024    /* Frames resampled at a time, about */
+#define PSK31_RATE      1000    /* Of the modulator */
+#define PSK31_SAMPLES   32      /* A symbol, at 31.25 baud */
+
+static const burst_t gap_burst = {20, 0};
+
+// Frames on their way from the source rate to the codec rate
+typedef struct {
+	resample_t rs;
+	float *in;
+	unsigned in_max;
+	float *out;
+	unsigned len, pos;
+} conv_t;
+
+// PSK31 at baseband on I, sending the text over and over
+typedef struct {
+	const char *text;
+	const char *next;
+	burst_t burst;
+	float level;
+} psk31_t;
+
+static const struct option long_options[] = {
+	{"device", required_argument, NULL, 'd'},
+	{"help", no_argument, NULL, 'h'},
+	{"period", required_argument, NULL, 'p'},
+	{"periods", required_argument, NULL, 'n'},
+	{"rate", required_argument, NULL, 'r'},
+	{"ring", required_argument, NULL, 'i'},
+	{"seconds", required_argument, NULL, 's'},
+	{"taps", required_argument, NULL, 'T'},
+	{"text", required_argument, NULL, 'x'},
+	{"tone", required_argument, NULL, 't'},
+	{NULL, 0, NULL, 0}
+};
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig) {
+	stop = 1;
+}
+
+static int16_t to_s16(float v) {
+	if (v >= 1.0f)
+		return 32767;
+	if (v <= -1.0f)
+		return -32767;
+	return (int16_t)lrintf(v * 32767.0f);
+}
+
+// Up to frames frames from the ring into out; returns how many
+static unsigned from_ring(iqring_t *r, int16_t *out, unsigned frames) {
+	unsigned done = 0, n, i;
+	const void *p;
+
+	while (done < frames && (n = iqring_readable(r, &p)) != 0) {
+		if (n > frames - done)
+			n = frames - done;
+		if (r->hdr->format == IQRING_S16) {
+			memcpy(out + done * 2, p, n * 2 * sizeof(int16_t));
+		} else {
+			for (i = 0; i < n * 2; i++)
+				out[done * 2 + i] = to_s16(((const float *)p)[i]);
+		}
+		iqring_release(r, n);
+		done += n;
+	}
+	return done;
+}
+
+// n frames, whole symbols, of PSK31: a zero reverses the phase over a symbol
+static void psk31_render(psk31_t *m, float *in, unsigned n) {
+	unsigned i, k;
+	int bit;
+
+	for (i = 0; i < n; i += PSK31_SAMPLES) {
+		if (m->burst.b_len == 0) {
+			if (*m->next) {
+				m->burst = varicode_table[(uint8_t)*m->next++];
+			} else {
+				m->burst = gap_burst;
+				m->next = m->text;
+			}
+		}
+		bit = m->burst.b_val & 1;
+		m->burst.b_val >>= 1;
+		m->burst.b_len--;
+		for (k = 0; k < PSK31_SAMPLES; k++) {
+			in[(i + k) * 2] = bit ? m->level : m->level * cosf(M_PI * k / PSK31_SAMPLES);
+			in[(i + k) * 2 + 1] = 0;
+		}
+		if (!bit)
+			m->level = -m->level;
+	}
+}
+
+static void report(const audio_t *a, unsigned long long missing) {
+	printf("Output:               %llu frames, %u xruns, %llu frames missing\n",
+		(unsigned long long)a->frames, a->xruns, missing);
+	if (a->latency_count)
+		printf("Latency:              %.0f us, %.0f min, %.0f avg, %.0f max\n", a->latency_us,
+			a->latency_min_us, a->latency_sum_us / a->latency_count, a->latency_max_us);
+	fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+	const char *device = "hw:0,0", *ring = NULL;
+	unsigned rate = 48000, period = 256, periods = 4;
+	const char *text = NULL;
+	double tone = 0, seconds = 0, phase = 0;
+	unsigned long long missing = 0, next_report;
+	unsigned taps = 16, in_rate = 0;
+	iqring_t r;
+	audio_t a;
+	conv_t c;
+	psk31_t m;
+	int16_t *out;
+	unsigned frames, n, k, i;
+
+	while (1) {
+		int opt;
+		int opt_index;
+
+		opt_index = 0;
+		opt = getopt_long(argc, argv, "d:", long_options, &opt_index);
+		if (opt == -1)
+			break;
+		switch (opt) {
+			case 'd':
+				device = optarg;
+				break;
+			case 'h':
+				fprintf(stderr,
+					"Usage: iqaudio --ring=<path>|--text=<text>|--tone=<Hz> [options]\n"
+					"Options:\n"
+					"  --device=<dev>      hw:<card>,<device>, null or file:<path> [hw:0,0]\n"
+					"  --help              Show this help\n"
+					"  --period=<n>        Frames per period [256]\n"
+					"  --periods=<n>       Periods in the buffer [4]\n"
+					"  --rate=<n>          Samples per second [48000]\n"
+					"  --ring=<path>       Play the I/Q ring\n"
+					"  --seconds=<s>       Stop after this long [0 = never]\n"
+					"  --taps=<n>          Resampler taps per phase [16]\n"
+					"  --text=<text>       Send the text in PSK31, over and over\n"
+					"  --tone=<Hz>         Play a test tone, I cos and Q sin\n");
+				return 0;
+			case 'i':
+				ring = optarg;
+				break;
+			case 'n':
+				periods = strtoul(optarg, NULL, 0);
+				break;
+			case 'p':
+				period = strtoul(optarg, NULL, 0);
+				break;
+			case 'r':
+				rate = strtoul(optarg, NULL, 0);
+				break;
+			case 's':
+				seconds = atof(optarg);
+				break;
+			case 't':
+				tone = atof(optarg);
+				break;
+			case 'T':
+				taps = strtoul(optarg, NULL, 0);
+				break;
+			case 'x':
+				text = optarg;
+				break;
+			default:
+				fprintf(stderr, "iqaudio: invalid options\n");
+				return 1;
+		}
+	}
+	if (!!ring + !!text + !!tone != 1) {
+		fprintf(stderr, "iqaudio: --ring, --text or --tone\n");
+		return 1;
+	}
+	if (ring) {
+		if (iqring_attach(&r, ring) < 0) {
+			fprintf(stderr, "iqaudio: cannot open ring %s: %m\n", ring);
+			return 1;
+		}
+		printf("Ring:                 %s, %s, %u Hz\n", ring,
+			r.hdr->format == IQRING_S16 ? "s16" : "f32", r.hdr->rate);
+		if (r.hdr->rate != rate)
+			in_rate = r.hdr->rate;
+	}
+	if (text) {
+		printf("Text:                 %s\n", text);
+		m.text = m.next = text;
+		m.burst = gap_burst;
+		m.level = 0.5f;
+		in_rate = PSK31_RATE;
+	}
+	if (audio_open(&a, device, rate, period, periods) < 0) {
+		fprintf(stderr, "iqaudio: cannot open %s: %m\n", device);
+		return 1;
+	}
+	printf("Device:               %s, %u Hz, %u frames x %u, %.1f ms\n", device, a.rate,
+		a.period, a.buffer / a.period, a.buffer * 1e3 / a.rate);
+	if (in_rate) {
+		if (resample_init(&c.rs, in_rate, a.rate, taps) < 0) {
+			fprintf(stderr, "iqaudio: cannot resample %u Hz to %u Hz: %m\n", in_rate, a.rate);
+			return 1;
+		}
+		c.in_max = (unsigned long long)IQAUDIO_BLOCK * c.rs.down / c.rs.up / PSK31_SAMPLES * PSK31_SAMPLES;
+		if (c.in_max < PSK31_SAMPLES)
+			c.in_max = PSK31_SAMPLES;
+		c.in = malloc(c.in_max * 2 * sizeof(float));
+		c.out = malloc(RESAMPLE_OUT_MAX(&c.rs, c.in_max) * 2 * sizeof(float));
+		if (!c.in || !c.out) {
+			fprintf(stderr, "iqaudio: out of memory\n");
+			return 1;
+		}
+		c.len = c.pos = 0;
+		printf("Resampling:           %u Hz to %u Hz, %u/%u, %u taps per phase\n", in_rate, a.rate,
+			c.rs.up, c.rs.down, c.rs.taps);
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	next_report = (unsigned long long)IQAUDIO_REPORT_S * a.rate;
+	while (!stop && (!seconds || a.frames < seconds * a.rate)) {
+		if (!(out = audio_begin(&a, &frames))) {
+			fprintf(stderr, "iqaudio: %s: %m\n", device);
+			break;
+		}
+		if (in_rate) {
+			for (n = 0; n < frames; n += k) {
+				if (c.pos == c.len) {
+					if (text) {
+						psk31_render(&m, c.in, c.in_max);
+						k = c.in_max;
+					} else if (!(k = iqring_read_float(&r, c.in, c.in_max))) {
+						break;
+					}
+					c.len = resample_run(&c.rs, c.in, k, c.out);
+					c.pos = 0;
+				}
+				k = c.len - c.pos < frames - n ? c.len - c.pos : frames - n;
+				for (i = 0; i < k * 2; i++)
+					out[n * 2 + i] = to_s16(c.out[c.pos * 2 + i]);
+				c.pos += k;
+			}
+		} else if (ring) {
+			n = from_ring(&r, out, frames);
+		}
+		if (ring) {
+			memset(out + n * 2, 0, (frames - n) * 2 * sizeof(int16_t));
+			/* The ring is empty before the stream starts, that is no loss */
+			if (a.running)
+				missing += frames - n;
+		} else if (tone) {
+			for (i = 0; i < frames; i++) {
+				out[i * 2] = to_s16(0.5 * cos(phase));
+				out[i * 2 + 1] = to_s16(0.5 * sin(phase));
+				phase = fmod(phase + 2 * M_PI * tone / a.rate, 2 * M_PI);
+			}
+		}
+		if (audio_commit(&a, frames) < 0) {
+			fprintf(stderr, "iqaudio: %s: %m\n", device);
+			break;
+		}
+		if (a.frames >= next_report) {
+			report(&a, missing);
+			next_report += (unsigned long long)IQAUDIO_REPORT_S * a.rate;
+		}
+	}
+	report(&a, missing);
+	audio_close(&a);
+	if (in_rate) {
+		resample_free(&c.rs);
+		free(c.in);
+		free(c.out);
+	}
+	if (ring)
+		iqring_close(&r);
+	return 0;
+}
@@ -0,0 +1,197 @@
+/*
+ * Copy between an I/Q ring (see iqring.h) and a file or pipe, for tools that
+ * cannot map the ring themselves.
+ *
+ * --read takes frames out of the ring and writes them to the file or stdout,
+ * --write reads the file or stdin into the ring, waiting while it is full.
+ * The frames are copied as they are, in the format of the ring. With --create
+ * the ring is made here, otherwise the other side has made it.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <getopt.h>
+#include "iqring.h"
+
+#define IQBRIDGE_POLL_US 1000
+
+static const struct option long_options[] = {
+	{"create", no_argument, NULL, 'c'},
+	{"format", required_argument, NULL, 'f'},
+	{"frames", required_argument, NULL, 'n'},
+	{"help", no_argument, NULL, 'h'},
+	{"rate", required_argument, NULL, 'r'},
+	{"read", no_argument, NULL, 'R'},
+	{"ring", required_argument, NULL, 'i'},
+	{"write", no_argument, NULL, 'W'},
+	{NULL, 0, NULL, 0}
+};
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig) {
+	stop = 1;
+}
+
+// Ring to fd, until interrupted
+static int ring_to_fd(iqring_t *r, int fd) {
+	const void *p;
+	size_t len, off;
+	uint32_t n;
+	ssize_t ss;
+
+	while (!stop) {
+		if (!(n = iqring_readable(r, &p))) {
+			usleep(IQBRIDGE_POLL_US);
+			continue;
+		}
+		len = (size_t)n * r->hdr->frame_size;
+		for (off = 0; off < len && !stop; off += ss)
+			if ((ss = write(fd, (const uint8_t *)p + off, len - off)) < 0) {
+				if (errno != EINTR) {
+					fprintf(stderr, "iqbridge: write: %m\n");
+					return -1;
+				}
+				ss = 0;
+			}
+		iqring_release(r, n);
+	}
+	return 0;
+}
+
+// fd to ring, until the end of the input
+static int fd_to_ring(iqring_t *r, int fd) {
+	uint32_t fs = r->hdr->frame_size;
+	uint8_t part[2 * sizeof(float)];
+	size_t have = 0;
+	void *p;
+	uint32_t n;
+	ssize_t ss;
+
+	while (!stop) {
+		if (!(n = iqring_writable(r, &p))) {
+			usleep(IQBRIDGE_POLL_US);
+			continue;
+		}
+		/* A frame split over two reads is finished first */
+		if (have) {
+			if ((ss = read(fd, part + have, fs - have)) <= 0)
+				return ss < 0 && errno != EINTR ? -1 : 0;
+			if ((have += ss) < fs)
+				continue;
+			memcpy(p, part, fs);
+			iqring_commit(r, 1);
+			have = 0;
+			continue;
+		}
+		if ((ss = read(fd, p, (size_t)n * fs)) < 0) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "iqbridge: read: %m\n");
+			return -1;
+		}
+		if (ss == 0)
+			return 0;
+		iqring_commit(r, ss / fs);
+		if ((have = ss % fs) != 0)
+			memcpy(part, (uint8_t *)p + ss - have, have);
+	}
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	const char *ring = "/dev/shm/psk31.iq";
+	int create = 0, dir = 0;
+	int format = IQRING_F32;
+	uint32_t rate = 48000, frames = 65536;
+	iqring_t r;
+	int fd, rc;
+
+	while (1) {
+		int opt;
+		int opt_index;
+
+		opt_index = 0;
+		opt = getopt_long(argc, argv, "i:", long_options, &opt_index);
+		if (opt == -1)
+			break;
+		switch (opt) {
+			case 'c':
+				create = 1;
+				break;
+			case 'f':
+				if (strcmp(optarg, "s16") == 0)
+					format = IQRING_S16;
+				else if (strcmp(optarg, "f32") == 0)
+					format = IQRING_F32;
+				else {
+					fprintf(stderr, "iqbridge: invalid format %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'h':
+				fprintf(stderr,
+					"Usage: iqbridge --read|--write [options] [file]\n"
+					"Options:\n"
+					"  --create            Make the ring, replacing any\n"
+					"  --format=<f>        s16 or f32, with --create [f32]\n"
+					"  --frames=<n>        Capacity, a power of 2, with --create [65536]\n"
+					"  --help              Show this help\n"
+					"  --rate=<n>          Samples per second, with --create [48000]\n"
+					"  --read              Copy from the ring to the file or stdout\n"
+					"  --ring=<path>       The ring [/dev/shm/psk31.iq]\n"
+					"  --write             Copy the file or stdin into the ring\n");
+				return 0;
+			case 'i':
+				ring = optarg;
+				break;
+			case 'n':
+				frames = strtoul(optarg, NULL, 0);
+				break;
+			case 'r':
+				rate = strtoul(optarg, NULL, 0);
+				break;
+			case 'R':
+				dir = 'r';
+				break;
+			case 'W':
+				dir = 'w';
+				break;
+			default:
+				fprintf(stderr, "iqbridge: invalid options\n");
+				return 1;
+		}
+	}
+	if (!dir) {
+		fprintf(stderr, "iqbridge: --read or --write\n");
+		return 1;
+	}
+	if ((create ? iqring_create(&r, ring, format, rate, frames) : iqring_attach(&r, ring)) < 0) {
+		fprintf(stderr, "iqbridge: cannot open ring %s: %m\n", ring);
+		return 1;
+	}
+	fprintf(stderr, "Ring:                 %s, %s, %u Hz, %u frames\n", ring,
+		r.hdr->format == IQRING_S16 ? "s16" : "f32", r.hdr->rate, r.hdr->frames);
+	if (optind < argc)
+		fd = open(argv[optind], dir == 'r' ? O_WRONLY | O_CREAT | O_TRUNC : O_RDONLY, 0644);
+	else
+		fd = dir == 'r' ? 1 : 0;
+	if (fd < 0) {
+		fprintf(stderr, "iqbridge: cannot open %s: %m\n", argv[optind]);
+		return 1;
+	}
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	signal(SIGPIPE, on_signal);
+	rc = dir == 'r' ? ring_to_fd(&r, fd) : fd_to_ring(&r, fd);
+	fprintf(stderr, "Frames:               %llu written, %llu read, %llu overruns\n",
+		(unsigned long long)r.hdr->write, (unsigned long long)r.hdr->read,
+		(unsigned long long)r.hdr->overruns);
+	iqring_close(&r);
+	return rc < 0 ? 2 : 0;
+}
@@ -0,0 +1,106 @@
+/*
+ * Shared memory ring of I/Q samples. See iqring.h.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "iqring.h"
+
+#define IQRING_DATA_OFFSET 4096
+
+static int iqring_map(iqring_t *r, int fd, size_t size) {
+	void *p;
+
+	p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+		return -1;
+	r->hdr = (iqring_hdr_t *)p;
+	r->data = (uint8_t *)p + r->hdr->data_offset;
+	r->size = size;
+	return 0;
+}
+
+// Make a new ring, empty, replacing any at path
+int iqring_create(iqring_t *r, const char *path, int format, uint32_t rate, uint32_t frames) {
+	iqring_hdr_t hdr = {
+		.magic = IQRING_MAGIC,
+		.version = IQRING_VERSION,
+		.format = format,
+		.rate = rate,
+		.frames = frames,
+		.frame_size = format == IQRING_S16 ? 2 * sizeof(int16_t) : 2 * sizeof(float),
+		.data_offset = IQRING_DATA_OFFSET,
+	};
+	size_t size;
+	int fd;
+
+	r->hdr = NULL;
+	if ((format != IQRING_S16 && format != IQRING_F32) || frames < 2 || (frames & (frames - 1))) {
+		errno = EINVAL;
+		return -1;
+	}
+	size = IQRING_DATA_OFFSET + (size_t)frames * hdr.frame_size;
+	unlink(path);
+	if ((fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0666)) < 0)
+		return -1;
+	fchmod(fd, 0666);
+	if (ftruncate(fd, size) < 0 || pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)) {
+		close(fd);
+		return -1;
+	}
+	return iqring_map(r, fd, size);
+}
+
+// Map a ring made by the other side
+int iqring_attach(iqring_t *r, const char *path) {
+	iqring_hdr_t hdr;
+	struct stat st;
+	int fd;
+
+	r->hdr = NULL;
+	if ((fd = open(path, O_RDWR)) < 0)
+		return -1;
+	if (fstat(fd, &st) < 0 || pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)) {
+		close(fd);
+		return -1;
+	}
+	if (hdr.magic != IQRING_MAGIC || hdr.version != IQRING_VERSION || hdr.frames < 2 ||
+			(hdr.frames & (hdr.frames - 1)) ||
+			st.st_size < hdr.data_offset + (off_t)hdr.frames * hdr.frame_size) {
+		close(fd);
+		errno = EINVAL;
+		return -1;
+	}
+	return iqring_map(r, fd, st.st_size);
+}
+
+uint32_t iqring_read_float(iqring_t *r, float *iq, uint32_t n) {
+	uint32_t done = 0, k, i;
+	const void *p;
+
+	while (done < n && (k = iqring_readable(r, &p)) != 0) {
+		if (k > n - done)
+			k = n - done;
+		if (r->hdr->format == IQRING_S16) {
+			for (i = 0; i < k * 2; i++)
+				iq[done * 2 + i] = ((const int16_t *)p)[i] / 32767.0f;
+		} else {
+			memcpy(iq + done * 2, p, k * 2 * sizeof(float));
+		}
+		iqring_release(r, k);
+		done += k;
+	}
+	return done;
+}
+
+void iqring_close(iqring_t *r) {
+	if (!r->hdr)
+		return;
+	munmap(r->hdr, r->size);
+	r->hdr = NULL;
+}
@@ -0,0 +1,89 @@
+/*
+ * Ring of I/Q samples in shared memory, one producer and one consumer.
+ *
+ * The ring is a file, normally on /dev/shm, that both sides map. A small
+ * header gives the sample rate, the format of a frame (an I/Q pair) and the
+ * capacity, then the count of frames ever written and ever read, each on a
+ * cache line of its own; the number of times a side went round is its count
+ * divided by the capacity. The producer writes frames in place and then
+ * publishes them by advancing its count, the consumer reads them in place
+ * and frees them the same way. Nothing is copied and nothing is locked, so
+ * another process (GNU Radio, a DSP tool) can be on the other side.
+ *
+ * A producer that finds the ring full does not wait: what it could not
+ * write is counted in overruns.
+ */
+#ifndef IQRING_H
+#define IQRING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define IQRING_MAGIC    0x514b5350      /* "PSKQ" */
+#define IQRING_VERSION  1
+
+enum {
+	IQRING_S16 = 1,         /* Interleaved signed 16 bit I and Q */
+	IQRING_F32,             /* Interleaved float I and Q, [-1, 1] */
+};
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t format;
+	uint32_t rate;          /* Frames per second */
+	uint32_t frames;        /* Capacity, a power of 2 */
+	uint32_t frame_size;    /* Bytes */
+	uint32_t data_offset;   /* From the start of the file */
+	uint32_t pad;
+	/* Written by the producer only */
+	uint64_t write __attribute__((aligned(64)));
+	uint64_t overruns;
+	/* Written by the consumer only */
+	uint64_t read __attribute__((aligned(64)));
+} iqring_hdr_t;
+
+typedef struct {
+	iqring_hdr_t *hdr;      /* NULL when not open */
+	uint8_t *data;
+	size_t size;
+} iqring_t;
+
+int iqring_create(iqring_t *r, const char *path, int format, uint32_t rate, uint32_t frames);
+int iqring_attach(iqring_t *r, const char *path);
+void iqring_close(iqring_t *r);
+
+// Producer: room for up to the returned number of frames at *p, in one piece
+static inline uint32_t iqring_writable(iqring_t *r, void **p) {
+	iqring_hdr_t *h = r->hdr;
+	uint64_t w = h->write;
+	uint32_t pos = w & (h->frames - 1);
+	uint32_t n = h->frames - (uint32_t)(w - __atomic_load_n(&h->read, __ATOMIC_ACQUIRE));
+
+	*p = r->data + (size_t)pos * h->frame_size;
+	return n < h->frames - pos ? n : h->frames - pos;
+}
+
+static inline void iqring_commit(iqring_t *r, uint32_t n) {
+	__atomic_store_n(&r->hdr->write, r->hdr->write + n, __ATOMIC_RELEASE);
+}
+
+// Consumer: up to the returned number of frames at *p, in one piece
+static inline uint32_t iqring_readable(iqring_t *r, const void **p) {
+	iqring_hdr_t *h = r->hdr;
+	uint64_t rd = h->read;
+	uint32_t pos = rd & (h->frames - 1);
+	uint32_t n = (uint32_t)(__atomic_load_n(&h->write, __ATOMIC_ACQUIRE) - rd);
+
+	*p = r->data + (size_t)pos * h->frame_size;
+	return n < h->frames - pos ? n : h->frames - pos;
+}
+
+static inline void iqring_release(iqring_t *r, uint32_t n) {
+	__atomic_store_n(&r->hdr->read, r->hdr->read + n, __ATOMIC_RELEASE);
+}
+
+// Consumer: up to n frames copied out as floats, full scale 1; returns how many
+uint32_t iqring_read_float(iqring_t *r, float *iq, uint32_t n);
+
+#endif
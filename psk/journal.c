@@ -0,0 +1,331 @@
+/*
+ * Crash safe journal of the queued messages. See journal.h.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "journal.h"
+
+#define JOURNAL_MAGIC   0x4a4b5350      /* "PSKJ" */
+
+#define ALIGN4(n) (((n) + 3) & ~3)
+
+enum {
+	JR_SUBMIT = 1,          /* psk31_msg_t and the text */
+	JR_SENT,                /* uint16_t characters on air */
+	JR_DONE,
+};
+
+typedef struct {
+	uint32_t magic;
+	uint32_t generation;
+	uint32_t size;          /* Of a region */
+	uint32_t commit;        /* Stored last */
+} jhdr_t;
+
+typedef struct {
+	uint16_t type;
+	uint16_t length;        /* Of the payload, which is followed by the commit word */
+	uint32_t seq;
+} jrec_t;
+
+// FNV-1a, seeded with the generation so stale records of a region never match
+static uint32_t checksum(uint32_t generation, const void *p, size_t len) {
+	const uint8_t *b = p;
+	uint32_t h = 2166136261u ^ generation;
+
+	while (len--)
+		h = (h ^ *b++) * 16777619u;
+	return h;
+}
+
+static uint8_t *region(journal_t *j, int r) {
+	return j->base + r * j->region;
+}
+
+static int hdr_valid(const jhdr_t *h, size_t size) {
+	return h->magic == JOURNAL_MAGIC && h->size == size &&
+		h->commit == checksum(h->generation, h, offsetof(jhdr_t, commit));
+}
+
+// Record at offset, NULL when there is no committed record there
+static const jrec_t *rec_get(journal_t *j, uint32_t offset) {
+	const jrec_t *rec = (const jrec_t *)(region(j, j->active) + offset);
+	uint32_t commit;
+
+	if (offset + sizeof(*rec) + 4 > j->region ||
+			offset + sizeof(*rec) + ALIGN4(rec->length) + 4 > j->region)
+		return NULL;
+	memcpy(&commit, (const uint8_t *)(rec + 1) + ALIGN4(rec->length), 4);
+	if (commit != checksum(j->generation, rec, sizeof(*rec) + rec->length))
+		return NULL;
+	return rec;
+}
+
+// Write a record at the tail of region r, the commit word last
+static void rec_put(journal_t *j, int r, uint32_t generation, int type, uint32_t seq,
+		const void *p1, size_t l1, const void *p2, size_t l2) {
+	jrec_t *rec = (jrec_t *)(region(j, r) + j->tail);
+	uint8_t *payload = (uint8_t *)(rec + 1);
+
+	rec->type = type;
+	rec->length = l1 + l2;
+	rec->seq = seq;
+	memcpy(payload, p1, l1);
+	memcpy(payload + l1, p2, l2);
+	__atomic_store_n((uint32_t *)(payload + ALIGN4(l1 + l2)),
+		checksum(generation, rec, sizeof(*rec) + l1 + l2), __ATOMIC_RELEASE);
+	j->tail += sizeof(*rec) + ALIGN4(l1 + l2) + 4;
+}
+
+static size_t rec_size(size_t length) {
+	return sizeof(jrec_t) + ALIGN4(length) + 4;
+}
+
+/*
+ * Copy the live messages to the other region and switch to it. The region
+ * being overwritten must not be needed any more, so the active one has to
+ * be on disk first; when the writer thread has not got it there yet, that
+ * is done here. The records go to disk before the header that commits them,
+ * or a crash could leave a new generation with nothing in it.
+ */
+static int compact(journal_t *j) {
+	int r = !j->active;
+	jhdr_t *h = (jhdr_t *)region(j, r);
+	uint32_t generation = j->generation + 1;
+	uint32_t offset;
+	const jrec_t *rec;
+	size_t need;
+	uint16_t pos;
+	int i;
+
+	if (__atomic_load_n(&j->synced, __ATOMIC_ACQUIRE) != j->generation) {
+		if (msync(region(j, j->active), j->region, MS_SYNC) < 0)
+			return -1;
+		__atomic_store_n(&j->synced, j->generation, __ATOMIC_RELEASE);
+	}
+	need = sizeof(jhdr_t);
+	for (i = 0; i < j->live_count; i++)
+		need += rec_size(sizeof(psk31_msg_t) + j->live[i].length) + rec_size(sizeof(pos));
+	if (need > j->region)
+		return -1;
+	__atomic_store_n(&h->commit, 0, __ATOMIC_RELEASE);
+	j->tail = sizeof(jhdr_t);
+	for (i = 0; i < j->live_count; i++) {
+		rec = (const jrec_t *)(region(j, j->active) + j->live[i].offset);
+		offset = j->tail;
+		rec_put(j, r, generation, JR_SUBMIT, rec->seq, rec + 1, rec->length, NULL, 0);
+		j->live[i].offset = offset;
+		if ((pos = j->live[i].pos) > 0)
+			rec_put(j, r, generation, JR_SENT, rec->seq, &pos, sizeof(pos), NULL, 0);
+	}
+	if (msync(region(j, r), j->tail, MS_SYNC) < 0)
+		return -1;
+	h->magic = JOURNAL_MAGIC;
+	h->generation = generation;
+	h->size = j->region;
+	__atomic_store_n(&h->commit, checksum(generation, h, offsetof(jhdr_t, commit)), __ATOMIC_RELEASE);
+	if (msync(region(j, r), sizeof(*h), MS_SYNC) < 0)
+		return -1;
+	j->active = r;
+	__atomic_store_n(&j->generation, generation, __ATOMIC_RELEASE);
+	__atomic_store_n(&j->dirty, 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+static int append(journal_t *j, int type, uint32_t seq, const void *p1, size_t l1, const void *p2, size_t l2) {
+	if (j->tail + rec_size(l1 + l2) > j->region &&
+			(compact(j) < 0 || j->tail + rec_size(l1 + l2) > j->region)) {
+		j->dropped++;
+		return -1;
+	}
+	rec_put(j, j->active, j->generation, type, seq, p1, l1, p2, l2);
+	__atomic_store_n(&j->dirty, 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+static journal_live_t *live_find(journal_t *j, uint32_t seq) {
+	int i;
+
+	for (i = 0; i < j->live_count; i++)
+		if (j->live[i].seq == seq)
+			return &j->live[i];
+	return NULL;
+}
+
+// Keeps the order of submission, which is the order of replay
+static void live_remove(journal_t *j, journal_live_t *l) {
+	int i = l - j->live;
+
+	memmove(l, l + 1, (j->live_count - i - 1) * sizeof(*l));
+	j->live_count--;
+}
+
+static void *journal_thread(void *arg) {
+	journal_t *j = (journal_t *)arg;
+	uint32_t generation;
+
+	while (!__atomic_load_n(&j->stop, __ATOMIC_ACQUIRE)) {
+		usleep(JOURNAL_SYNC_MS * 1000);
+		if (!__atomic_exchange_n(&j->dirty, 0, __ATOMIC_ACQ_REL))
+			continue;
+		generation = __atomic_load_n(&j->generation, __ATOMIC_ACQUIRE);
+		if (msync(j->base, 2 * j->region, MS_SYNC) == 0)
+			__atomic_store_n(&j->synced, generation, __ATOMIC_RELEASE);
+	}
+	return NULL;
+}
+
+// Scan the active region, rebuilding the live messages
+static void replay(journal_t *j) {
+	const jrec_t *rec;
+	journal_live_t *l;
+	uint32_t offset;
+
+	offset = sizeof(jhdr_t);
+	while ((rec = rec_get(j, offset)) != NULL) {
+		switch (rec->type) {
+			case JR_SUBMIT:
+				if (rec->length < sizeof(psk31_msg_t) || j->live_count == JOURNAL_LIVE)
+					break;
+				l = &j->live[j->live_count++];
+				l->seq = rec->seq;
+				l->offset = offset;
+				l->length = rec->length - sizeof(psk31_msg_t);
+				l->pos = 0;
+				break;
+			case JR_SENT:
+				if ((l = live_find(j, rec->seq)) != NULL && rec->length == sizeof(uint16_t))
+					memcpy(&l->pos, rec + 1, sizeof(l->pos));
+				break;
+			case JR_DONE:
+				if ((l = live_find(j, rec->seq)) != NULL)
+					live_remove(j, l);
+				break;
+		}
+		if (rec->seq >= j->next_seq)
+			j->next_seq = rec->seq + 1;
+		offset += rec_size(rec->length);
+	}
+	j->tail = offset;
+}
+
+/*
+ * Map the journal, creating it if needed, and hand every message that was
+ * not finished to fn, with the characters already on air. Those fn refuses
+ * are dropped, the others are compacted into a fresh generation.
+ */
+int journal_open(journal_t *j, const char *path, journal_replay_fn fn, void *ctx) {
+	const jhdr_t *h[2];
+	const jrec_t *rec;
+	struct stat st;
+	int i;
+
+	memset(j, 0, sizeof(*j));
+	j->next_seq = 1;
+	j->region = JOURNAL_SIZE / 2;
+	if ((j->fd = open(path, O_RDWR | O_CREAT, 0644)) < 0)
+		return -1;
+	if (fstat(j->fd, &st) < 0 || (st.st_size < JOURNAL_SIZE && ftruncate(j->fd, JOURNAL_SIZE) < 0))
+		goto fail;
+	j->base = mmap(NULL, JOURNAL_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, j->fd, 0);
+	if (j->base == MAP_FAILED)
+		goto fail;
+
+	h[0] = (const jhdr_t *)region(j, 0);
+	h[1] = (const jhdr_t *)region(j, 1);
+	for (i = 0; i < 2; i++)
+		if (hdr_valid(h[i], j->region) && (j->generation == 0 || h[i]->generation > j->generation)) {
+			j->active = i;
+			j->generation = h[i]->generation;
+		}
+	if (j->generation) {
+		replay(j);
+		for (i = 0; i < j->live_count; i++) {
+			rec = (const jrec_t *)(region(j, j->active) + j->live[i].offset);
+			if (fn(ctx, j->live[i].seq, (const psk31_msg_t *)(rec + 1),
+					(const uint8_t *)(rec + 1) + sizeof(psk31_msg_t), j->live[i].pos) < 0)
+				live_remove(j, &j->live[i--]);
+		}
+	} else {
+		/* New journal: an empty region 1 of generation 1, so region 0 comes next */
+		jhdr_t *n = (jhdr_t *)region(j, 1);
+
+		n->magic = JOURNAL_MAGIC;
+		n->generation = 1;
+		n->size = j->region;
+		n->commit = checksum(1, n, offsetof(jhdr_t, commit));
+		j->active = 1;
+		j->generation = 1;
+		j->tail = sizeof(jhdr_t);
+	}
+	/* What was read is on disk */
+	j->synced = j->generation;
+	if (compact(j) < 0 || msync(j->base, JOURNAL_SIZE, MS_SYNC) < 0)
+		goto fail;
+	j->synced = j->generation;
+	if ((errno = pthread_create(&j->thread, NULL, journal_thread, j)) != 0)
+		goto fail;
+	return 0;
+fail:
+	if (j->base && j->base != MAP_FAILED)
+		munmap(j->base, JOURNAL_SIZE);
+	j->base = NULL;
+	close(j->fd);
+	return -1;
+}
+
+// Journal a message, 0 when it could not be
+uint32_t journal_submit(journal_t *j, const psk31_msg_t *m, const void *text) {
+	journal_live_t *l;
+
+	if (j->live_count == JOURNAL_LIVE) {
+		j->dropped++;
+		return 0;
+	}
+	if (append(j, JR_SUBMIT, j->next_seq, m, sizeof(*m), text, m->length) < 0)
+		return 0;
+	/* Where it went, compaction can have moved the tail */
+	l = &j->live[j->live_count++];
+	l->seq = j->next_seq++;
+	l->offset = j->tail - rec_size(sizeof(*m) + m->length);
+	l->length = m->length;
+	l->pos = 0;
+	return l->seq;
+}
+
+void journal_sent(journal_t *j, uint32_t seq, int pos) {
+	journal_live_t *l;
+	uint16_t p = pos;
+
+	if (!seq || !(l = live_find(j, seq)))
+		return;
+	if (append(j, JR_SENT, seq, &p, sizeof(p), NULL, 0) == 0)
+		l->pos = pos;
+}
+
+void journal_done(journal_t *j, uint32_t seq) {
+	journal_live_t *l;
+
+	if (!seq || !(l = live_find(j, seq)))
+		return;
+	live_remove(j, l);
+	append(j, JR_DONE, seq, NULL, 0, NULL, 0);
+}
+
+void journal_close(journal_t *j) {
+	if (!j->base)
+		return;
+	__atomic_store_n(&j->stop, 1, __ATOMIC_RELEASE);
+	pthread_join(j->thread, NULL);
+	msync(j->base, JOURNAL_SIZE, MS_SYNC);
+	munmap(j->base, JOURNAL_SIZE);
+	close(j->fd);
+	j->base = NULL;
+}
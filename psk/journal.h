@@ -0,0 +1,62 @@
+/*
+ * Crash safe journal of the queued messages.
+ *
+ * The journal is a file mapped into memory, split in two regions. One is
+ * appended to: every submitted message, then how many of its characters have
+ * been on air, then that it is done. A record ends with a commit word, a
+ * checksum of the record, which is stored last; a record whose commit word
+ * does not match was never completed and ends the replay. When the active
+ * region is full, the messages still alive are copied to the other one,
+ * which then takes over under a higher generation number in its header.
+ *
+ * Appending is a copy into the mapping and does not call the kernel, but
+ * for a compaction, which writes the new region out before it takes over.
+ * A thread of the journal writes the dirty pages out in the background.
+ */
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "psk31msg.h"
+
+#define JOURNAL_SIZE    (1024 * 1024)
+#define JOURNAL_LIVE    64              /* Messages tracked, more than a queue holds */
+#define JOURNAL_SYNC_MS 50
+
+typedef struct {
+	uint32_t seq;
+	uint32_t offset;        /* Of the submit record, in the active region */
+	uint16_t length;
+	uint16_t pos;           /* Characters on air */
+} journal_live_t;
+
+typedef struct {
+	int fd;
+	uint8_t *base;
+	size_t region;          /* Size of each region */
+	int active;
+	uint32_t generation;
+	uint32_t tail;          /* Append offset in the active region */
+	uint32_t next_seq;
+	journal_live_t live[JOURNAL_LIVE];
+	int live_count;
+	unsigned dropped;       /* Records that did not fit */
+	/* Writer thread */
+	pthread_t thread;
+	int dirty;
+	uint32_t synced;        /* Generation known to be on disk */
+	int stop;
+} journal_t;
+
+typedef int (*journal_replay_fn)(void *ctx, uint32_t seq, const psk31_msg_t *m,
+	const uint8_t *text, int pos);
+
+int journal_open(journal_t *j, const char *path, journal_replay_fn fn, void *ctx);
+uint32_t journal_submit(journal_t *j, const psk31_msg_t *m, const void *text);
+void journal_sent(journal_t *j, uint32_t seq, int pos);
+void journal_done(journal_t *j, uint32_t seq);
+void journal_close(journal_t *j);
+
+#endif
@@ -0,0 +1,113 @@
+/*
+ * Priority queue of messages. See msgq.h.
+ */
+#include <string.h>
+#include "msgq.h"
+
+void msgq_init(msgq_t *q) {
+	int i;
+
+	memset(q, 0, sizeof(*q));
+	for (i = 0; i < MSGQ_SIZE - 1; i++)
+		q->pool[i].next = &q->pool[i + 1];
+	q->free = q->pool;
+}
+
+// Queue a message, NULL when it does not fit
+msg_t *msgq_submit(msgq_t *q, const psk31_msg_t *m, const void *text, int owner) {
+	msg_t *msg, **mp;
+
+	if (!q->free || q->bytes + m->length > MSGQ_BYTES)
+		return NULL;
+	msg = q->free;
+	q->free = msg->next;
+	msg->next = NULL;
+	msg->id = m->id;
+	msg->owner = owner;
+	msg->priority = m->priority;
+	msg->len = m->length;
+	msg->pos = 0;
+	msg->start_ns = m->start_ns;
+	msg->start_sample = 0;
+	msg->end_sample = 0;
+	msg->start_seen_ns = 0;
+	msg->jseq = 0;
+	memcpy(msg->text, text, m->length);
+	q->count++;
+	q->bytes += msg->len;
+	if (msg->start_ns) {
+		for (mp = &q->sched; *mp && (*mp)->start_ns <= msg->start_ns; mp = &(*mp)->next)
+			;
+		msg->next = *mp;
+		*mp = msg;
+		return msg;
+	}
+	if (q->tail[msg->priority])
+		q->tail[msg->priority]->next = msg;
+	else
+		q->head[msg->priority] = msg;
+	q->tail[msg->priority] = msg;
+	return msg;
+}
+
+/*
+ * Next character to send, -1 when the queue is empty. It comes from the
+ * oldest message of the highest priority, so pre-emption happens here. The
+ * message is returned in *msg. When that was its last character
+ * (pos == len), it has left the queue and the caller gives it back with
+ * msgq_release().
+ */
+int msgq_next_char(msgq_t *q, msg_t **msg) {
+	msg_t *m;
+	int p, c;
+
+	for (p = PSK31_PRIO_COUNT - 1; p >= 0; p--)
+		if (q->head[p])
+			break;
+	if (p < 0)
+		return -1;
+	m = q->head[p];
+	c = m->text[m->pos++];
+	q->bytes--;
+	if (m->pos == m->len) {
+		if (!(q->head[p] = m->next))
+			q->tail[p] = NULL;
+		m->next = NULL;
+		q->count--;
+	}
+	*msg = m;
+	return c;
+}
+
+// Characters already sent, of a message just submitted
+void msgq_skip(msgq_t *q, msg_t *m, int n) {
+	m->pos = n;
+	q->bytes -= n;
+}
+
+// The earliest scheduled message goes first, whatever the priorities, but behind one still running
+void msgq_start(msgq_t *q) {
+	msg_t *m = q->sched, **mp;
+	int p = PSK31_PRIO_COUNT - 1;
+
+	q->sched = m->next;
+	for (mp = &q->head[p]; *mp && (*mp)->start_ns; mp = &(*mp)->next)
+		;
+	if (!(m->next = *mp))
+		q->tail[p] = m;
+	*mp = m;
+}
+
+void msgq_release(msgq_t *q, msg_t *m) {
+	m->next = q->free;
+	q->free = m;
+}
+
+// The connection went away: its messages are still sent, but nobody is told
+void msgq_disown(msgq_t *q, int owner) {
+	int i;
+
+	for (i = 0; i < MSGQ_SIZE; i++)
+		if (q->pool[i].owner == owner)
+			q->pool[i].owner = -1;
+}
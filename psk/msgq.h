@@ -0,0 +1,70 @@
+/*
+ * Priority queue of messages for one transmitter. See psk31msg.h for the
+ * rules; this only keeps the order. Messages come from a fixed pool, so
+ * nothing is allocated while transmitting. Scheduled messages wait on a
+ * list of their own, by start time, until the sender starts them.
+ */
+#ifndef MSGQ_H
+#define MSGQ_H
+
+#include "psk31msg.h"
+
+#define MSGQ_SIZE       32              /* Messages */
+#define MSGQ_BYTES      8192            /* Unsent text */
+
+typedef struct msg_s {
+	struct msg_s *next;
+	uint32_t id;
+	int owner;              /* Connection that submitted it, -1 when gone */
+	int priority;
+	int len;
+	int pos;                /* Next character to send */
+	uint64_t start_ns;      /* Scheduled start, 0 for none */
+	uint64_t start_sample;  /* On air, set by the sender */
+	uint64_t end_sample;
+	uint64_t start_seen_ns; /* On air, from the DMA read just after its start */
+	uint32_t jseq;          /* In the journal, 0 for none */
+	unsigned char text[PSK31_TEXT_MAX];
+} msg_t;
+
+typedef struct {
+	msg_t pool[MSGQ_SIZE];
+	msg_t *free;
+	msg_t *head[PSK31_PRIO_COUNT];
+	msg_t *tail[PSK31_PRIO_COUNT];
+	msg_t *sched;           /* Scheduled, earliest first */
+	int count;              /* Messages queued */
+	int bytes;              /* Unsent bytes queued */
+} msgq_t;
+
+void msgq_init(msgq_t *q);
+msg_t *msgq_submit(msgq_t *q, const psk31_msg_t *m, const void *text, int owner);
+int msgq_next_char(msgq_t *q, msg_t **msg);
+void msgq_skip(msgq_t *q, msg_t *m, int n);
+void msgq_release(msgq_t *q, msg_t *m);
+void msgq_start(msgq_t *q);
+void msgq_disown(msgq_t *q, int owner);
+
+// Earliest scheduled message, NULL for none
+static inline msg_t *msgq_scheduled(msgq_t *q) {
+	return q->sched;
+}
+
+// Messages that can be sent now, the scheduled ones wait until they start
+static inline int msgq_ready(msgq_t *q) {
+	int p;
+
+	for (p = 0; p < PSK31_PRIO_COUNT; p++)
+		if (q->head[p])
+			return 1;
+	return 0;
+}
+
+// A scheduled message is still being sent, the next one waits for it
+static inline int msgq_sched_running(msgq_t *q) {
+	msg_t *m = q->head[PSK31_PRIO_COUNT - 1];
+
+	return m && m->start_ns;
+}
+
+#endif
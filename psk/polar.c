@@ -0,0 +1,57 @@
+/*
+ * Polar modulation. See polar.h.
+ */
+#include <string.h>
+#include <math.h>
+#include "polar.h"
+#include "sdmodel.h"
+
+#define POLAR_QUIET     1e-8    /* Power below which the phase is not followed */
+#define POLAR_CLOCK     (500e6 * 4096)  /* PLLD, over the fraction of the divisor */
+
+void polar_init(polar_t *p, double div, double rate, double decay, double amplitude, const predistort_t *pd) {
+	memset(p, 0, sizeof(*p));
+	p->carrier = POLAR_CLOCK / div;
+	p->rate = rate;
+	p->decay = decay;
+	p->amplitude = amplitude;
+	p->pd = pd;
+	p->v = 0.5;
+}
+
+void polar_run(polar_t *p, const float *iq, unsigned n, uint32_t *div, uint8_t *up) {
+	double f, a, level;
+	float i, q;
+	uint32_t dq;
+	unsigned k;
+
+	for (k = 0; k < n; k++) {
+		i = iq[2 * k];
+		q = iq[2 * k + 1];
+		a = i * i + q * q;
+		/* Phase advance since the last sample that had one, in cycles */
+		if (a > POLAR_QUIET) {
+			if (p->i != 0 || p->q != 0)
+				p->phase += atan2f(q * p->i - i * p->q, i * p->i + q * p->q) * (float)(0.5 / M_PI);
+			p->i = i;
+			p->q = q;
+		}
+
+		/* Catch up in one sample, the short way round */
+		p->phase -= rint(p->phase);
+		f = p->carrier + p->phase * p->rate;
+		dq = (uint32_t)(POLAR_CLOCK / f + 0.5);
+		div[k] = dq;
+		/* What the quantised divisor does to the phase */
+		p->phase -= (POLAR_CLOCK / dq - p->carrier) / p->rate;
+
+		/* Envelope on the positive side of the mid level */
+		a = sqrt(a);
+		if (a > 1.0)
+			a = 1.0;
+		if (p->pd)
+			a = predistort(p->pd, a);
+		level = 0.5 + a * p->amplitude / 2;
+		up[k] = sdmodel_step(level, p->decay, &p->v);
+	}
+}
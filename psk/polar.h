@@ -0,0 +1,42 @@
+/*
+ * Polar modulation: I/Q to the carrier clock divisor and the envelope.
+ *
+ * Every sample of I/Q becomes a divisor of the general purpose clock, for
+ * its instantaneous frequency, and a sigma-delta bit for the GPIO pair, for
+ * its amplitude. The divisor is quantised, so the phase it leaves the carrier
+ * at is kept, and the next sample asks for the frequency that catches up with
+ * the phase wanted; the quantisation noise of the phase is pushed up in
+ * frequency instead of adding up. Where the amplitude is close to zero the
+ * phase means nothing, and it is followed again from the next sample that
+ * has one.
+ *
+ * The envelope goes through the PA predistortion, when there is one, and the
+ * sigma-delta model of sdmodel.h, a sample at a time, so the filter carries
+ * over from one call to the next.
+ */
+#ifndef POLAR_H
+#define POLAR_H
+
+#include <stdint.h>
+#include "predistort.h"
+
+typedef struct {
+	/* Settings */
+	double carrier;         /* Hz */
+	double rate;            /* Samples per second */
+	double decay;           /* Of the RC filter over a sample */
+	double amplitude;       /* Envelope at full scale, as psk31 --amplitude */
+	const predistort_t *pd; /* NULL for none */
+	/* State */
+	float i, q;             /* Last sample with a phase */
+	double phase;           /* Wanted minus produced, in cycles */
+	double v;               /* Filter */
+} polar_t;
+
+// div is the divisor of the carrier, 12.12 fixed point, unquantised
+void polar_init(polar_t *p, double div, double rate, double decay, double amplitude, const predistort_t *pd);
+
+// n frames of I/Q, full scale 1, to clock divisors and sigma-delta bits
+void polar_run(polar_t *p, const float *iq, unsigned n, uint32_t *div, uint8_t *up);
+
+#endif
@@ -0,0 +1,91 @@
+/*
+ * AM/AM predistortion of the envelope. See predistort.h.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include "predistort.h"
+
+#define POINTS_MAX      256
+
+typedef struct {
+	double in;              /* Amplitude, relative to full drive */
+	double out;             /* Amplitude, relative to the output at full drive */
+} am_point_t;
+
+static int am_point_cmp(const void *v1, const void *v2) {
+	const am_point_t *p1 = (const am_point_t *)v1;
+	const am_point_t *p2 = (const am_point_t *)v2;
+
+	if (p1->in < p2->in)
+		return -1;
+	if (p1->in > p2->in)
+		return 1;
+	return 0;
+}
+
+int predistort_load(predistort_t *pd, const char *fn) {
+	am_point_t pt[POINTS_MAX + 1];
+	double in_db[POINTS_MAX], out_db[POINTS_MAX];
+	double in_max, out_max, y, a;
+	char line[128];
+	int i, j, n;
+	FILE *f;
+
+	if (!(f = fopen(fn, "r")))
+		return -1;
+	n = 0;
+	while (fgets(line, sizeof(line), f) && n < POINTS_MAX) {
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+		if (sscanf(line, "%lf %lf", &in_db[n], &out_db[n]) != 2) {
+			fclose(f);
+			errno = EINVAL;
+			return -1;
+		}
+		n++;
+	}
+	fclose(f);
+	if (n < 2) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* dBm to amplitudes relative to the largest drive */
+	in_max = in_db[0];
+	for (i = 1; i < n; i++)
+		if (in_db[i] > in_max)
+			in_max = in_db[i];
+	for (i = 0; i < n; i++) {
+		pt[i + 1].in = pow(10.0, (in_db[i] - in_max) / 20.0);
+		pt[i + 1].out = out_db[i];
+	}
+	qsort(&pt[1], n, sizeof(pt[0]), am_point_cmp);
+	pd->gain_db = pt[1].out - (20.0 * log10(pt[1].in) + in_max);
+	out_max = pt[n].out;
+	pd->compression_db = pd->gain_db - (out_max - in_max);
+	for (i = 1; i <= n; i++)
+		pt[i].out = pow(10.0, (pt[i].out - out_max) / 20.0);
+	/* Zero drive gives no output. Past saturation the curve is kept flat. */
+	pt[0].in = 0;
+	pt[0].out = 0;
+	for (i = 1; i <= n; i++)
+		if (pt[i].out < pt[i - 1].out)
+			pt[i].out = pt[i - 1].out;
+	pd->points = n;
+
+	/* Invert the piecewise linear AM/AM curve */
+	for (i = 0, j = 1; i <= PREDISTORT_SIZE; i++) {
+		y = (double)i / PREDISTORT_SIZE;
+		while (j < n && pt[j].out < y)
+			j++;
+		if (pt[j].out > pt[j - 1].out)
+			a = pt[j - 1].in + (pt[j].in - pt[j - 1].in) * (y - pt[j - 1].out) / (pt[j].out - pt[j - 1].out);
+		else
+			a = pt[j].in;
+		pd->lut[i] = a > 1.0 ? 1.0 : a;
+	}
+	return 0;
+}
@@ -0,0 +1,34 @@
+/*
+ * AM/AM predistortion of the envelope.
+ *
+ * The calibration file holds measured "<input dBm> <output dBm>" pairs of the
+ * PA. They are turned into an inverse transfer curve, sampled into a table
+ * indexed by the wanted (normalised) output amplitude, which gives the drive
+ * amplitude to ask for. Full scale stays full scale: the largest measured
+ * input is taken as the drive at full envelope.
+ *
+ * Applying the table is a single lookup, so it can be used on every sample
+ * of an IQ stream as well as when the DMA waveforms are built.
+ */
+#ifndef PREDISTORT_H
+#define PREDISTORT_H
+
+#define PREDISTORT_SIZE 4096
+
+typedef struct {
+	int points;                     /* Calibration points used */
+	double gain_db;                 /* Small signal gain */
+	double compression_db;          /* Gain compression at full drive */
+	float lut[PREDISTORT_SIZE + 1];
+} predistort_t;
+
+int predistort_load(predistort_t *pd, const char *fn);
+
+// Predistort a signed amplitude in [-1, 1]
+static inline double predistort(const predistort_t *pd, double x) {
+	if (x >= 0)
+		return x >= 1.0 ? pd->lut[PREDISTORT_SIZE] : pd->lut[(int)(x * PREDISTORT_SIZE + 0.5)];
+	return x <= -1.0 ? -pd->lut[PREDISTORT_SIZE] : -pd->lut[(int)(-x * PREDISTORT_SIZE + 0.5)];
+}
+
+#endif
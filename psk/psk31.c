@@ -51,6 +51,7 @@
 #include <errno.h>
 #include <stdarg.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <signal.h>
 #include <time.h>
 #include <sys/time.h>
@@ -60,9 +61,24 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/eventfd.h>
 #include <math.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include "si570.h"
+#include "predistort.h"
+#include "shape.h"
+#include "msgq.h"
+#include "journal.h"
+#include "txlog.h"
+#include "sdmodel.h"
+#include "iqring.h"
+#include "varicode.h"
+#include "polar.h"
+#include "resample.h"
 
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof(a[0]))
 #define out32(a,v) (*(volatile uint32_t *)(a) = (v))
@@ -80,13 +96,18 @@ static uint8_t gpio_list[] = {
     25,    // P1-22
 };
 #endif
-#define GPIO_FREQ_NUM 4
 #define GPIO_POS_NUM 17
 #define GPIO_NEG_NUM 18
 
+/* The serializer outputs, PWM channels 1 and 2 */
+#define SERIAL_GPIO_POS 18
+#define SERIAL_GPIO_NEG 19
+
 #define DEVFILE_SEND "/dev/psk31.data"
 #define DEVFILE_CTRL "/dev/psk31.ctrl"
 #define DEVFILE_STAT "/dev/psk31.stat"
+#define DEVFILE_SOCK "/dev/psk31.sock"
+#define DEVFILE_HANDOFF "/dev/psk31.handoff"
 
 enum {
 	SYM_L,
@@ -104,25 +125,41 @@ enum {
 
 #define BS_US                32000
 #define BS_SAMPLES           (BS_US / PULSE_WIDTH_INCR_US)
-#define TS_SHIFT             4
-#define TS_COUNT             (1 << TS_SHIFT)
 #define TS_US                BS_US
+#define TS_MAX               128     /* Slots of the DMA queue, at most */
+#define DMA_MEM_MAX_MB       128     /* Of all transmitters, locked or from the VideoCore */
 
 // Various
-#define NUM_SAMPLES          (BS_SAMPLES * SYM_COUNT * TS_COUNT)
-#define NUM_CBS              (NUM_SAMPLES * 3)
-
 #define PAGE_SIZE            4096
 #define PAGE_SHIFT           12
-#define NUM_PAGES_CBS        ((NUM_CBS * 32 + PAGE_SIZE - 1) >> PAGE_SHIFT)
-#define NUM_PAGES_SAMPLES    ((2 * 4 + PAGE_SIZE - 1) >> PAGE_SHIFT)
-#define NUM_PAGES            (NUM_PAGES_CBS + NUM_PAGES_SAMPLES)
 
+// One transmitter per pacing peripheral, PWM and PCM
+#define TX_MAX               2
+
+/* Feeder wakeup lateness, in powers of 2 of us, the last one open */
+#define LATE_BUCKETS         16
+
+/* PTT switching: CBs of a slot for what falls in its symbol, and what is still to come */
+#define PTT_CBS              8
+#define PTT_EVENTS           16
+#define PTT_LEAD_MAX_MS      500
 
+/* Modelled output for other processes, 1.3s */
+#define IQ_TAP_FRAMES        (1 << 17)
+
+/* Polar mode: a ring of samples, 164ms, of a divisor, set, clear and delay CB each */
+#define POLAR_RING           16384
+#define POLAR_CBS            4
+#define POLAR_LEAD_MIN       2000    /* Samples kept queued, silence if need be */
+#define POLAR_GUARD          64      /* Samples next to the DMA never written */
+#define POLAR_BLOCK          1024
+#define POLAR_WAIT_US        5000
 
 // Memory Addresses
 #define DMA_BASE        0x20007000
 #define DMA_LEN         0x24
+#define DMA_CHAN_MAX    14              /* Channel 15 is elsewhere */
+#define DMA_CHAN_LEN    0x1000
 #define PWM_BASE        0x2020C000
 #define PWM_LEN         0x28
 #define CLK_BASE        0x20101000
@@ -133,6 +170,7 @@ enum {
 #define PCM_LEN         0x24
 
 #define DMA_NO_WIDE_BURSTS  (1<<26)
+#define DMA_SRC_INC     (1<<8)
 #define DMA_WAIT_RESP   (1<<3)
 #define DMA_D_DREQ      (1<<6)
 #define DMA_PER_MAP(x)  ((x)<<16)
@@ -142,6 +180,7 @@ enum {
 
 #define DMA_CS          (0x00/4)
 #define DMA_CONBLK_AD   (0x04/4)
+#define DMA_SOURCE_AD   (0x0c/4)
 #define DMA_DEBUG       (0x20/4)
 
 // GPIO Memory Addresses
@@ -162,11 +201,15 @@ enum {
 #define GPIO_MODE_ALT4  3
 #define GPIO_MODE_ALT5  2
 
+/* The serializer drives its pins as PWM outputs */
+#define TX_GPIO_MODE    (option_serial ? GPIO_MODE_ALT5 : GPIO_MODE_OUT)
+
 // PWM Memory Addresses
 #define PWM_CTL         (0x00/4)
 #define PWM_DMAC        (0x08/4)
 #define PWM_RNG1        (0x10/4)
 #define PWM_FIFO        (0x18/4)
+#define PWM_RNG2        (0x20/4)
 
 #define PWMCLK_CNTL     40
 #define PWMCLK_DIV      41
@@ -175,6 +218,9 @@ enum {
 #define PWMCTL_PWEN1    (1<<0)
 #define PWMCTL_CLRF     (1<<6)
 #define PWMCTL_USEF1    (1<<5)
+#define PWMCTL_PWEN2    (1<<8)
+#define PWMCTL_MODE2    (1<<9)
+#define PWMCTL_USEF2    (1<<13)
 
 #define PWMDMAC_ENAB    (1<<31)
 #define PWMDMAC_THRSHLD ((15<<8) | (15<<0))
@@ -214,32 +260,26 @@ typedef struct {
 	uint32_t pad_2;
 } dma_cb_t;
 
-struct ctl {
-	union {
-		dma_cb_t cb[NUM_CBS];
-		char cb_pages[NUM_PAGES_CBS][PAGE_SIZE];
-	};
-	union {
-		uint32_t samples[2];
-		char samples_pages[NUM_PAGES_SAMPLES][PAGE_SIZE];
-	};
-};
-
 typedef struct {
 	uint32_t physaddr;   /* Starting address */
+	uint32_t cb_offset;  /* Of the first CB */
 	dma_cb_t *cb_last;   /* Last CB */
 } bs_info_t;
 
 typedef struct {
 	bs_info_t bs[SYM_COUNT];
 	uint32_t physaddr;
+	uint64_t start;                 /* Sample at which the symbol queued here starts */
+	int skip;                       /* Samples of the burst it skips */
+	dma_cb_t *entry_cb;             /* Serializer: CB moved for the skip, NULL for none */
+	uint32_t entry_src;             /* ... and where its source was */
+	uint32_t entry_length;
+	uint32_t ptt_offset;            /* PTT: CB offset of the CBs of the slot */
+	int ptt_patches;                /* ... CBs of the symbol linked to them */
+	dma_cb_t *ptt_patch[PTT_CBS];
+	uint32_t ptt_next[PTT_CBS];     /* ... and where they went before */
 } ts_info_t;
 
-ts_info_t ts_info[TS_COUNT];
-int ts_last;
-dma_cb_t *ts_last_cbp;
-int ts_last_sym;
-
 static const int ts_next[SYM_COUNT][2] = {
 	[SYM_L] = {SYM_LH, SYM_L},
 	[SYM_H] = {SYM_HL, SYM_H},
@@ -255,293 +295,120 @@ typedef struct {
 page_map_t *page_map;
 page_map_t *phys_info;
 
+/*
+ * DMA memory: the CBs of every transmitter, each in its own region of
+ * cb_region_size bytes of CB offset space, followed by one page of samples.
+ */
 static uint8_t *virtbase;
+static int num_pages;
+static int num_pages_cbs;
+static uint32_t cb_region_size;
+static uint32_t *samples;
+
+/* Scattered memory: hash of the physical pages to their place in phys_info */
+static int *phys_index;
+static int phys_index_bits;
+
+/* Where the DMA memory comes from, best first */
+enum {
+	MEM_AUTO,
+	MEM_MBOX,       /* VideoCore allocation, physically contiguous */
+	MEM_HUGE,       /* Huge pages, contiguous within each huge page */
+	MEM_PAGES,      /* Locked small pages, scattered */
+};
+
+static const char *const mem_names[] = {
+	[MEM_AUTO] = "auto",
+	[MEM_MBOX] = "mbox",
+	[MEM_HUGE] = "huge",
+	[MEM_PAGES] = "pages",
+};
+
+static int mem_kind = MEM_AUTO;
+static size_t mem_size;
+static long sys_page_size;
+static int mem_contiguous;      /* CB translation is mem_phys_base + offset */
+static uint32_t mem_phys_base;
+static int mbox_fd = -1;
+static uint32_t mbox_handle;
+static int mem_fd = -1;                 /* memfd of huge and small pages, for a handoff */
 
 static volatile uint32_t *pwm_reg;
 static volatile uint32_t *pcm_reg;
 static volatile uint32_t *clk_reg;
-static volatile uint32_t *dma_reg;
+static volatile uint32_t *dma_base_reg;
 static volatile uint32_t *gpio_reg;
 
-static int delay_hw = DELAY_VIA_PWM;
 
-static double pi;
 static double option_amplitude = 0.9;
-static double option_frequency = 0;
-static int option_div = 0;
 static int option_mash = 3;
 static double option_rc = 4700.0 * 0.000001;
 static int option_timeout = -1;
+static int option_sleep;
+static int option_serial;               /* Serializer bits per sample, 0 for GPIO writes */
+static const char *option_polar;        /* I/Q ring to send in polar mode */
+static int option_ptt;                  /* PTT lines switched in the DMA chain */
+static int ptt_gpio[3] = {-1, -1, -1};  /* PA, RF and RF complement, -1 for none */
+static int ptt_lead[2] = {500, 1000};   /* Samples the PA and RF go on before the start */
+static int ptt_lag[2] = {500, 1000};    /* ... and off after the end */
+static int option_rt_priority;          /* SCHED_FIFO of the feeders, 0 for none */
+static int option_cpu = -1;             /* CPU of the feeders */
 static double level_error_max;
+static const char *option_si570 = NULL;
+static double option_lo_frequency = 0;
+static double option_lo_startup = 10.0;
+
+static si570_t lo;
+static int lo_active;
+
+static const char *option_doppler = NULL;
+static const char *option_predistort = NULL;
+static const char *option_shape = "rc";
+static int option_threads = 0;
+static int ts_count = 16;               /* Slots of the DMA queue, a power of 2 */
+static int ts_depth_min = 8;            /* Symbols queued ahead while typing */
+static const char *option_journal = NULL;
+static const char *option_log = NULL;
+static const char *option_iq_tap = NULL;
+static int ctrl_threads;
+
+static predistort_t pd;
+static int pd_active;
 
 typedef struct {
-	int b_len;
-	int b_val;
-} burst_t;
+	double t;               /* Unix time */
+	double factor;          /* Carrier multiplier */
+	int last;               /* Last point of a pass */
+} doppler_point_t;
+
+static doppler_point_t *doppler;
+static int doppler_count;
+static double doppler_lo;       /* Nominal LO frequency, Hz */
 
 static const burst_t starting_burst = {20, 0};
 static const burst_t ending_burst = {20, 0x000fffff};
 static const burst_t fill_burst = {1, 0};
 static const burst_t idle_burst = {1, 1};
 
-/* Each character is separated by last two zeros. The bits are sent lsbit first. */
-static const burst_t varicode_table[] = {
-	{12, 0x0355}, /* ASCII =   0 101010101100 */
-	{12, 0x036d}, /* ASCII =   1 101101101100 */
-	{12, 0x02dd}, /* ASCII =   2 101110110100 */
-	{12, 0x03bb}, /* ASCII =   3 110111011100 */
-	{12, 0x035d}, /* ASCII =   4 101110101100 */
-	{12, 0x03eb}, /* ASCII =   5 110101111100 */
-	{12, 0x03dd}, /* ASCII =   6 101110111100 */
-	{12, 0x02fd}, /* ASCII =   7 101111110100 */
-	{12, 0x03fd}, /* ASCII =   8 101111111100 */
-	{10, 0x00f7}, /* ASCII =   9 1110111100 */
-	{ 7, 0x0017}, /* ASCII =  10 1110100 */
-	{12, 0x03db}, /* ASCII =  11 110110111100 */
-	{12, 0x02ed}, /* ASCII =  12 101101110100 */
-	{ 7, 0x001f}, /* ASCII =  13 1111100 */
-	{12, 0x02bb}, /* ASCII =  14 110111010100 */
-	{12, 0x0357}, /* ASCII =  15 111010101100 */
-	{12, 0x03bd}, /* ASCII =  16 101111011100 */
-	{12, 0x02bd}, /* ASCII =  17 101111010100 */
-	{12, 0x02d7}, /* ASCII =  18 111010110100 */
-	{12, 0x03d7}, /* ASCII =  19 111010111100 */
-	{12, 0x036b}, /* ASCII =  20 110101101100 */
-	{12, 0x035b}, /* ASCII =  21 110110101100 */
-	{12, 0x02db}, /* ASCII =  22 110110110100 */
-	{12, 0x03ab}, /* ASCII =  23 110101011100 */
-	{12, 0x037b}, /* ASCII =  24 110111101100 */
-	{12, 0x02fb}, /* ASCII =  25 110111110100 */
-	{12, 0x03b7}, /* ASCII =  26 111011011100 */
-	{12, 0x02ab}, /* ASCII =  27 110101010100 */
-	{12, 0x02eb}, /* ASCII =  28 110101110100 */
-	{12, 0x0377}, /* ASCII =  29 111011101100 */
-	{12, 0x037d}, /* ASCII =  30 101111101100 */
-	{12, 0x03fb}, /* ASCII =  31 110111111100 */
-	{ 3, 0x0001}, /* ASCII = ' ' 100 */
-	{11, 0x01ff}, /* ASCII = '!' 11111111100 */
-	{11, 0x01f5}, /* ASCII = '"' 10101111100 */
-	{11, 0x015f}, /* ASCII = '#' 11111010100 */
-	{11, 0x01b7}, /* ASCII = '$' 11101101100 */
-	{12, 0x02ad}, /* ASCII = '%' 101101010100 */
-	{12, 0x0375}, /* ASCII = '&' 101011101100 */
-	{11, 0x01fd}, /* ASCII = ''' 10111111100 */
-	{10, 0x00df}, /* ASCII = '(' 1111101100 */
-	{10, 0x00ef}, /* ASCII = ')' 1111011100 */
-	{11, 0x01ed}, /* ASCII = '*' 10110111100 */
-	{11, 0x01f7}, /* ASCII = '+' 11101111100 */
-	{ 9, 0x0057}, /* ASCII = ',' 111010100 */
-	{ 8, 0x002b}, /* ASCII = '-' 11010100 */
-	{ 9, 0x0075}, /* ASCII = '.' 101011100 */
-	{11, 0x01eb}, /* ASCII = '/' 11010111100 */
-	{10, 0x00ed}, /* ASCII = '0' 1011011100 */
-	{10, 0x00bd}, /* ASCII = '1' 1011110100 */
-	{10, 0x00b7}, /* ASCII = '2' 1110110100 */
-	{10, 0x00ff}, /* ASCII = '3' 1111111100 */
-	{11, 0x01dd}, /* ASCII = '4' 10111011100 */
-	{11, 0x01b5}, /* ASCII = '5' 10101101100 */
-	{11, 0x01ad}, /* ASCII = '6' 10110101100 */
-	{11, 0x016b}, /* ASCII = '7' 11010110100 */
-	{11, 0x01ab}, /* ASCII = '8' 11010101100 */
-	{11, 0x01db}, /* ASCII = '9' 11011011100 */
-	{10, 0x00af}, /* ASCII = ':' 1111010100 */
-	{11, 0x017b}, /* ASCII = ';' 11011110100 */
-	{11, 0x016f}, /* ASCII = '<' 11110110100 */
-	{ 9, 0x0055}, /* ASCII = '=' 101010100 */
-	{11, 0x01d7}, /* ASCII = '>' 11101011100 */
-	{12, 0x03d5}, /* ASCII = '?' 101010111100 */
-	{12, 0x02f5}, /* ASCII = '@' 101011110100 */
-	{ 9, 0x005f}, /* ASCII = 'A' 111110100 */
-	{10, 0x00d7}, /* ASCII = 'B' 1110101100 */
-	{10, 0x00b5}, /* ASCII = 'C' 1010110100 */
-	{10, 0x00ad}, /* ASCII = 'D' 1011010100 */
-	{ 9, 0x0077}, /* ASCII = 'E' 111011100 */
-	{10, 0x00db}, /* ASCII = 'F' 1101101100 */
-	{10, 0x00bf}, /* ASCII = 'G' 1111110100 */
-	{11, 0x0155}, /* ASCII = 'H' 10101010100 */
-	{ 9, 0x007f}, /* ASCII = 'I' 111111100 */
-	{11, 0x017f}, /* ASCII = 'J' 11111110100 */
-	{11, 0x017d}, /* ASCII = 'K' 10111110100 */
-	{10, 0x00eb}, /* ASCII = 'L' 1101011100 */
-	{10, 0x00dd}, /* ASCII = 'M' 1011101100 */
-	{10, 0x00bb}, /* ASCII = 'N' 1101110100 */
-	{10, 0x00d5}, /* ASCII = 'O' 1010101100 */
-	{10, 0x00ab}, /* ASCII = 'P' 1101010100 */
-	{11, 0x0177}, /* ASCII = 'Q' 11101110100 */
-	{10, 0x00f5}, /* ASCII = 'R' 1010111100 */
-	{ 9, 0x007b}, /* ASCII = 'S' 110111100 */
-	{ 9, 0x005b}, /* ASCII = 'T' 110110100 */
-	{11, 0x01d5}, /* ASCII = 'U' 10101011100 */
-	{11, 0x015b}, /* ASCII = 'V' 11011010100 */
-	{11, 0x0175}, /* ASCII = 'W' 10101110100 */
-	{11, 0x015d}, /* ASCII = 'X' 10111010100 */
-	{11, 0x01bd}, /* ASCII = 'Y' 10111101100 */
-	{12, 0x02d5}, /* ASCII = 'Z' 101010110100 */
-	{11, 0x01df}, /* ASCII = '[' 11111011100 */
-	{11, 0x01ef}, /* ASCII = '\' 11110111100 */
-	{11, 0x01bf}, /* ASCII = ']' 11111101100 */
-	{12, 0x03f5}, /* ASCII = '^' 101011111100 */
-	{11, 0x016d}, /* ASCII = '_' 10110110100 */
-	{12, 0x03ed}, /* ASCII = '`' 101101111100 */
-	{ 6, 0x000d}, /* ASCII = 'a' 101100 */
-	{ 9, 0x007d}, /* ASCII = 'b' 101111100 */
-	{ 8, 0x003d}, /* ASCII = 'c' 10111100 */
-	{ 8, 0x002d}, /* ASCII = 'd' 10110100 */
-	{ 4, 0x0003}, /* ASCII = 'e' 1100 */
-	{ 8, 0x002f}, /* ASCII = 'f' 11110100 */
-	{ 9, 0x006d}, /* ASCII = 'g' 101101100 */
-	{ 8, 0x0035}, /* ASCII = 'h' 10101100 */
-	{ 6, 0x000b}, /* ASCII = 'i' 110100 */
-	{11, 0x01af}, /* ASCII = 'j' 11110101100 */
-	{10, 0x00fd}, /* ASCII = 'k' 1011111100 */
-	{ 7, 0x001b}, /* ASCII = 'l' 1101100 */
-	{ 8, 0x0037}, /* ASCII = 'm' 11101100 */
-	{ 6, 0x000f}, /* ASCII = 'n' 111100 */
-	{ 5, 0x0007}, /* ASCII = 'o' 11100 */
-	{ 8, 0x003f}, /* ASCII = 'p' 11111100 */
-	{11, 0x01fb}, /* ASCII = 'q' 11011111100 */
-	{ 7, 0x0015}, /* ASCII = 'r' 1010100 */
-	{ 7, 0x001d}, /* ASCII = 's' 1011100 */
-	{ 5, 0x0005}, /* ASCII = 't' 10100 */
-	{ 8, 0x003b}, /* ASCII = 'u' 11011100 */
-	{ 9, 0x006f}, /* ASCII = 'v' 111101100 */
-	{ 9, 0x006b}, /* ASCII = 'w' 110101100 */
-	{10, 0x00fb}, /* ASCII = 'x' 1101111100 */
-	{ 9, 0x005d}, /* ASCII = 'y' 101110100 */
-	{11, 0x0157}, /* ASCII = 'z' 11101010100 */
-	{12, 0x03b5}, /* ASCII = '{' 101011011100 */
-	{11, 0x01bb}, /* ASCII = '|' 11011101100 */
-	{12, 0x02b5}, /* ASCII = '}' 101011010100 */
-	{12, 0x03ad}, /* ASCII = '~' 101101011100 */
-	{12, 0x02b7}, /* ASCII = 127 111011010100 */
-	{12, 0x02f7}, /* ASCII = 128 111011110100 */
-	{12, 0x03f7}, /* ASCII = 129 111011111100 */
-	{12, 0x02af}, /* ASCII = 130 111101010100 */
-	{12, 0x03af}, /* ASCII = 131 111101011100 */
-	{12, 0x036f}, /* ASCII = 132 111101101100 */
-	{12, 0x02ef}, /* ASCII = 133 111101110100 */
-	{12, 0x03ef}, /* ASCII = 134 111101111100 */
-	{12, 0x035f}, /* ASCII = 135 111110101100 */
-	{12, 0x02df}, /* ASCII = 136 111110110100 */
-	{12, 0x03df}, /* ASCII = 137 111110111100 */
-	{12, 0x02bf}, /* ASCII = 138 111111010100 */
-	{12, 0x03bf}, /* ASCII = 139 111111011100 */
-	{12, 0x037f}, /* ASCII = 140 111111101100 */
-	{12, 0x02ff}, /* ASCII = 141 111111110100 */
-	{12, 0x03ff}, /* ASCII = 142 111111111100 */
-	{13, 0x0555}, /* ASCII = 143 1010101010100 */
-	{13, 0x0755}, /* ASCII = 144 1010101011100 */
-	{13, 0x06d5}, /* ASCII = 145 1010101101100 */
-	{13, 0x05d5}, /* ASCII = 146 1010101110100 */
-	{13, 0x07d5}, /* ASCII = 147 1010101111100 */
-	{13, 0x06b5}, /* ASCII = 148 1010110101100 */
-	{13, 0x05b5}, /* ASCII = 149 1010110110100 */
-	{13, 0x07b5}, /* ASCII = 150 1010110111100 */
-	{13, 0x0575}, /* ASCII = 151 1010111010100 */
-	{13, 0x0775}, /* ASCII = 152 1010111011100 */
-	{13, 0x06f5}, /* ASCII = 153 1010111101100 */
-	{13, 0x05f5}, /* ASCII = 154 1010111110100 */
-	{13, 0x07f5}, /* ASCII = 155 1010111111100 */
-	{13, 0x06ad}, /* ASCII = 156 1011010101100 */
-	{13, 0x05ad}, /* ASCII = 157 1011010110100 */
-	{13, 0x07ad}, /* ASCII = 158 1011010111100 */
-	{13, 0x056d}, /* ASCII = 159 1011011010100 */
-	{13, 0x076d}, /* ASCII = 160 1011011011100 */
-	{13, 0x06ed}, /* ASCII = 161 1011011101100 */
-	{13, 0x05ed}, /* ASCII = 162 1011011110100 */
-	{13, 0x07ed}, /* ASCII = 163 1011011111100 */
-	{13, 0x055d}, /* ASCII = 164 1011101010100 */
-	{13, 0x075d}, /* ASCII = 165 1011101011100 */
-	{13, 0x06dd}, /* ASCII = 166 1011101101100 */
-	{13, 0x05dd}, /* ASCII = 167 1011101110100 */
-	{13, 0x07dd}, /* ASCII = 168 1011101111100 */
-	{13, 0x06bd}, /* ASCII = 169 1011110101100 */
-	{13, 0x05bd}, /* ASCII = 170 1011110110100 */
-	{13, 0x07bd}, /* ASCII = 171 1011110111100 */
-	{13, 0x057d}, /* ASCII = 172 1011111010100 */
-	{13, 0x077d}, /* ASCII = 173 1011111011100 */
-	{13, 0x06fd}, /* ASCII = 174 1011111101100 */
-	{13, 0x05fd}, /* ASCII = 175 1011111110100 */
-	{13, 0x07fd}, /* ASCII = 176 1011111111100 */
-	{13, 0x06ab}, /* ASCII = 177 1101010101100 */
-	{13, 0x05ab}, /* ASCII = 178 1101010110100 */
-	{13, 0x07ab}, /* ASCII = 179 1101010111100 */
-	{13, 0x056b}, /* ASCII = 180 1101011010100 */
-	{13, 0x076b}, /* ASCII = 181 1101011011100 */
-	{13, 0x06eb}, /* ASCII = 182 1101011101100 */
-	{13, 0x05eb}, /* ASCII = 183 1101011110100 */
-	{13, 0x07eb}, /* ASCII = 184 1101011111100 */
-	{13, 0x055b}, /* ASCII = 185 1101101010100 */
-	{13, 0x075b}, /* ASCII = 186 1101101011100 */
-	{13, 0x06db}, /* ASCII = 187 1101101101100 */
-	{13, 0x05db}, /* ASCII = 188 1101101110100 */
-	{13, 0x07db}, /* ASCII = 189 1101101111100 */
-	{13, 0x06bb}, /* ASCII = 190 1101110101100 */
-	{13, 0x05bb}, /* ASCII = 191 1101110110100 */
-	{13, 0x07bb}, /* ASCII = 192 1101110111100 */
-	{13, 0x057b}, /* ASCII = 193 1101111010100 */
-	{13, 0x077b}, /* ASCII = 194 1101111011100 */
-	{13, 0x06fb}, /* ASCII = 195 1101111101100 */
-	{13, 0x05fb}, /* ASCII = 196 1101111110100 */
-	{13, 0x07fb}, /* ASCII = 197 1101111111100 */
-	{13, 0x0557}, /* ASCII = 198 1110101010100 */
-	{13, 0x0757}, /* ASCII = 199 1110101011100 */
-	{13, 0x06d7}, /* ASCII = 200 1110101101100 */
-	{13, 0x05d7}, /* ASCII = 201 1110101110100 */
-	{13, 0x07d7}, /* ASCII = 202 1110101111100 */
-	{13, 0x06b7}, /* ASCII = 203 1110110101100 */
-	{13, 0x05b7}, /* ASCII = 204 1110110110100 */
-	{13, 0x07b7}, /* ASCII = 205 1110110111100 */
-	{13, 0x0577}, /* ASCII = 206 1110111010100 */
-	{13, 0x0777}, /* ASCII = 207 1110111011100 */
-	{13, 0x06f7}, /* ASCII = 208 1110111101100 */
-	{13, 0x05f7}, /* ASCII = 209 1110111110100 */
-	{13, 0x07f7}, /* ASCII = 210 1110111111100 */
-	{13, 0x06af}, /* ASCII = 211 1111010101100 */
-	{13, 0x05af}, /* ASCII = 212 1111010110100 */
-	{13, 0x07af}, /* ASCII = 213 1111010111100 */
-	{13, 0x056f}, /* ASCII = 214 1111011010100 */
-	{13, 0x076f}, /* ASCII = 215 1111011011100 */
-	{13, 0x06ef}, /* ASCII = 216 1111011101100 */
-	{13, 0x05ef}, /* ASCII = 217 1111011110100 */
-	{13, 0x07ef}, /* ASCII = 218 1111011111100 */
-	{13, 0x055f}, /* ASCII = 219 1111101010100 */
-	{13, 0x075f}, /* ASCII = 220 1111101011100 */
-	{13, 0x06df}, /* ASCII = 221 1111101101100 */
-	{13, 0x05df}, /* ASCII = 222 1111101110100 */
-	{13, 0x07df}, /* ASCII = 223 1111101111100 */
-	{13, 0x06bf}, /* ASCII = 224 1111110101100 */
-	{13, 0x05bf}, /* ASCII = 225 1111110110100 */
-	{13, 0x07bf}, /* ASCII = 226 1111110111100 */
-	{13, 0x057f}, /* ASCII = 227 1111111010100 */
-	{13, 0x077f}, /* ASCII = 228 1111111011100 */
-	{13, 0x06ff}, /* ASCII = 229 1111111101100 */
-	{13, 0x05ff}, /* ASCII = 230 1111111110100 */
-	{13, 0x07ff}, /* ASCII = 231 1111111111100 */
-	{14, 0x0d55}, /* ASCII = 232 10101010101100 */
-	{14, 0x0b55}, /* ASCII = 233 10101010110100 */
-	{14, 0x0f55}, /* ASCII = 234 10101010111100 */
-	{14, 0x0ad5}, /* ASCII = 235 10101011010100 */
-	{14, 0x0ed5}, /* ASCII = 236 10101011011100 */
-	{14, 0x0dd5}, /* ASCII = 237 10101011101100 */
-	{14, 0x0bd5}, /* ASCII = 238 10101011110100 */
-	{14, 0x0fd5}, /* ASCII = 239 10101011111100 */
-	{14, 0x0ab5}, /* ASCII = 240 10101101010100 */
-	{14, 0x0eb5}, /* ASCII = 241 10101101011100 */
-	{14, 0x0db5}, /* ASCII = 242 10101101101100 */
-	{14, 0x0bb5}, /* ASCII = 243 10101101110100 */
-	{14, 0x0fb5}, /* ASCII = 244 10101101111100 */
-	{14, 0x0d75}, /* ASCII = 245 10101110101100 */
-	{14, 0x0b75}, /* ASCII = 246 10101110110100 */
-	{14, 0x0f75}, /* ASCII = 247 10101110111100 */
-	{14, 0x0af5}, /* ASCII = 248 10101111010100 */
-	{14, 0x0ef5}, /* ASCII = 249 10101111011100 */
-	{14, 0x0df5}, /* ASCII = 250 10101111101100 */
-	{14, 0x0bf5}, /* ASCII = 251 10101111110100 */
-	{14, 0x0ff5}, /* ASCII = 252 10101111111100 */
-	{14, 0x0aad}, /* ASCII = 253 10110101010100 */
-	{14, 0x0ead}, /* ASCII = 254 10110101011100 */
-	{14, 0x0dad}, /* ASCII = 255 10110101101100 */
+/* Feeder states */
+enum {
+	STATE_START,
+	STATE_SEND,
+	STATE_FILL,
+	STATE_STOP,
+	STATE_IDLE,
+	STATE_SLEEP,            /* Off the air, clocks and DMA stopped */
+	STATE_KEY,              /* Steady symbols while the PTT lines come up */
+};
+
+static const char *const state_names[] = {
+	[STATE_START] = "start",
+	[STATE_SEND] = "send",
+	[STATE_FILL] = "fill",
+	[STATE_STOP] = "stop",
+	[STATE_IDLE] = "idle",
+	[STATE_SLEEP] = "sleep",
+	[STATE_KEY] = "key",
 };
 
 typedef struct {
@@ -549,11 +416,199 @@ typedef struct {
 	int c_mash;
 } clock_cb_t;
 
-clock_cb_t clock_cb = {
-	.c_div = 0,
-	.c_mash = 0,
+/* PTT lines of the first transmitter: PA enable, RF switch and its complement */
+enum {
+	PTT_PA,
+	PTT_RF,
+	PTT_RF2,
+};
+
+static const char *const ptt_names[] = {
+	[PTT_PA] = "pa",
+	[PTT_RF] = "rf",
+	[PTT_RF2] = "rf2",
+};
+
+/* A write to the GPIO set or clear register, due at a sample */
+#define PTT_WHAT(line, on, set) ((line) << 2 | (on) << 1 | (set))
+
+typedef struct {
+	uint64_t sample;
+	uint32_t mask;
+	uint8_t what;                   /* PTT_WHAT(), as logged */
+} ptt_event_t;
+
+/* General purpose clock outputs, ALT0 */
+static const int gpclk_gpio[] = {4, 5, 6};
+
+typedef struct {
+	/* Configuration */
+	char name[16];          /* Empty for the first one, which has the plain device files */
+	int gpclk;              /* General purpose clock 0 .. 2 */
+	int dma_chan;
+	int gpio_pos;
+	int gpio_neg;
+	int delay_hw;           /* DELAY_VIA_PWM or DELAY_VIA_PCM */
+	double frequency;
+	int div;
+	/* Hardware */
+	volatile uint32_t *dma_reg;
+	clock_cb_t clock_cb;
+	uint32_t cb_base;       /* Start of the CB region */
+	/* DMA queue */
+	ts_info_t *ts_info;     /* ts_count slots */
+	int ts_last;
+	int depth;              /* Symbols kept queued ahead of the DMA */
+	dma_cb_t *ts_last_cbp;
+	int ts_last_sym;
+	uint64_t sample_next;   /* Sample at which the next symbol queued starts */
+	/* Doppler */
+	int doppler_pos;
+	uint32_t doppler_div;   /* Nominal clock divisor */
+	double doppler_factor;
+	/* Device files and feeder */
+	char devfile_send[64];
+	char devfile_ctrl[64];
+	char devfile_stat[64];
+	char devfile_sock[64];
+	pthread_t thread;
+	/* Messages from the submission socket */
+	msgq_t queue;
+	char journal_path[80];  /* Empty for none */
+	journal_t journal;
+	char log_path[80];      /* Empty for none */
+	txlog_t log;
+	char iq_path[80];       /* Empty for none */
+	iqring_t iq;
+	/* Low power idle */
+	int asleep;
+	unsigned sleep_count;
+	unsigned sleep_wakeups; /* Of the feeder, in the last sleep */
+	double sleep_start_ms;
+	double sleep_cpu_ms;    /* Feeder CPU time at the start of the sleep */
+	double wake_ms;         /* From the input to the first symbol, last time */
+	/* Feeder timing */
+	uint32_t late_hist[LATE_BUCKETS];
+	uint32_t late_max_us;
+	int margin_min;         /* Fewest symbols left in the DMA queue at a refill */
+	int margin_skip;        /* The DMA just started again on one symbol, not a sample */
+	/* Polar mode */
+	polar_t polar;
+	/* Live handoff */
+	int handoff_event;      /* eventfd, wakes the feeder to stop for it */
+	/* PTT, first transmitter only */
+	ptt_event_t ptt[PTT_EVENTS];    /* Switching not in the chain yet, by sample */
+	int ptt_count;
+	int ptt_on[2];          /* PA and RF, once all of it has happened */
+	uint64_t ptt_last;      /* Sample of the last switching put in the chain */
+} tx_t;
+
+static tx_t tx_list[TX_MAX] = {
+	[0] = {
+		.gpclk = 0,
+		.dma_chan = 0,
+		.gpio_pos = GPIO_POS_NUM,
+		.gpio_neg = GPIO_NEG_NUM,
+		.delay_hw = DELAY_VIA_PWM,
+	},
+};
+static int tx_count = 1;
+
+/*
+ * Live handoff, for an upgrade without going off the air. A new psk31 started
+ * with --handoff connects to the running one, which finishes the messages in
+ * flight, fills its DMA queues and stops feeding them at a symbol boundary.
+ * It passes its DMA memory, its device files and where every feeder stood,
+ * and the new one links its symbols on to the chains the DMA is still
+ * running. The old one then exits without touching the hardware.
+ */
+#define HANDOFF_MAGIC   0x70736b68
+#define HANDOFF_VERSION 3
+#define HANDOFF_WAIT_MS 30000   /* For the messages in flight to go out */
+#define HANDOFF_ACK_MS  5000
+#define HANDOFF_FDS     (2 + 3 * TX_MAX)
+#define SENDSIZE 128
+
+enum {
+	HANDOFF_NONE,
+	HANDOFF_PENDING,
 };
 
+// A slot of the DMA queue, with the pointers as CB offsets, which are the same in both
+typedef struct {
+	struct {
+		uint32_t physaddr;
+		uint32_t cb_offset;
+		uint32_t cb_last;
+	} bs[SYM_COUNT];
+	uint32_t physaddr;
+	uint64_t start;
+	int skip;
+	uint32_t entry_cb;              /* ~0 for none */
+	uint32_t entry_src;
+	uint32_t entry_length;
+	int ptt_patches;
+	uint32_t ptt_patch[PTT_CBS];
+	uint32_t ptt_next[PTT_CBS];
+} handoff_ts_t;
+
+// Where a feeder stopped
+typedef struct {
+	int dma_chan;
+	int fd[3];                      /* FIFO, status and message sockets; -1 for none */
+	clock_cb_t clock_cb;
+	uint32_t doppler_div;
+	uint32_t ts_last_cb;            /* End of the chain, ~0 for none */
+	int ts_last;
+	int ts_last_sym;
+	int depth;
+	int asleep;
+	uint64_t sample_next;
+	int state;
+	int fill_timeout;
+	burst_t curburst;
+	int sendcount;
+	uint8_t sendbuf[SENDSIZE];
+	ptt_event_t ptt[PTT_EVENTS];
+	int ptt_count;
+	int ptt_on[2];
+	uint64_t ptt_last;
+} handoff_tx_t;
+
+// What the old process sends, followed by the slots of every transmitter
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;                  /* Of this, so both were built alike */
+	pid_t pid;
+	/* Layout, which the new process has to have come to as well */
+	int tx_count;
+	int ts_count;
+	int num_pages;
+	int serial;
+	uint32_t ts_stride;
+	/* DMA memory, the descriptors are indexes in those passed */
+	int mem_kind;
+	uint64_t mem_size;
+	uint32_t mem_phys_base;
+	uint32_t mbox_handle;
+	int fd_mem;
+	int fd_handoff;
+	int lo_active;
+	si570_t lo;                     /* Its tuning, the bus is opened again */
+	double doppler_lo;
+	handoff_tx_t tx[TX_MAX];
+} handoff_t;
+
+static int option_handoff;
+static int fd_handoff = -1;             /* Listening for a new process */
+static int handoff_conn = -1;           /* The new process, while pending */
+static volatile int handoff_state;
+static int handoff_parked;              /* Feeders stopped for it */
+static volatile int handoff_adopting;   /* Taking over, the hardware is still the old one's */
+static double handoff_start_ms;
+static handoff_t handoff;
+
 // Sets a GPIO to either GPIO_MODE_IN(=0) or GPIO_MODE_OUT(=1)
 static void gpio_set_mode(uint32_t pin, uint32_t mode) {
 	uint32_t fsel = gpio_reg[GPIO_FSEL0 + pin/10];
@@ -573,6 +628,15 @@ gpio_set(int pin, int level)
         gpio_reg[GPIO_CLR0] = 1 << pin;
 }
 
+// PA and RF switch as they are while not keyed
+static void ptt_off(void) {
+	int line;
+
+	for (line = PTT_PA; line <= PTT_RF2; line++)
+		if (ptt_gpio[line] >= 0)
+			gpio_set(ptt_gpio[line], line == PTT_RF2);
+}
+
 // Very short delay
 static void
 udelay(int us)
@@ -583,19 +647,31 @@ udelay(int us)
 }
 
 static void devfiles_unlink(void) {
-	unlink(DEVFILE_SEND);
-	unlink(DEVFILE_CTRL);
-	unlink(DEVFILE_STAT);
+	tx_t *tx;
+
+	for (tx = tx_list; tx < &tx_list[tx_count]; tx++) {
+		if (!tx->devfile_send[0])
+			continue;
+		unlink(tx->devfile_send);
+		unlink(tx->devfile_ctrl);
+		unlink(tx->devfile_stat);
+		unlink(tx->devfile_sock);
+	}
+	unlink(DEVFILE_HANDOFF);
 }
 
-static void clock_stop(void) {
-	clk_reg[CM_GP0CTL] = 0x5a000000 | (clk_reg[CM_GP0CTL] & 0x0000070f);
-	while ((clk_reg[CM_GP0CTL] & 0x00000080) != 0)
+static void clock_stop(tx_t *tx) {
+	int ctl = CM_GP0CTL + 2 * tx->gpclk;
+
+	if (!clk_reg)
+		return;
+	clk_reg[ctl] = 0x5a000000 | (clk_reg[ctl] & 0x0000070f);
+	while ((clk_reg[ctl] & 0x00000080) != 0)
 		/*usleep(1000)*/;
-	clock_cb.c_div = 0;
+	tx->clock_cb.c_div = 0;
 }
 
-static void clock_start(void) {
+static void clock_start(tx_t *tx) {
 	uint32_t div, divi;
 	uint32_t mash;
 	uint32_t ctl;
@@ -606,19 +682,19 @@ static void clock_start(void) {
 	} dt[] = {{2, 0, 1}, {3, 1, 2}, {5, 3, 4}};
 
 	/* Stop the clock */
-	clock_stop();
-	if (option_div > 0 && option_div <= 0x00fff000)
-		div = option_div;
-	else if (option_frequency >= 500.0 * (double)(1 << 12) / (double)0x00fff000)
-		div = (uint32_t)((500.0 / option_frequency) * (double)(1 << 12) + 0.5);
+	clock_stop(tx);
+	if (tx->div > 0 && tx->div <= 0x00fff000)
+		div = tx->div;
+	else if (tx->frequency >= 500.0 * (double)(1 << 12) / (double)0x00fff000)
+		div = (uint32_t)((500.0 / tx->frequency) * (double)(1 << 12) + 0.5);
 	else
 		return;
-	gpio_set_mode(GPIO_FREQ_NUM, GPIO_MODE_ALT0);
+	gpio_set_mode(gpclk_gpio[tx->gpclk], GPIO_MODE_ALT0);
 	/* Setup new frequency */
 	divi = div >> 12;
 	if (divi < 1 || div > 0x00fff000)
 		return;
-	clk_reg[CM_GP0DIV] = 0x5a000000 | div;
+	clk_reg[CM_GP0DIV + 2 * tx->gpclk] = 0x5a000000 | div;
 	if (option_mash >= -3 && option_mash <= 0) {
 		mash = -option_mash;
 	} else {
@@ -638,19 +714,72 @@ static void clock_start(void) {
 		}
 	}
 	ctl = 0x5a000006 | (mash << 9);
-	clk_reg[CM_GP0CTL] = ctl;
-	clk_reg[CM_GP0CTL] = ctl | 0x00000010;
-	clock_cb.c_div = div;
-	clock_cb.c_mash = mash;
+	clk_reg[CM_GP0CTL + 2 * tx->gpclk] = ctl;
+	clk_reg[CM_GP0CTL + 2 * tx->gpclk] = ctl | 0x00000010;
+	tx->clock_cb.c_div = div;
+	tx->clock_cb.c_mash = mash;
+}
+
+// VideoCore mailbox property call with up to three arguments
+#define IOCTL_MBOX_PROPERTY     _IOWR(100, 0, char *)
+#define MBOX_MEM_ALLOC          0x3000c
+#define MBOX_MEM_LOCK           0x3000d
+#define MBOX_MEM_UNLOCK         0x3000e
+#define MBOX_MEM_FREE           0x3000f
+#define MBOX_MEM_FLAG_DIRECT    0x0c    /* Uncached, bus alias 0xC0000000 */
+
+static uint32_t mbox_property(uint32_t tag, int nargs, uint32_t a0, uint32_t a1, uint32_t a2) {
+	uint32_t p[10];
+
+	p[0] = sizeof(p);
+	p[1] = 0;               /* Process request */
+	p[2] = tag;
+	p[3] = 12;              /* Value buffer size */
+	p[4] = nargs * 4;       /* Request size */
+	p[5] = a0;
+	p[6] = a1;
+	p[7] = a2;
+	p[8] = 0;               /* End tag */
+	p[9] = 0;
+	if (ioctl(mbox_fd, IOCTL_MBOX_PROPERTY, p) < 0 || p[1] != 0x80000000)
+		return 0;
+	return p[5];
+}
+
+// Give back memory the VideoCore lent us, it is not freed on exit
+static void mem_release(void) {
+	if (mbox_fd < 0)
+		return;
+	if (mbox_handle) {
+		if (virtbase)
+			munmap(virtbase, mem_size);
+		mbox_property(MBOX_MEM_UNLOCK, 1, mbox_handle, 0, 0);
+		mbox_property(MBOX_MEM_FREE, 1, mbox_handle, 0, 0);
+		mbox_handle = 0;
+	}
+	close(mbox_fd);
+	mbox_fd = -1;
 }
 
 // Shutdown -- its super important to reset the DMA before quitting
 static void terminate(int dummy) {
-	if (dma_reg && virtbase) {
-		dma_reg[DMA_CS] = DMA_RESET;
-		udelay(10);
+	tx_t *tx;
+
+	/* Until the handoff is done, the hardware is the running process's */
+	if (handoff_adopting)
+		exit(1);
+	for (tx = tx_list; tx < &tx_list[tx_count]; tx++)
+		if (tx->dma_reg && virtbase) {
+			tx->dma_reg[DMA_CS] = DMA_RESET;
+			udelay(10);
+		}
+	mem_release();
+	if (option_ptt && gpio_reg)
+		ptt_off();
+	for (tx = tx_list; tx < &tx_list[tx_count]; tx++) {
+		clock_stop(tx);
+		txlog_close(&tx->log);
 	}
-	clock_stop();
 	devfiles_unlink();
 	exit(1);
 }
@@ -665,6 +794,102 @@ static void fatal(char *fmt, ...) {
 	terminate(0);
 }
 
+// Program the Si570 local oscillator, if one is configured
+static void lo_start(void) {
+	si570_bus_t bus;
+
+	if (!option_si570)
+		return;
+	if (si570_bus_open(&bus, option_si570, SI570_I2C_ADDR) < 0)
+		fatal("psk31: Failed to open %s: %m\n", option_si570);
+	if (si570_init(&lo, &bus, option_lo_startup * 1e6) < 0)
+		fatal("psk31: Failed to init Si570 on %s: %m\n", option_si570);
+	lo_active = 1;
+	if (option_lo_frequency > 0 && si570_set_frequency(&lo, option_lo_frequency * 1e6) < 0)
+		fatal("psk31: Failed to set Si570 to %f MHz: %m\n", option_lo_frequency);
+}
+
+// Load a Doppler trajectory written by the doppler tool
+static void doppler_load(void) {
+	char line[128];
+	doppler_point_t *p;
+	int size, i;
+	FILE *f;
+
+	if (!option_doppler)
+		return;
+	if (!(f = fopen(option_doppler, "r")))
+		fatal("psk31: Failed to open %s: %m\n", option_doppler);
+	size = 0;
+	while (fgets(line, sizeof(line), f)) {
+		if (line[0] == '#')
+			continue;
+		if (line[0] == '\n') {
+			/* End of pass */
+			if (doppler_count)
+				doppler[doppler_count - 1].last = 1;
+			continue;
+		}
+		if (doppler_count == size) {
+			size = size ? size * 2 : 1024;
+			if (!(doppler = realloc(doppler, size * sizeof(*doppler))))
+				fatal("psk31: Failed to malloc doppler: %m\n");
+		}
+		p = &doppler[doppler_count];
+		if (sscanf(line, "%lf %lf", &p->t, &p->factor) != 2 || p->factor <= 0)
+			fatal("psk31: %s: invalid line %d\n", option_doppler, doppler_count + 1);
+		if (doppler_count && p->t <= doppler[doppler_count - 1].t)
+			fatal("psk31: %s: time goes backwards\n", option_doppler);
+		p->last = 0;
+		doppler_count++;
+	}
+	fclose(f);
+	if (doppler_count)
+		doppler[doppler_count - 1].last = 1;
+	/* Corrections are relative to the carriers as configured */
+	for (i = 0; i < tx_count; i++) {
+		tx_list[i].doppler_div = tx_list[i].clock_cb.c_div;
+		tx_list[i].doppler_factor = 1.0;
+	}
+	doppler_lo = lo_active ? lo.f_out : 0;
+}
+
+// Follow the trajectory. Only the carriers are touched, and only when they change.
+// The LO is shared by the board and follows the first transmitter.
+static void doppler_apply(tx_t *tx) {
+	struct timeval tv;
+	const doppler_point_t *p;
+	double t, factor;
+	uint32_t div;
+
+	if (!doppler_count)
+		return;
+	gettimeofday(&tv, NULL);
+	t = tv.tv_sec + tv.tv_usec * 0.000001;
+	while (tx->doppler_pos < doppler_count && doppler[tx->doppler_pos].t <= t)
+		tx->doppler_pos++;
+	factor = 1.0;
+	if (tx->doppler_pos > 0 && tx->doppler_pos < doppler_count && !doppler[tx->doppler_pos - 1].last) {
+		p = &doppler[tx->doppler_pos - 1];
+		factor = p[0].factor + (p[1].factor - p[0].factor) * (t - p[0].t) / (p[1].t - p[0].t);
+	}
+	if (factor == tx->doppler_factor)
+		return;
+	tx->doppler_factor = factor;
+	if (tx->doppler_div) {
+		/* Frequency goes with the inverse of the divisor */
+		div = (uint32_t)(tx->doppler_div / factor + 0.5);
+		if (div != tx->clock_cb.c_div) {
+			clk_reg[CM_GP0DIV + 2 * tx->gpclk] = 0x5a000000 | div;
+			tx->clock_cb.c_div = div;
+			txlog_put(&tx->log, TXLOG_CLOCK, 0, div, tx->sample_next);
+		}
+	}
+	if (tx == tx_list && doppler_lo > 0 && fabs(doppler_lo * factor - lo.f_out) >= 1.0)
+		if (si570_set_frequency(&lo, doppler_lo * factor) < 0)
+			fatal("psk31: Failed to retune Si570: %m\n");
+}
+
 static void devfile_create(const char *devfile_name, mode_t mode) {
 	if (mkfifo(devfile_name, mode) < 0)
 		fatal("rpio-pwm: Failed to create %s: %m\n", devfile_name);
@@ -673,8 +898,12 @@ static void devfile_create(const char *devfile_name, mode_t mode) {
 }
 
 static void devfiles_create(void) {
-	devfile_create(DEVFILE_SEND, 0622);
-	devfile_create(DEVFILE_CTRL, 0622);
+	tx_t *tx;
+
+	for (tx = tx_list; tx < &tx_list[tx_count]; tx++) {
+		devfile_create(tx->devfile_send, 0622);
+		devfile_create(tx->devfile_ctrl, 0622);
+	}
 }
 
 // Catch all signals possible - it is vital we kill the DMA engine
@@ -701,7 +930,7 @@ static void *mem_phys_to_virt(uint32_t phys) {
 	int l, u, m;
 
 	l = 0;
-	u = NUM_PAGES_CBS;
+	u = num_pages_cbs;
 	while (u > l + 1) {
 		m = (l + u) / 2;
 		if (phys >= phys_info[m].physaddr)
@@ -715,64 +944,6 @@ static void *mem_phys_to_virt(uint32_t phys) {
 }
 #endif
 
-static int tx_sym_pending(void) {
-	uint32_t phys;
-	int l, m, u;
-
-	/* Retrieve current TS */
-	phys = dma_reg[DMA_CONBLK_AD];
-	if (phys == 0)
-		fatal("rpio-pwm: DMA stopped\n");
-	l = 0;
-	u = TS_COUNT;
-	while (u > l + 1) {
-		m = (l + u) / 2;
-		if (phys >= ts_info[m].physaddr)
-			l = m;
-		else
-			u = m;
-	}
-	return (ts_last - l) & (TS_COUNT - 1);
-}
-
-static void tx_sym_enqueue(int s) {
-	ts_info_t *ti;
-	bs_info_t *bs;
-
-#if 0
-{
-	static int sent = 0;
-	static const char s_char[][2] = {
-		[SYM_L] = {' ', '_'},
-		[SYM_H] = {'_', ' '},
-		[SYM_LH] = {' ', '/'},
-		[SYM_HL] = {' ', '\\'},
-	};
-	static char buf[2][51];
-
-	buf[0][sent] = s_char[s][0];
-	buf[1][sent] = s_char[s][1];
-	if (++sent == 50) {
-		buf[0][sent] = 0;
-		buf[1][sent] = 0;
-		sent = 0;
-		printf(" %s\n[%s]\n", buf[0], buf[1]);
-	}
-}
-#endif
-	if (!ts_last_cbp)
-		ts_last = 0;
-	else
-		ts_last = (ts_last + 1) % TS_COUNT;
-	ti = &ts_info[ts_last];
-	bs = &ti->bs[s];
-	out32(&bs->cb_last->next, 0);
-	if (ts_last_cbp)
-		out32(&ts_last_cbp->next, bs->physaddr);
-	ts_last_cbp = bs->cb_last;
-	ts_last_sym = s;
-}
-
 // More memory mapping
 static void *map_peripheral(uint32_t base, uint32_t len) {
 	int fd = open("/dev/mem", O_RDWR);
@@ -788,37 +959,150 @@ static void *map_peripheral(uint32_t base, uint32_t len) {
 	return vaddr;
 }
 
-// Initialize the memory pagemap
+static double now_ms(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static int mem_alloc_mbox(void) {
+	uint32_t bus;
+	int fd;
+
+	if ((mbox_fd = open("/dev/vcio", 0)) < 0)
+		return -1;
+	mbox_handle = mbox_property(MBOX_MEM_ALLOC, 3, mem_size, PAGE_SIZE, MBOX_MEM_FLAG_DIRECT);
+	if (!mbox_handle || !(bus = mbox_property(MBOX_MEM_LOCK, 1, mbox_handle, 0, 0))) {
+		mem_release();
+		return -1;
+	}
+	if ((fd = open("/dev/mem", O_RDWR | O_SYNC)) < 0)
+		fatal("psk31: Failed to open /dev/mem: %m\n");
+	virtbase = mmap(NULL, mem_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, bus & ~0xc0000000);
+	close(fd);
+	if (virtbase == MAP_FAILED) {
+		virtbase = NULL;
+		mem_release();
+		return -1;
+	}
+	mem_phys_base = bus;
+	return 0;
+}
+
+static long huge_page_size(void) {
+	char line[128];
+	long kb = 0;
+	FILE *f;
+
+	if (!(f = fopen("/proc/meminfo", "r")))
+		return 0;
+	while (fgets(line, sizeof(line), f))
+		if (sscanf(line, "Hugepagesize: %ld kB", &kb) == 1)
+			break;
+	fclose(f);
+	return kb * 1024;
+}
+
+static int mem_alloc_huge(void) {
+	long huge = huge_page_size();
+	size_t size;
+	void *p;
+
+	if (huge <= 0)
+		return -1;
+	size = (mem_size + huge - 1) & ~(huge - 1);
+	/* In a memfd, so that a handoff can pass it on */
+	if ((mem_fd = memfd_create("psk31", MFD_CLOEXEC | MFD_HUGETLB)) < 0)
+		return -1;
+	if (ftruncate(mem_fd, size) < 0 || (p = mmap(NULL, size, PROT_READ|PROT_WRITE,
+			MAP_SHARED|MAP_LOCKED|MAP_POPULATE, mem_fd, 0)) == MAP_FAILED) {
+		close(mem_fd);
+		mem_fd = -1;
+		return -1;
+	}
+	virtbase = p;
+	mem_size = size;
+	return 0;
+}
+
+static int mem_alloc_pages(void) {
+	void *p;
+
+	mem_size = (mem_size + sys_page_size - 1) & ~(sys_page_size - 1);
+	if ((mem_fd = memfd_create("psk31", MFD_CLOEXEC)) < 0)
+		return -1;
+	if (ftruncate(mem_fd, mem_size) < 0 || (p = mmap(NULL, mem_size, PROT_READ|PROT_WRITE,
+			MAP_SHARED|MAP_NORESERVE|MAP_LOCKED, mem_fd, 0)) == MAP_FAILED) {
+		close(mem_fd);
+		mem_fd = -1;
+		return -1;
+	}
+	virtbase = p;
+	return 0;
+}
+
+// Get the memory for CBs and samples, the most contiguous kind available
+static void mem_alloc(void) {
+	sys_page_size = sysconf(_SC_PAGESIZE);
+	if (sys_page_size < PAGE_SIZE || (sys_page_size & (sys_page_size - 1)))
+		fatal("psk31: Unsupported page size %ld\n", sys_page_size);
+	mem_size = (size_t)num_pages * PAGE_SIZE;
+	if ((mem_kind == MEM_AUTO || mem_kind == MEM_MBOX) && mem_alloc_mbox() == 0)
+		mem_kind = MEM_MBOX;
+	else if ((mem_kind == MEM_AUTO || mem_kind == MEM_HUGE) && mem_alloc_huge() == 0)
+		mem_kind = MEM_HUGE;
+	else if ((mem_kind == MEM_AUTO || mem_kind == MEM_PAGES) && mem_alloc_pages() == 0)
+		mem_kind = MEM_PAGES;
+	else
+		fatal("psk31: Failed to allocate %s DMA memory: %m\n", mem_names[mem_kind]);
+	if ((unsigned long)virtbase & (PAGE_SIZE-1))
+		fatal("psk31: Virtual address is not page aligned\n");
+}
+
+// Initialize the memory pagemap, all of it with a single read
 static void make_pagemap(void) {
-	int i, fd, memfd, pid;
-	char pagemap_fn[64];
+	int i, fd, n_sys, per_sys;
+	uint64_t *pfn;
+	uint64_t phys;
+	off_t offset;
+	ssize_t len;
 
-	page_map = malloc(NUM_PAGES * sizeof(*page_map));
+	page_map = malloc(num_pages * sizeof(*page_map));
 	if (page_map == 0)
-		fatal("rpio-pwm: Failed to malloc page_map: %m\n");
-	memfd = open("/dev/mem", O_RDWR);
-	if (memfd < 0)
-		fatal("rpio-pwm: Failed to open /dev/mem: %m\n");
-	pid = getpid();
-	sprintf(pagemap_fn, "/proc/%d/pagemap", pid);
-	fd = open(pagemap_fn, O_RDONLY);
-	if (fd < 0)
-		fatal("rpio-pwm: Failed to open %s: %m\n", pagemap_fn);
-	if (lseek(fd, (uint32_t)virtbase >> 9, SEEK_SET) != (uint32_t)virtbase >> 9)
-		fatal("rpio-pwm: Failed to seek on %s: %m\n", pagemap_fn);
-	for (i = 0; i < NUM_PAGES; i++) {
-		uint64_t pfn;
-		page_map[i].virtaddr = virtbase + i * PAGE_SIZE;
-		// Following line forces page to be allocated
-		page_map[i].virtaddr[0] = 0;
-		if (read(fd, &pfn, sizeof(pfn)) != sizeof(pfn))
-			fatal("rpio-pwm: Failed to read %s: %m\n", pagemap_fn);
-		if (((pfn >> 55) & 0x1bf) != 0x10c)
-			fatal("rpio-pwm: Page %d not present (pfn 0x%016llx)\n", i, pfn);
-		page_map[i].physaddr = (uint32_t)pfn << PAGE_SHIFT | 0x40000000;
+		fatal("psk31: Failed to malloc page_map: %m\n");
+	if (mem_kind == MEM_MBOX) {
+		for (i = 0; i < num_pages; i++) {
+			page_map[i].virtaddr = virtbase + i * PAGE_SIZE;
+			page_map[i].physaddr = mem_phys_base + i * PAGE_SIZE;
+		}
+		return;
 	}
+	per_sys = sys_page_size / PAGE_SIZE;
+	n_sys = (num_pages + per_sys - 1) / per_sys;
+	// Following loop forces the pages to be allocated
+	for (i = 0; i < n_sys; i++)
+		virtbase[i * sys_page_size] = 0;
+	if ((fd = open("/proc/self/pagemap", O_RDONLY)) < 0)
+		fatal("psk31: Failed to open /proc/self/pagemap: %m\n");
+	if (!(pfn = malloc(n_sys * sizeof(*pfn))))
+		fatal("psk31: Failed to malloc pfn: %m\n");
+	len = n_sys * sizeof(*pfn);
+	offset = (off_t)((uintptr_t)virtbase / sys_page_size) * sizeof(*pfn);
+	if (pread(fd, pfn, len, offset) != len)
+		fatal("psk31: Failed to read /proc/self/pagemap: %m\n");
 	close(fd);
-	close(memfd);
+	for (i = 0; i < num_pages; i++) {
+		uint64_t e = pfn[i / per_sys];
+
+		/* Present, not swapped, and a PFN we are allowed to see */
+		if (!(e >> 63) || ((e >> 62) & 1) || !(e & ((1ULL << 55) - 1)))
+			fatal("psk31: Page %d not present (pfn 0x%016llx)\n", i, (unsigned long long)e);
+		phys = (e & ((1ULL << 55) - 1)) * sys_page_size + (i % per_sys) * PAGE_SIZE;
+		page_map[i].virtaddr = virtbase + i * PAGE_SIZE;
+		page_map[i].physaddr = (uint32_t)phys | 0x40000000;
+	}
+	free(pfn);
 }
 
 static int make_physinfo_cmp(const void *v1, const void *v2) {
@@ -832,18 +1116,66 @@ static int make_physinfo_cmp(const void *v1, const void *v2) {
 	return 0;
 }
 
+static uint32_t phys_hash(uint32_t phys) {
+	return ((phys >> PAGE_SHIFT) * 0x9e3779b1u) >> (32 - phys_index_bits);
+}
+
 static void make_physinfo(void) {
-	if (!(phys_info = (typeof(phys_info))malloc(NUM_PAGES_CBS * sizeof(*phys_info))))
+	uint32_t h;
+	int i;
+
+	/* Contiguous memory needs no table, offsets translate by addition */
+	for (i = 1; i < num_pages; i++)
+		if (page_map[i].physaddr != page_map[0].physaddr + i * PAGE_SIZE)
+			break;
+	if (i == num_pages) {
+		mem_contiguous = 1;
+		mem_phys_base = page_map[0].physaddr;
+		phys_info = page_map;
+		return;
+	}
+	if (!(phys_info = (typeof(phys_info))malloc(num_pages_cbs * sizeof(*phys_info))))
 		fatal("rpio-pwm: Failed to malloc phys_info: %m\n");
-	memcpy(phys_info, page_map, NUM_PAGES_CBS * sizeof(*phys_info));
-	qsort(phys_info, NUM_PAGES_CBS, sizeof(*phys_info), make_physinfo_cmp);
+	memcpy(phys_info, page_map, num_pages_cbs * sizeof(*phys_info));
+	qsort(phys_info, num_pages_cbs, sizeof(*phys_info), make_physinfo_cmp);
+
+	/* At most half full, so the probes stay short */
+	for (phys_index_bits = 1; (1 << phys_index_bits) < 2 * num_pages_cbs; phys_index_bits++)
+		;
+	if (!(phys_index = malloc(sizeof(*phys_index) << phys_index_bits)))
+		fatal("psk31: Failed to malloc phys_index: %m\n");
+	memset(phys_index, 0xff, sizeof(*phys_index) << phys_index_bits);
+	for (i = 0; i < num_pages_cbs; i++) {
+		h = phys_hash(phys_info[i].physaddr);
+		while (phys_index[h] >= 0)
+			h = (h + 1) & ((1 << phys_index_bits) - 1);
+		phys_index[h] = i;
+	}
 }
 
 static uint32_t cb_offset_to_phys(uint32_t cb_offset) {
+	if (mem_contiguous)
+		return mem_phys_base + cb_offset;
 	return phys_info[cb_offset >> PAGE_SHIFT].physaddr + (cb_offset % PAGE_SIZE);
 }
 
+// Scattered pages are looked up in the hash, in constant time
+static uint32_t cb_phys_to_offset(uint32_t phys) {
+	uint32_t page = phys & ~(PAGE_SIZE - 1);
+	uint32_t h;
+
+	if (mem_contiguous)
+		return phys - mem_phys_base;
+	for (h = phys_hash(page); phys_index[h] >= 0; h = (h + 1) & ((1 << phys_index_bits) - 1))
+		if (phys_info[phys_index[h]].physaddr == page)
+			return (phys_index[h] << PAGE_SHIFT) + (phys % PAGE_SIZE);
+	fatal("psk31: DMA at 0x%08x, outside its memory\n", phys);
+	return 0;
+}
+
 static void *cb_offset_to_virt(uint32_t cb_offset) {
+	if (mem_contiguous)
+		return virtbase + cb_offset;
 	return phys_info[cb_offset >> PAGE_SHIFT].virtaddr + (cb_offset % PAGE_SIZE);
 }
 
@@ -851,34 +1183,107 @@ static void *cb_offset_to_virt(uint32_t cb_offset) {
 #define LEVEL_MAX (0.5 + option_amplitude / 2)
 #define LEVEL_MED (0.5)
 
-static double sym_l_fn(double t) {
-	return LEVEL_MIN;
+// PA predistortion, applied to the signed amplitude around the mid level
+static double level_predistort(double v) {
+	if (!pd_active)
+		return v;
+	return LEVEL_MED + predistort(&pd, (v - LEVEL_MED) * 2) / 2;
 }
 
-static double sym_h_fn(double t) {
-	return LEVEL_MAX;
-}
+typedef struct {
+	double level[BS_SAMPLES + 1];   /* Target level at each sample boundary */
+	uint8_t up[BS_SAMPLES];         /* Sigma-delta output for each sample */
+	int cb_count;                   /* CBs in a burst of this symbol */
+	uint16_t cb_sample[BS_SAMPLES * 3];     /* Sample each CB belongs to */
+	uint16_t cb_entry[BS_SAMPLES];          /* First CB of each sample */
+	float out[BS_SAMPLES];                  /* Filter output, as baseband [-1, 1] */
+	uint32_t *fifo;                 /* Serializer: FIFO words of both channels */
+	uint32_t data_offset;           /* Serializer: where they are in DMA memory */
+} sd_t;
+
+static sd_t sym_def[SYM_COUNT];
+static shape_t shape;
+
+// Level tables of all the symbols, from the transition shape
+static void init_sym_def(void) {
+	double rise;
+	int i;
 
-static double sym_lh_fn(double t) {
-	return LEVEL_MED - cos(pi * t) * (LEVEL_MAX - LEVEL_MED);
+	if (!shape.rise && shape_init(&shape, option_shape, BS_SAMPLES) < 0)
+		fatal("psk31: Invalid shape %s: %m\n", option_shape);
+	for (i = 0; i <= BS_SAMPLES; i++) {
+		rise = shape.rise[i];
+		sym_def[SYM_L].level[i] = level_predistort(LEVEL_MIN);
+		sym_def[SYM_H].level[i] = level_predistort(LEVEL_MAX);
+		sym_def[SYM_LH].level[i] = level_predistort(LEVEL_MIN + rise * (LEVEL_MAX - LEVEL_MIN));
+		sym_def[SYM_HL].level[i] = level_predistort(LEVEL_MAX - rise * (LEVEL_MAX - LEVEL_MIN));
+	}
 }
 
-static double sym_hl_fn(double t) {
-	return LEVEL_MED + cos(pi * t) * (LEVEL_MAX - LEVEL_MED);
+/*
+ * The serializer shifts out option_serial bits per sample, a FIFO word a
+ * channel at a time. A burst takes one CB per page of FIFO words, and can be
+ * entered at the start of any sample of a page by moving the source of its CB.
+ */
+#define SERIAL_WORDS         (BS_SAMPLES * option_serial / 16)
+#define SERIAL_SAMPLE_BYTES  (option_serial / 4)
+#define SERIAL_PAGE_SAMPLES  (PAGE_SIZE / SERIAL_SAMPLE_BYTES)
+
+static void init_sym_serial(sd_t *sd) {
+	double error, decay, v;
+	float out[BS_SAMPLES];
+	int i;
+
+	if (!sd->fifo && !(sd->fifo = malloc(SERIAL_WORDS * sizeof(*sd->fifo))))
+		fatal("psk31: Failed to malloc FIFO words: %m\n");
+	decay = sdmodel_decay((double)PULSE_WIDTH_INCR_US / option_serial, option_rc);
+	error = sdmodel_serial(sd->level, BS_SAMPLES, option_serial, decay, sd->fifo);
+	if (error > level_error_max)
+		level_error_max = error;
+	/* What goes on air is what the serializer makes of the words */
+	v = sd->level[0];
+	sdmodel_serializer(sd->fifo, SERIAL_WORDS, option_serial, decay, &v, out);
+	sd->cb_count = (BS_SAMPLES + SERIAL_PAGE_SAMPLES - 1) / SERIAL_PAGE_SAMPLES;
+	for (i = 0; i < BS_SAMPLES; i++) {
+		sd->out[i] = 2 * out[i] - 1;
+		sd->cb_entry[i] = i / SERIAL_PAGE_SAMPLES;
+	}
+	for (i = 0; i < sd->cb_count; i++)
+		sd->cb_sample[i] = i * SERIAL_PAGE_SAMPLES;
 }
 
-typedef struct {
-	double (*sd_fn)(double t);
-} sd_t;
+// Track the level table through the RC filter. The result is the same for
+// every burst of the symbol, so it is computed once.
+static void init_sym_model(sd_t *sd) {
+	double error, decay, v;
+	int i;
 
-static const sd_t sym_def[SYM_COUNT] = {
-	[SYM_L] = {.sd_fn = sym_l_fn},
-	[SYM_H] = {.sd_fn = sym_h_fn},
-	[SYM_LH] = {.sd_fn = sym_lh_fn},
-	[SYM_HL] = {.sd_fn = sym_hl_fn},
-};
+	if (option_serial) {
+		init_sym_serial(sd);
+		return;
+	}
+	decay = sdmodel_decay(PULSE_WIDTH_INCR_US, option_rc);
+	error = sdmodel_symbol(sd->level, BS_SAMPLES, decay, sd->up);
+	if (error > level_error_max)
+		level_error_max = error;
+	sd->cb_count = 0;
+	v = sd->level[0];
+	for (i = 0; i < BS_SAMPLES; i++) {
+		v = v * decay + (sd->up[i] ? 1.0 - decay : 0);
+		sd->out[i] = 2 * v - 1;
+		/* Pads on every change, and a delay */
+		sd->cb_entry[i] = sd->cb_count;
+		if (i == 0 || sd->up[i - 1] != sd->up[i]) {
+			sd->cb_sample[sd->cb_count++] = i;
+			sd->cb_sample[sd->cb_count++] = i;
+		}
+		sd->cb_sample[sd->cb_count++] = i;
+	}
+}
 
-static uint32_t init_bs(bs_info_t *bs, const sd_t *sd, uint32_t cb_offset, uint32_t phys_sample_pos, uint32_t phys_sample_neg) {
+// Write the CBs of a burst from the symbol model
+static uint32_t init_bs(bs_info_t *bs, const sd_t *sd, uint32_t cb_offset, int delay_hw,
+		uint32_t phys_sample_pos, uint32_t phys_sample_neg) {
 	dma_cb_t *cbp;
 	uint32_t cb_phys;
 	int i;
@@ -886,13 +1291,7 @@ static uint32_t init_bs(bs_info_t *bs, const sd_t *sd, uint32_t cb_offset, uint3
 	uint32_t phys_fifo_addr;
 	uint32_t phys_gpclr0 = 0x7e200000 + 0x28;
 	uint32_t phys_gpset0 = 0x7e200000 + 0x1c;
-	double v_old, v_new, v, v_error;
 	int up, up_old;
-	double mean_decay;
-	double mean_weight;
-
-	mean_decay = exp(-((double)PULSE_WIDTH_INCR_US) / (1000000.0 * option_rc));
-	mean_weight = 1.0 - mean_decay;
 
 	if (delay_hw == DELAY_VIA_PWM) {
 		cbp_info = DMA_NO_WIDE_BURSTS | DMA_WAIT_RESP | DMA_D_DREQ | DMA_PER_MAP(5);
@@ -904,8 +1303,8 @@ static uint32_t init_bs(bs_info_t *bs, const sd_t *sd, uint32_t cb_offset, uint3
 
 	cb_phys = cb_offset_to_phys(cb_offset);
 	bs->physaddr = cb_phys;
+	bs->cb_offset = cb_offset;
 	cbp = NULL;
-	v_old = sd->sd_fn(0);
 	up_old = 0; /* To avoid warnings */
 	for (i = 0; i < BS_SAMPLES; i++) {
 		/* Get new cb physical address */
@@ -913,16 +1312,7 @@ static uint32_t init_bs(bs_info_t *bs, const sd_t *sd, uint32_t cb_offset, uint3
 		/* Link previous cb to new cb */
 		if (cbp)
 			cbp->next = cb_phys;
-		/* Get new target value */
-		v = sd->sd_fn((i + 1) / (double)BS_SAMPLES);
-		up = (v > v_old);
-		v_new = v_old * mean_decay;
-		if (up)
-			v_new += mean_weight;
-		/* Compute error statistics */
-		v_error = fabs(v - v_new);
-		if (v_error > level_error_max)
-			level_error_max = v_error;
+		up = sd->up[i];
 		/* Write cb */
 		if (i == 0 || up_old != up) {
 			/* Positive pad */
@@ -956,75 +1346,736 @@ static uint32_t init_bs(bs_info_t *bs, const sd_t *sd, uint32_t cb_offset, uint3
 		cb_offset += 32;
 
 		up_old = up;
-		v_old = v_new;
 	}
 	bs->cb_last = cbp;
 	return cb_offset;
 }
 
-static void init_ctrl_data(void) {
-	struct ctl *ctl;
-	int ts;
-	uint32_t cb_offset;
-	void *cb_virt;
-	ts_info_t *ti;
-	uint32_t phys_sample_pos;
-	uint32_t phys_sample_neg;
+// Write the CBs of a burst for the serializer, a page of FIFO words each
+static uint32_t init_bs_serial(bs_info_t *bs, const sd_t *sd, uint32_t cb_offset) {
+	uint8_t *fifo = virtbase + sd->data_offset;
+	uint32_t bytes = SERIAL_WORDS * sizeof(uint32_t);
+	dma_cb_t *cbp = NULL;
+	int i;
+
+	bs->physaddr = cb_offset_to_phys(cb_offset);
+	bs->cb_offset = cb_offset;
+	for (i = 0; i < sd->cb_count; i++) {
+		if (cbp)
+			cbp->next = cb_offset_to_phys(cb_offset);
+		cbp = (dma_cb_t *)cb_offset_to_virt(cb_offset);
+		cbp->info = DMA_NO_WIDE_BURSTS | DMA_WAIT_RESP | DMA_D_DREQ | DMA_PER_MAP(5) | DMA_SRC_INC;
+		cbp->src = mem_virt_to_phys(fifo + i * PAGE_SIZE);
+		cbp->dst = (PWM_BASE | 0x7e000000) + 0x18;
+		cbp->length = bytes - i * PAGE_SIZE < PAGE_SIZE ? bytes - i * PAGE_SIZE : PAGE_SIZE;
+		cbp->stride = 0;
+		cb_offset += sizeof(dma_cb_t);
+	}
+	bs->cb_last = cbp;
+	return cb_offset;
+}
+
+/* Bursts of a TS are laid out back to back, every TS takes the same space */
+static uint32_t ts_stride;
+
+// Model the symbols, which also gives the exact amount of DMA memory needed
+static void init_waveforms(void) {
 	int s;
 
-	/* Generate waveforms */
+	/* Polar mode has one ring of CBs instead of the symbols */
+	if (option_polar) {
+		num_pages_cbs = POLAR_RING * POLAR_CBS * sizeof(dma_cb_t) >> PAGE_SHIFT;
+		num_pages = num_pages_cbs + 1;
+		return;
+	}
 	level_error_max = 0;
-	ctl = (struct ctl *)virtbase;
-	memset(ctl, 0, sizeof(*ctl));
-	ctl->samples[0] = (1 << GPIO_POS_NUM);
-	ctl->samples[1] = (1 << GPIO_NEG_NUM);
-	phys_sample_pos = mem_virt_to_phys(&ctl->samples[0]);
-	phys_sample_neg = mem_virt_to_phys(&ctl->samples[1]);
-	ti = ts_info;
-	cb_offset = 0;
-	for (ti = ts_info, ts = 0; ts < TS_COUNT; ti++, ts++) {
-		ti->physaddr = cb_offset_to_phys(cb_offset);
-		for (s = 0; s < SYM_COUNT; s++)
-			cb_offset = init_bs(&ti->bs[s], &sym_def[s], cb_offset, phys_sample_pos, phys_sample_neg);
-	}
-	/* Free unused memory */
-	cb_offset = (cb_offset + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
-	while (cb_offset < sizeof(ctl->cb_pages)) {
-		cb_virt = cb_offset_to_virt(cb_offset);
-		if (munmap(cb_virt, PAGE_SIZE) != 0)
-			fatal("psk31: munmap failed: %m\n");
-		cb_offset += PAGE_SIZE;
-	}
-}
-
-// Initialize PWM (or PCM) and DMA
-static void init_hardware(void) {
-	int i;
-	uint32_t phys;
+	init_sym_def();
+	ts_stride = 0;
+	for (s = 0; s < SYM_COUNT; s++) {
+		init_sym_model(&sym_def[s]);
+		ts_stride += sym_def[s].cb_count * sizeof(dma_cb_t);
+	}
+	if (option_ptt)
+		ts_stride += PTT_CBS * sizeof(dma_cb_t);
+	cb_region_size = (ts_stride * ts_count + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+	num_pages_cbs = tx_count * (cb_region_size >> PAGE_SHIFT);
+	num_pages = num_pages_cbs + 1;
+	/* The FIFO words of the serializer follow the samples, shared by all TSs */
+	if (option_serial)
+		for (s = 0; s < SYM_COUNT; s++) {
+			sym_def[s].data_offset = num_pages * PAGE_SIZE;
+			num_pages += (SERIAL_WORDS * sizeof(uint32_t) + PAGE_SIZE - 1) >> PAGE_SHIFT;
+		}
+}
 
-	/* Setup idle burst */
-	ts_last_cbp = NULL;
-	for (i = 0; i < TS_COUNT; i++)
-		tx_sym_enqueue(SYM_H);
-	phys = ts_info[0].bs[SYM_H].physaddr;
+/*
+ * Generate again what a transmitter sent, from its log and with the settings
+ * it was sent with. The text and the events go to stderr, the output of the
+ * RC filter at every sample to stdout, as 32 bit floats.
+ */
+static int replay(const char *path) {
+	txlog_reader_t r;
+	txlog_rec_t rec;
+	float out[BS_SAMPLES];
+	double decay, weight, v;
+	const sd_t *sd;
+	unsigned symbols, lost;
+	int i, n;
+
+	if (txlog_reader_open(&r, path) < 0) {
+		fprintf(stderr, "psk31: Failed to open %s: %m\n", path);
+		return 1;
+	}
+	if (r.hdr.samples != BS_SAMPLES || r.hdr.sample_us != PULSE_WIDTH_INCR_US) {
+		fprintf(stderr, "psk31: %s has symbols of %u samples of %uus\n", path, r.hdr.samples, r.hdr.sample_us);
+		return 1;
+	}
+	option_amplitude = r.hdr.amplitude;
+	option_rc = r.hdr.rc;
+	option_shape = r.hdr.shape;
+	option_serial = r.hdr.serial;
+	option_ptt = 1;         /* Room for the switching, for ptt_check() */
+	if (r.hdr.predistort[0]) {
+		if (predistort_load(&pd, r.hdr.predistort) < 0) {
+			fprintf(stderr, "psk31: Failed to load %s: %m\n", r.hdr.predistort);
+			return 1;
+		}
+		pd_active = 1;
+	}
+	init_waveforms();
+	fprintf(stderr, "Transmitter:          %s\n", r.hdr.name[0] ? r.hdr.name : "default");
+	fprintf(stderr, "RC:                   %fs\n", option_rc);
+	fprintf(stderr, "Amplitude:            %f\n", option_amplitude);
+	fprintf(stderr, "Shape:                %s\n", option_shape);
+	fprintf(stderr, "Frequency:            %f, div %u, mash %u\n", r.hdr.frequency, r.hdr.div, r.hdr.mash);
+	if (option_serial)
+		fprintf(stderr, "Serializer:           %d bits per sample\n", option_serial);
+
+	decay = sdmodel_decay((double)PULSE_WIDTH_INCR_US / (option_serial ? option_serial : 1), option_rc);
+	weight = 1.0 - decay;
+	v = LEVEL_MED;
+	symbols = lost = 0;
+	while (txlog_read(&r, &rec) > 0) {
+		switch (rec.type) {
+			case TXLOG_SYM:
+				if (rec.a >= SYM_COUNT || rec.b >= BS_SAMPLES)
+					break;
+				sd = &sym_def[rec.a];
+				/* The serializer from the words the DMA was given */
+				if (option_serial) {
+					i = rec.b * option_serial / 16;
+					n = sdmodel_serializer(sd->fifo + i, SERIAL_WORDS - i, option_serial, decay, &v, out);
+					fwrite(out, sizeof(*out), n, stdout);
+					symbols++;
+					break;
+				}
+				for (i = rec.b, n = 0; i < BS_SAMPLES; i++) {
+					v = v * decay + (sd->up[i] ? weight : 0);
+					out[n++] = v;
+				}
+				fwrite(out, sizeof(*out), n, stdout);
+				symbols++;
+				break;
+			case TXLOG_STATE:
+				fprintf(stderr, "%10.3fs %s\n", rec.sample * PULSE_WIDTH_INCR_US / 1e6,
+					rec.a < ARRAY_SIZE(state_names) ? state_names[rec.a] : "?");
+				break;
+			case TXLOG_CHAR:
+				fprintf(stderr, "%10.3fs %u: %c\n", rec.sample * PULSE_WIDTH_INCR_US / 1e6,
+					rec.b, rec.a >= ' ' && rec.a < 127 ? rec.a : '.');
+				break;
+			case TXLOG_CLOCK:
+				fprintf(stderr, "%10.3fs clock div %u\n", rec.sample * PULSE_WIDTH_INCR_US / 1e6, rec.b);
+				break;
+			case TXLOG_LOST:
+				lost += rec.b;
+				break;
+		}
+	}
+	txlog_reader_close(&r);
+	fprintf(stderr, "Symbols:              %u, %u records lost\n", symbols, lost);
+	return 0;
+}
 
-	if (delay_hw == DELAY_VIA_PWM) {
+static uint32_t init_ts(tx_t *tx, int ts) {
+	ts_info_t *ti = &tx->ts_info[ts];
+	uint32_t cb_offset = tx->cb_base + ts * ts_stride;
+	uint32_t *sample = &samples[2 * (tx - tx_list)];
+	int s;
+
+	ti->physaddr = cb_offset_to_phys(cb_offset);
+	for (s = 0; s < SYM_COUNT; s++)
+		if (option_serial)
+			cb_offset = init_bs_serial(&ti->bs[s], &sym_def[s], cb_offset);
+		else
+			cb_offset = init_bs(&ti->bs[s], &sym_def[s], cb_offset, tx->delay_hw,
+			mem_virt_to_phys(&sample[0]), mem_virt_to_phys(&sample[1]));
+	ti->ptt_offset = cb_offset;
+	if (option_ptt)
+		cb_offset += PTT_CBS * sizeof(dma_cb_t);
+	return cb_offset;
+}
+
+/*
+ * Polar mode: every sample takes four CBs, writing the clock divisor, the
+ * GPIO set and the GPIO clear, and waiting for the pacing. The CBs go round
+ * in a ring and are never changed, the words they write are kept in their
+ * own padding and are what the feeder fills in ahead of the DMA.
+ */
+static dma_cb_t *polar_cbs(tx_t *tx, uint64_t sample) {
+	return (dma_cb_t *)cb_offset_to_virt(tx->cb_base +
+		(sample & (POLAR_RING - 1)) * POLAR_CBS * sizeof(dma_cb_t));
+}
+
+static void polar_write(tx_t *tx, uint64_t sample, const uint32_t *div, const uint8_t *up, unsigned n) {
+	uint32_t *mask = &samples[2 * (tx - tx_list)];
+	dma_cb_t *cbp;
+	unsigned k;
+
+	for (k = 0; k < n; k++) {
+		cbp = polar_cbs(tx, sample + k);
+		cbp[0].pad_1 = 0x5a000000 | div[k];
+		cbp[1].pad_1 = mask[!up[k]];
+		cbp[2].pad_1 = mask[!!up[k]];
+	}
+}
+
+// Silence, the carrier on its frequency and the envelope at zero
+static void polar_silence(tx_t *tx, uint64_t sample, unsigned n) {
+	static const float zero[2 * POLAR_BLOCK];
+	uint32_t div[POLAR_BLOCK];
+	uint8_t up[POLAR_BLOCK];
+	unsigned k;
+
+	for (; n; n -= k, sample += k) {
+		k = n < POLAR_BLOCK ? n : POLAR_BLOCK;
+		polar_run(&tx->polar, zero, k, div, up);
+		polar_write(tx, sample, div, up, k);
+	}
+}
+
+static void init_polar(tx_t *tx) {
+	uint32_t phys_gpclk_div = 0x7e101000 + (CM_GP0DIV + 2 * tx->gpclk) * 4;
+	uint32_t phys_gpclr0 = 0x7e200000 + 0x28;
+	uint32_t phys_gpset0 = 0x7e200000 + 0x1c;
+	uint32_t cb_offset, cbp_info, phys_fifo_addr;
+	dma_cb_t *cbp;
+	int i;
+
+	if (!tx->clock_cb.c_div)
+		fatal("psk31: --polar needs a carrier\n");
+	if (tx->delay_hw == DELAY_VIA_PWM) {
+		cbp_info = DMA_NO_WIDE_BURSTS | DMA_WAIT_RESP | DMA_D_DREQ | DMA_PER_MAP(5);
+		phys_fifo_addr = (PWM_BASE | 0x7e000000) + 0x18;
+	} else {
+		cbp_info = DMA_NO_WIDE_BURSTS | DMA_WAIT_RESP | DMA_D_DREQ | DMA_PER_MAP(2);
+		phys_fifo_addr = (PCM_BASE | 0x7e000000) + 0x04;
+	}
+	for (i = 0; i < POLAR_RING * POLAR_CBS; i++) {
+		cb_offset = tx->cb_base + i * sizeof(dma_cb_t);
+		cbp = (dma_cb_t *)cb_offset_to_virt(cb_offset);
+		cbp->info = DMA_NO_WIDE_BURSTS | DMA_WAIT_RESP;
+		cbp->src = cb_offset_to_phys(cb_offset + offsetof(dma_cb_t, pad_1));
+		cbp->length = 4;
+		cbp->stride = 0;
+		switch (i % POLAR_CBS) {
+			case 0:
+				cbp->dst = phys_gpclk_div;
+				break;
+			case 1:
+				cbp->dst = phys_gpset0;
+				break;
+			case 2:
+				cbp->dst = phys_gpclr0;
+				break;
+			case 3:
+				/* Only paces, but writes a defined word */
+				cbp->info = cbp_info;
+				cbp->dst = phys_fifo_addr;
+				cbp->pad_1 = 0;
+				break;
+		}
+		cbp->next = cb_offset_to_phys(tx->cb_base + (i + 1) % (POLAR_RING * POLAR_CBS) * sizeof(dma_cb_t));
+	}
+	polar_init(&tx->polar, tx->div ? tx->div : 500.0 * 4096 / tx->frequency, 1e6 / PULSE_WIDTH_INCR_US,
+		sdmodel_decay(PULSE_WIDTH_INCR_US, option_rc), option_amplitude, pd_active ? &pd : NULL);
+	polar_silence(tx, 0, POLAR_RING);
+}
+
+typedef struct {
+	pthread_t thread;
+	int first;              /* Range of TSs, over all transmitters */
+	int end;
+} ctrl_job_t;
+
+static void *init_ctrl_job(void *arg) {
+	ctrl_job_t *job = (ctrl_job_t *)arg;
+	int i;
+
+	for (i = job->first; i < job->end; i++)
+		init_ts(&tx_list[i / ts_count], i % ts_count);
+	return NULL;
+}
+
+static void init_ctrl_data(void) {
+	ctrl_job_t job[64];
+	int threads, total;
+	int i;
+
+	memset(virtbase, 0, (size_t)num_pages * PAGE_SIZE);
+	samples = (uint32_t *)(virtbase + num_pages_cbs * PAGE_SIZE);
+	for (i = 0; i < tx_count; i++) {
+		tx_list[i].cb_base = i * cb_region_size;
+		if (!(tx_list[i].ts_info = calloc(ts_count, sizeof(ts_info_t))))
+			fatal("psk31: Failed to malloc ts_info: %m\n");
+		samples[2 * i] = 1 << tx_list[i].gpio_pos;
+		samples[2 * i + 1] = 1 << tx_list[i].gpio_neg;
+	}
+	if (option_serial)
+		for (i = 0; i < SYM_COUNT; i++)
+			memcpy(virtbase + sym_def[i].data_offset, sym_def[i].fifo, SERIAL_WORDS * sizeof(uint32_t));
+	if (option_polar) {
+		init_polar(tx_list);
+		ctrl_threads = 1;
+		return;
+	}
+
+	/* TS start offsets are known, so the TSs can be written in parallel */
+	total = tx_count * ts_count;
+	threads = option_threads > 0 ? option_threads : sysconf(_SC_NPROCESSORS_ONLN);
+	if (threads < 1)
+		threads = 1;
+	if (threads > (int)ARRAY_SIZE(job))
+		threads = ARRAY_SIZE(job);
+	if (threads > total)
+		threads = total;
+	for (i = 0; i < threads; i++) {
+		job[i].first = total * i / threads;
+		job[i].end = total * (i + 1) / threads;
+		if (i == 0 || pthread_create(&job[i].thread, NULL, init_ctrl_job, &job[i]) != 0)
+			job[i].thread = 0;
+	}
+	/* The first share, and any that did not get a thread, are done here */
+	for (i = 0; i < threads; i++)
+		if (!job[i].thread)
+			init_ctrl_job(&job[i]);
+	for (i = 1; i < threads; i++)
+		if (job[i].thread)
+			pthread_join(job[i].thread, NULL);
+	ctrl_threads = threads;
+}
+
+// TS a CB address is in, the TSs are back to back in CB offset space
+static int tx_sym_slot(tx_t *tx, uint32_t phys) {
+	return (cb_phys_to_offset(phys) - tx->cb_base) / ts_stride;
+}
+
+static int tx_sym_pending(tx_t *tx) {
+	uint32_t phys;
+
+	/* Retrieve current TS */
+	phys = tx->dma_reg[DMA_CONBLK_AD];
+	if (phys == 0)
+		fatal("rpio-pwm: DMA stopped\n");
+	return (tx->ts_last - tx_sym_slot(tx, phys)) & (ts_count - 1);
+}
+
+// The DMA is on the last symbol queued, or has run off its end
+static int tx_drained(tx_t *tx) {
+	uint32_t phys = tx->dma_reg[DMA_CONBLK_AD];
+
+	return phys == 0 || tx_sym_slot(tx, phys) == tx->ts_last;
+}
+
+// Time until the next scheduled message has to be queued, INT64_MAX for none
+static int64_t tx_sched_wait_ns(tx_t *tx) {
+	msg_t *msg = msgq_scheduled(&tx->queue);
+	struct timespec ts;
+	int64_t lead;
+
+	if (!msg)
+		return INT64_MAX;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	/* A queue depth, and the PTT lead, ahead of its start */
+	lead = ptt_lead[PTT_PA] > ptt_lead[PTT_RF] ? ptt_lead[PTT_PA] : ptt_lead[PTT_RF];
+	lead = (lead + (int64_t)(tx->depth + 1) * BS_SAMPLES) * PULSE_WIDTH_INCR_US * 1000;
+	return (int64_t)(msg->start_ns - (ts.tv_sec * 1000000000ULL + ts.tv_nsec)) - lead;
+}
+
+// Modelled output of a symbol to the I/Q tap, on I. What does not fit is dropped.
+static void iq_tap(tx_t *tx, int s, int skip) {
+	const float *out = &sym_def[s].out[skip];
+	uint32_t n = BS_SAMPLES - skip;
+	uint32_t i, k;
+	float *p;
+
+	if (!tx->iq.hdr)
+		return;
+	while (n) {
+		if (!(k = iqring_writable(&tx->iq, (void **)&p))) {
+			__atomic_store_n(&tx->iq.hdr->overruns, tx->iq.hdr->overruns + n, __ATOMIC_RELAXED);
+			return;
+		}
+		if (k > n)
+			k = n;
+		for (i = 0; i < k; i++) {
+			p[2 * i] = out[i];
+			p[2 * i + 1] = 0;
+		}
+		iqring_commit(&tx->iq, k);
+		out += k;
+		n -= k;
+	}
+}
+
+// Switching to come, kept in order of the sample
+static void ptt_push(tx_t *tx, uint64_t sample, int what, uint32_t mask) {
+	int i;
+
+	if (tx->ptt_count == PTT_EVENTS)
+		fatal("psk31: Too much PTT switching queued\n");
+	for (i = tx->ptt_count++; i > 0 && tx->ptt[i - 1].sample > sample; i--)
+		tx->ptt[i] = tx->ptt[i - 1];
+	tx->ptt[i].sample = sample;
+	tx->ptt[i].mask = mask;
+	tx->ptt[i].what = what;
+}
+
+// A line on or off at a sample; the RF switch takes its complement along
+static void ptt_line(tx_t *tx, int line, int on, uint64_t sample) {
+	tx->ptt_on[line] = on;
+	if (ptt_gpio[line] >= 0)
+		ptt_push(tx, sample, PTT_WHAT(line, on, on), 1 << ptt_gpio[line]);
+	if (line == PTT_RF && ptt_gpio[PTT_RF2] >= 0)
+		ptt_push(tx, sample, PTT_WHAT(PTT_RF2, on, !on), 1 << ptt_gpio[PTT_RF2]);
+}
+
+/*
+ * Key up for a transmission starting at a sample, 0 for as soon as the lines
+ * can be up: switching off that has not happened yet is called off, and what
+ * is off comes on its lead earlier, or right away when that has passed.
+ * Returns the samples to the start.
+ */
+static int ptt_key_up(tx_t *tx, uint64_t start) {
+	int i, line, lead = 0;
+
+	if (!option_ptt || tx != tx_list)
+		return 0;
+	for (i = 0; i < tx->ptt_count; i++)
+		if (!(tx->ptt[i].what & 2)) {
+			tx->ptt_on[tx->ptt[i].what >> 2 == PTT_PA ? PTT_PA : PTT_RF] = 1;
+			memmove(&tx->ptt[i], &tx->ptt[i + 1], (--tx->ptt_count - i) * sizeof(tx->ptt[0]));
+			i--;
+		}
+	for (line = PTT_PA; line <= PTT_RF; line++)
+		if (!tx->ptt_on[line] && ptt_lead[line] > lead)
+			lead = ptt_lead[line];
+	if (!start)
+		start = tx->sample_next + (lead + BS_SAMPLES - 1) / BS_SAMPLES * BS_SAMPLES;
+	for (line = PTT_PA; line <= PTT_RF; line++)
+		if (!tx->ptt_on[line])
+			ptt_line(tx, line, 1, start > tx->sample_next + ptt_lead[line] ?
+				start - ptt_lead[line] : tx->sample_next);
+	return start - tx->sample_next;
+}
+
+// Key down after a transmission that ended at a sample
+static void ptt_key_down(tx_t *tx, uint64_t end) {
+	int line;
+
+	if (!option_ptt || tx != tx_list)
+		return;
+	for (line = PTT_PA; line <= PTT_RF; line++)
+		if (tx->ptt_on[line])
+			ptt_line(tx, line, 0, end + ptt_lag[line]);
+}
+
+/*
+ * The switching due in the symbol being queued goes into the chain: a CB of
+ * the slot writes the GPIO set or clear register, with the word in its own
+ * padding. It is linked in ahead of the first CB of the sample it is due at,
+ * by moving the next of the CB before, which is put back when the slot is
+ * used again. With the serializer it goes at the start of a page of FIFO
+ * words, the one before for switching on and the one after for switching
+ * off, so the lines are up for all of the carrier. Late switching goes at
+ * the entry of the symbol. Returns the entry.
+ */
+static uint32_t ptt_place(tx_t *tx, ts_info_t *ti, int s, int skip, uint32_t entry) {
+	const sd_t *sd = &sym_def[s];
+	const bs_info_t *bs = &ti->bs[s];
+	uint64_t end = tx->sample_next + BS_SAMPLES - skip;
+	uint32_t phys_gpclr0 = 0x7e200000 + 0x28;
+	uint32_t phys_gpset0 = 0x7e200000 + 0x1c;
+	uint32_t cb_offset;
+	dma_cb_t *cb, *before, *prev = NULL;
+	ptt_event_t *e;
+	int n, k, o, k_prev = -1;
+
+	for (n = 0; n < tx->ptt_count && n < PTT_CBS && tx->ptt[n].sample < end; n++) {
+		e = &tx->ptt[n];
+		o = e->sample > tx->sample_next ? e->sample - tx->sample_next + skip : skip;
+		if (!option_serial)
+			k = sd->cb_entry[o];
+		else if ((k = (o + (e->what & 2 ? 0 : SERIAL_PAGE_SAMPLES - 1)) / SERIAL_PAGE_SAMPLES) == sd->cb_count)
+			break;
+		cb_offset = ti->ptt_offset + n * sizeof(dma_cb_t);
+		cb = (dma_cb_t *)cb_offset_to_virt(cb_offset);
+		cb->info = DMA_NO_WIDE_BURSTS | DMA_WAIT_RESP;
+		cb->src = cb_offset_to_phys(cb_offset) + offsetof(dma_cb_t, pad_1);
+		cb->dst = e->what & 1 ? phys_gpset0 : phys_gpclr0;
+		cb->length = 4;
+		cb->stride = 0;
+		cb->pad_1 = e->mask;
+		cb->next = cb_offset_to_phys(bs->cb_offset + k * sizeof(dma_cb_t));
+		/* After the one before when they are due together */
+		if (k == k_prev) {
+			prev->next = cb_offset_to_phys(cb_offset);
+		} else if (k == sd->cb_entry[skip]) {
+			entry = cb_offset_to_phys(cb_offset);
+		} else {
+			before = (dma_cb_t *)cb_offset_to_virt(bs->cb_offset + (k - 1) * sizeof(dma_cb_t));
+			ti->ptt_patch[ti->ptt_patches] = before;
+			ti->ptt_next[ti->ptt_patches++] = before->next;
+			before->next = cb_offset_to_phys(cb_offset);
+		}
+		txlog_put(&tx->log, TXLOG_PTT, e->what, e->mask, e->sample);
+		if (e->sample > tx->ptt_last)
+			tx->ptt_last = e->sample;
+		prev = cb;
+		k_prev = k;
+	}
+	tx->ptt_count -= n;
+	memmove(tx->ptt, &tx->ptt[n], tx->ptt_count * sizeof(tx->ptt[0]));
+	return entry;
+}
+
+/*
+ * Queue a symbol. A steady symbol can be shortened by entering its burst
+ * skip samples late, which moves the start of everything after it. When the
+ * entry sample has no pads the GPIOs keep the level of the previous sample
+ * until the next change, which the RC filter hardly sees.
+ */
+static uint32_t tx_sym_enqueue(tx_t *tx, int s, int skip) {
+	ts_info_t *ti;
+	bs_info_t *bs;
+	uint32_t phys;
+
+#if 0
+{
+	static int sent = 0;
+	static const char s_char[][2] = {
+		[SYM_L] = {' ', '_'},
+		[SYM_H] = {'_', ' '},
+		[SYM_LH] = {' ', '/'},
+		[SYM_HL] = {' ', '\\'},
+	};
+	static char buf[2][51];
+
+	buf[0][sent] = s_char[s][0];
+	buf[1][sent] = s_char[s][1];
+	if (++sent == 50) {
+		buf[0][sent] = 0;
+		buf[1][sent] = 0;
+		sent = 0;
+		printf(" %s\n[%s]\n", buf[0], buf[1]);
+	}
+}
+#endif
+	if (!tx->ts_last_cbp)
+		tx->ts_last = 0;
+	else
+		tx->ts_last = (tx->ts_last + 1) & (ts_count - 1);
+	ti = &tx->ts_info[tx->ts_last];
+	bs = &ti->bs[s];
+	phys = bs->physaddr;
+	if (ti->entry_cb) {
+		ti->entry_cb->src = ti->entry_src;
+		ti->entry_cb->length = ti->entry_length;
+		ti->entry_cb = NULL;
+	}
+	while (ti->ptt_patches) {
+		ti->ptt_patches--;
+		ti->ptt_patch[ti->ptt_patches]->next = ti->ptt_next[ti->ptt_patches];
+	}
+	if (skip)
+		phys = cb_offset_to_phys(bs->cb_offset + sym_def[s].cb_entry[skip] * sizeof(dma_cb_t));
+	if (option_serial && skip % SERIAL_PAGE_SAMPLES) {
+		ti->entry_cb = (dma_cb_t *)cb_offset_to_virt(bs->cb_offset + sym_def[s].cb_entry[skip] * sizeof(dma_cb_t));
+		ti->entry_src = ti->entry_cb->src;
+		ti->entry_length = ti->entry_cb->length;
+		ti->entry_cb->src += skip % SERIAL_PAGE_SAMPLES * SERIAL_SAMPLE_BYTES;
+		ti->entry_cb->length -= skip % SERIAL_PAGE_SAMPLES * SERIAL_SAMPLE_BYTES;
+	}
+	if (tx->ptt_count)
+		phys = ptt_place(tx, ti, s, skip, phys);
+	out32(&bs->cb_last->next, 0);
+	if (tx->ts_last_cbp)
+		out32(&tx->ts_last_cbp->next, phys);
+	tx->ts_last_cbp = bs->cb_last;
+	tx->ts_last_sym = s;
+	txlog_put(&tx->log, TXLOG_SYM, s, skip, tx->sample_next);
+	iq_tap(tx, s, skip);
+	ti->start = tx->sample_next;
+	ti->skip = skip;
+	tx->sample_next += BS_SAMPLES - skip;
+	return phys;
+}
+
+/*
+ * Off-target check of the PTT switching in a log: the symbols are queued
+ * again, with the switching as logged, to chains in plain memory, and each
+ * symbol is walked the way the DMA goes through it, counting the samples it
+ * paces. Where each switch lands is compared to the sample it was due at.
+ * Switching on late or off early, or left out of the chain, fails the check.
+ */
+static int ptt_check(const char *path) {
+	txlog_reader_t r;
+	txlog_rec_t rec;
+	tx_t *tx = tx_list;
+	ts_info_t *ti;
+	ptt_event_t due[PTT_EVENTS];
+	dma_cb_t *cb;
+	uint32_t phys, cb_offset;
+	uint64_t sample;
+	unsigned switches = 0, late = 0, early = 0, wrong = 0, missing = 0;
+	int n, placed, seen, err, err_max = 0;
+
+	if (txlog_reader_open(&r, path) < 0)
+		return 1;
+	mem_kind = MEM_MBOX;
+	mem_phys_base = 0x40000000;
+	if (!(virtbase = aligned_alloc(PAGE_SIZE, (size_t)num_pages * PAGE_SIZE)))
+		fatal("psk31: Failed to malloc the chains: %m\n");
+	make_pagemap();
+	make_physinfo();
+	init_ctrl_data();
+	while (txlog_read(&r, &rec) > 0) {
+		if (rec.type == TXLOG_PTT) {
+			ptt_push(tx, rec.sample, rec.a, rec.b);
+			continue;
+		}
+		if (rec.type != TXLOG_SYM || rec.a >= SYM_COUNT || rec.b >= BS_SAMPLES)
+			continue;
+		n = tx->ptt_count;
+		memcpy(due, tx->ptt, n * sizeof(due[0]));
+		tx->sample_next = rec.sample;
+		phys = tx_sym_enqueue(tx, rec.a, rec.b);
+		placed = n - tx->ptt_count;
+		if (!placed)
+			continue;
+
+		/* From the entry to the end of the chain, as the DMA goes */
+		ti = &tx->ts_info[tx->ts_last];
+		sample = rec.sample;
+		for (seen = 0; phys; phys = cb->next) {
+			cb_offset = cb_phys_to_offset(phys);
+			cb = (dma_cb_t *)cb_offset_to_virt(cb_offset);
+			if (cb_offset >= ti->ptt_offset && cb->src == phys + offsetof(dma_cb_t, pad_1)) {
+				n = (cb_offset - ti->ptt_offset) / sizeof(dma_cb_t);
+				err = (int64_t)(sample - due[n].sample);
+				fprintf(stderr, "%10.3fs %s %s, %+d samples\n", due[n].sample * PULSE_WIDTH_INCR_US / 1e6,
+					ptt_names[due[n].what >> 2], due[n].what & 2 ? "on" : "off", err);
+				if (err < 0)
+					early++;
+				else if (err > 0)
+					late++;
+				if (due[n].what & 2 ? err > 0 : err < 0)
+					wrong++;
+				if (abs(err) > err_max)
+					err_max = abs(err);
+				switches++;
+				seen++;
+			} else if (cb->info & DMA_D_DREQ) {
+				sample += option_serial ? cb->length / SERIAL_SAMPLE_BYTES : 1;
+			}
+		}
+		missing += placed - seen;
+	}
+	txlog_reader_close(&r);
+	if (!switches && !missing)
+		return 0;
+	fprintf(stderr, "PTT:                  %u switches, %u early, %u late, at most %d samples out, "
+		"%u the wrong way, %u missing\n", switches, early, late, err_max, wrong, missing);
+	return wrong || missing;
+}
+
+/*
+ * Exact position of the DMA, in samples since the first symbol, and the
+ * CLOCK_REALTIME at which it was read.
+ */
+static uint64_t tx_position(tx_t *tx, uint64_t *t_ns) {
+	struct timespec ts;
+	uint32_t phys, offset, src, base;
+	uint64_t pos;
+	int slot, s, cb;
+
+	phys = tx->dma_reg[DMA_CONBLK_AD];
+	src = tx->dma_reg[DMA_SOURCE_AD];
+	clock_gettime(CLOCK_REALTIME, &ts);
+	*t_ns = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	if (phys == 0)
+		fatal("rpio-pwm: DMA stopped\n");
+	offset = cb_phys_to_offset(phys);
+	/* A PTT CB is at the start of the CB it goes ahead of */
+	while (option_ptt && offset >= tx->ts_info[(offset - tx->cb_base) / ts_stride].ptt_offset) {
+		offset = cb_phys_to_offset(((dma_cb_t *)cb_offset_to_virt(offset))->next);
+		src = 0;
+	}
+	offset -= tx->cb_base;
+	slot = offset / ts_stride;
+	cb = (offset % ts_stride) / sizeof(dma_cb_t);
+	for (s = 0; s < SYM_COUNT - 1 && cb >= sym_def[s].cb_count; s++)
+		cb -= sym_def[s].cb_count;
+	pos = tx->ts_info[slot].start + sym_def[s].cb_sample[cb] - tx->ts_info[slot].skip;
+	/* A serializer CB takes many samples, the source address tells which */
+	if (option_serial) {
+		base = mem_virt_to_phys(virtbase + sym_def[s].data_offset + cb * PAGE_SIZE);
+		if (src >= base && src - base < PAGE_SIZE)
+			pos += (src - base) / SERIAL_SAMPLE_BYTES;
+	}
+	return pos;
+}
+
+// Time at which a sample goes on air, from a position read by tx_position()
+static uint64_t tx_sample_time(uint64_t sample, uint64_t pos, uint64_t t_ns) {
+	return t_ns + ((int64_t)sample - (int64_t)pos) * PULSE_WIDTH_INCR_US * 1000;
+}
+
+// Start the PWM (or PCM) that paces the DMA of a transmitter
+static void pacing_start(tx_t *tx) {
+	if (tx->delay_hw == DELAY_VIA_PWM) {
 		// Initialise PWM
 		pwm_reg[PWM_CTL] = 0;
 		udelay(10);
 		clk_reg[PWMCLK_CNTL] = 0x5A000006;        // Source=PLLD (500MHz)
 		udelay(100);
-		clk_reg[PWMCLK_DIV] = 0x5A000000 | (50<<12);    // set pwm div to 50, giving 10MHz
-		udelay(100);
-		clk_reg[PWMCLK_CNTL] = 0x5A000016;        // Source=PLLD and enable
+		if (option_serial) {
+			// One bit a clock, 12.12 divisor with MASH 1 for the fraction
+			clk_reg[PWMCLK_DIV] = 0x5A000000 | (500 * 4096 * PULSE_WIDTH_INCR_US / option_serial);
+			udelay(100);
+			clk_reg[PWMCLK_CNTL] = 0x5A000216;        // Source=PLLD, MASH 1 and enable
+		} else {
+			clk_reg[PWMCLK_DIV] = 0x5A000000 | (50<<12);    // set pwm div to 50, giving 10MHz
+			udelay(100);
+			clk_reg[PWMCLK_CNTL] = 0x5A000016;        // Source=PLLD and enable
+		}
 		udelay(100);
-		pwm_reg[PWM_RNG1] = PULSE_WIDTH_INCR_US * 10;
+		if (option_serial) {
+			pwm_reg[PWM_RNG1] = 32;
+			pwm_reg[PWM_RNG2] = 32;
+		} else {
+			pwm_reg[PWM_RNG1] = PULSE_WIDTH_INCR_US * 10;
+		}
 		udelay(10);
 		pwm_reg[PWM_DMAC] = PWMDMAC_ENAB | PWMDMAC_THRSHLD;
 		udelay(10);
 		pwm_reg[PWM_CTL] = PWMCTL_CLRF;
 		udelay(10);
-		pwm_reg[PWM_CTL] = PWMCTL_USEF1 | PWMCTL_PWEN1;
+		if (option_serial)
+			pwm_reg[PWM_CTL] = PWMCTL_USEF1 | PWMCTL_MODE1 | PWMCTL_PWEN1 |
+				PWMCTL_USEF2 | PWMCTL_MODE2 | PWMCTL_PWEN2;
+		else
+			pwm_reg[PWM_CTL] = PWMCTL_USEF1 | PWMCTL_PWEN1;
 		udelay(10);
 	} else {
 		// Initialise PCM
@@ -1047,8 +2098,28 @@ static void init_hardware(void) {
 		pcm_reg[PCM_CS_A] |= 1<<9;            // Enable DMA
 		udelay(100);
 	}
+}
+
+static void pacing_stop(tx_t *tx) {
+	int cntl;
+
+	if (tx->delay_hw == DELAY_VIA_PWM) {
+		pwm_reg[PWM_CTL] = 0;
+		cntl = PWMCLK_CNTL;
+	} else {
+		pcm_reg[PCM_CS_A] = 0;
+		cntl = PCMCLK_CNTL;
+	}
+	udelay(10);
+	clk_reg[cntl] = 0x5A000006;        // Source=PLLD, disabled
+	while ((clk_reg[cntl] & 0x00000080) != 0)
+		;
+}
+
+// Start the DMA of a transmitter at a CB
+static void dma_start(tx_t *tx, uint32_t phys) {
+	volatile uint32_t *dma_reg = tx->dma_reg;
 
-	// Initialise the DMA
 	dma_reg[DMA_CS] = DMA_RESET;
 	udelay(10);
 	dma_reg[DMA_CS] = DMA_INT | DMA_END;
@@ -1056,13 +2127,130 @@ static void init_hardware(void) {
 	dma_reg[DMA_DEBUG] = 7; // clear debug error flags
 	dma_reg[DMA_CS] = 0x10880001;    // go, mid priority, wait for outstanding writes
 
-	if (delay_hw == DELAY_VIA_PCM) {
+	if (tx->delay_hw == DELAY_VIA_PCM) {
 		pcm_reg[PCM_CS_A] |= 1<<2;            // Enable Tx
 	}
 }
 
+// Initialize PWM (or PCM) and DMA of a transmitter
+static void init_hardware(tx_t *tx) {
+	int i;
+
+	if (option_polar) {
+		pacing_start(tx);
+		dma_start(tx, cb_offset_to_phys(tx->cb_base));
+		return;
+	}
+
+	/* Setup idle burst */
+	tx->ts_last_cbp = NULL;
+	tx->depth = ts_depth_min;
+	for (i = 0; i <= tx->depth; i++)
+		tx_sym_enqueue(tx, SYM_H, 0);
+	pacing_start(tx);
+	dma_start(tx, tx->ts_info[0].bs[SYM_H].physaddr);
+}
+
+static double thread_cpu_ms(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/*
+ * Low power idle: the DMA, its pacing clock and the carrier are stopped and
+ * the GPIOs float. The CB chains stay as they are, so waking up only starts
+ * the clocks and the DMA again, on a steady symbol at the level it stopped.
+ */
+static void tx_sleep(tx_t *tx) {
+	tx->dma_reg[DMA_CS] = DMA_RESET;
+	udelay(10);
+	pacing_stop(tx);
+	clock_stop(tx);
+	gpio_set_mode(tx->gpio_pos, GPIO_MODE_IN);
+	gpio_set_mode(tx->gpio_neg, GPIO_MODE_IN);
+	gpio_set_mode(gpclk_gpio[tx->gpclk], GPIO_MODE_IN);
+	txlog_put(&tx->log, TXLOG_STATE, STATE_SLEEP, 0, tx->sample_next);
+	tx->asleep = 1;
+	tx->sleep_count++;
+	tx->sleep_wakeups = 0;
+	tx->sleep_start_ms = now_ms();
+	tx->sleep_cpu_ms = thread_cpu_ms();
+}
+
+/*
+ * Real-time feeder: SCHED_FIFO, and pinned to a CPU that the journal and log
+ * threads, which wait on the disk, are kept off. They were started by the
+ * feeder before this, so they keep the normal policy.
+ */
+static void rt_setup(tx_t *tx) {
+	struct sched_param sp = { .sched_priority = option_rt_priority };
+	cpu_set_t set;
+	int i, cpus;
+
+	if (option_cpu >= 0) {
+		CPU_ZERO(&set);
+		CPU_SET(option_cpu, &set);
+		if ((errno = pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) != 0)
+			fatal("psk31: Failed to pin the feeder to CPU %d: %m\n", option_cpu);
+		CPU_ZERO(&set);
+		cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		for (i = 0; i < cpus; i++)
+			if (i != option_cpu)
+				CPU_SET(i, &set);
+		if (CPU_COUNT(&set)) {
+			if (tx->journal.base)
+				pthread_setaffinity_np(tx->journal.thread, sizeof(set), &set);
+			if (tx->log.ring)
+				pthread_setaffinity_np(tx->log.thread, sizeof(set), &set);
+		}
+	}
+	if (option_rt_priority > 0 && (errno = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp)) != 0)
+		fatal("psk31: Failed to set SCHED_FIFO %d: %m\n", option_rt_priority);
+}
+
+// How late the feeder woke up from a timeout
+static void late_record(tx_t *tx, double late_us) {
+	uint32_t us = late_us > 0 ? (uint32_t)late_us : 0;
+	int b;
+
+	for (b = 0; b < LATE_BUCKETS - 1 && us >= (1u << b); b++)
+		;
+	tx->late_hist[b]++;
+	if (us > tx->late_max_us)
+		tx->late_max_us = us;
+}
+
+static void tx_wake(tx_t *tx, double t_input_ms) {
+	int s = ts_next[tx->ts_last_sym][1];
+	double slept_ms = now_ms() - tx->sleep_start_ms;
+	double cpu_ms = thread_cpu_ms() - tx->sleep_cpu_ms;
+	int i;
+
+	gpio_set_mode(tx->gpio_pos, TX_GPIO_MODE);
+	gpio_set_mode(tx->gpio_neg, TX_GPIO_MODE);
+	clock_start(tx);
+	tx->doppler_factor = 0;         /* Applied again */
+	pacing_start(tx);
+	tx->ts_last_cbp = NULL;
+	dma_start(tx, tx_sym_enqueue(tx, s, 0));
+	tx->margin_skip = 1;
+	for (i = 0; i < 1000 && !tx->dma_reg[DMA_CONBLK_AD]; i++)
+		udelay(1);
+	tx->wake_ms = now_ms() - t_input_ms;
+	tx->asleep = 0;
+	printf("Sleep%s%s:%*s %.1fs, %u wakeups, %.2fms CPU; on air %.2fms after the input\n",
+		tx->name[0] ? " " : "", tx->name, (int)(15 - strlen(tx->name) - !!tx->name[0]), "",
+		slept_ms / 1000, tx->sleep_wakeups, cpu_ms, tx->wake_ms);
+	fflush(stdout);
+}
+
 static void term_hardware(void) {
-	dma_reg[DMA_CS] = DMA_RESET;
+	tx_t *tx;
+
+	for (tx = tx_list; tx < &tx_list[tx_count]; tx++)
+		tx->dma_reg[DMA_CS] = DMA_RESET;
 	udelay(10);
 }
 
@@ -1076,11 +2264,6 @@ typedef struct stat_s {
 	char *s_buf;
 } stat_t;
 
-const struct sockaddr_un stat_addr = {
-	.sun_family = AF_UNIX,
-	.sun_path = DEVFILE_STAT,
-};
-
 static int stat_fd_set(int fd_max, int fd_stat, stat_t *stat_head, fd_set *readfs, fd_set *writefs) {
 	stat_t *s;
 
@@ -1093,8 +2276,9 @@ static int stat_fd_set(int fd_max, int fd_stat, stat_t *stat_head, fd_set *readf
 	return fd_max;
 }
 
-static void stat_accept(int fd_stat, stat_t **stat_head, fd_set *readfs, int sendcount) {
-	int fd;
+static void stat_accept(tx_t *tx, int fd_stat, stat_t **stat_head, fd_set *readfs, int sendcount) {
+	char hist[LATE_BUCKETS * 11];
+	int fd, b, len;
 	stat_t *s;
 
 	if (!FD_ISSET(fd_stat, readfs))
@@ -1110,6 +2294,8 @@ static void stat_accept(int fd_stat, stat_t **stat_head, fd_set *readfs, int sen
 			fatal("psk31: accept oom\n");
 		s->s_fd = fd;
 		s->s_read = 0;
+		for (b = len = 0; b < LATE_BUCKETS; b++)
+			len += sprintf(hist + len, " %u", tx->late_hist[b]);
 		s->s_count = asprintf(&s->s_buf,
 			"amplitude %f\n"
 			"rc %f\n"
@@ -1117,14 +2303,34 @@ static void stat_accept(int fd_stat, stat_t **stat_head, fd_set *readfs, int sen
 			"clock_mash %d\n"
 			"clock_freq %f\n"
 			"timeout %d\n"
-			"pending_char %d\n",
+			"lo_freq %f\n"
+			"pending_char %d\n"
+			"queued_msgs %d\n"
+			"asleep %d\n"
+			"sleep_count %u\n"
+			"sleep_wakeups %u\n"
+			"wake_ms %f\n"
+			"late_max_us %u\n"
+			"late_hist%s\n"
+			"margin_min_ms %d\n"
+			"queue_ms %d\n",
 			option_amplitude,
 			option_rc,
-			(unsigned)clock_cb.c_div,
-			clock_cb.c_mash,
-			clock_cb.c_div ? 500.0 * (double)(1 << 12) / (double)clock_cb.c_div : 0,
+			(unsigned)tx->clock_cb.c_div,
+			tx->clock_cb.c_mash,
+			tx->clock_cb.c_div ? 500.0 * (double)(1 << 12) / (double)tx->clock_cb.c_div : 0,
 			option_timeout,
-			sendcount);
+			lo_active ? lo.f_out / 1e6 : 0,
+			sendcount + tx->queue.bytes,
+			tx->queue.count,
+			tx->asleep,
+			tx->sleep_count,
+			tx->sleep_wakeups,
+			tx->wake_ms,
+			tx->late_max_us,
+			hist,
+			tx->margin_min * BS_US / 1000,
+			tx->depth * BS_US / 1000);
 		if (s->s_count == -1)
 			fatal("psk31: asprintf oom\n");
 		s->s_next = *stat_head;
@@ -1164,49 +2370,689 @@ static void stat_write(stat_t **stat_head, fd_set *writefs) {
 	}
 }
 
-// Endless loop to read the FIFO DEVFILE_SEND and set the servos according
-// to the values in the FIFO
-static void go_go_go(void) {
+typedef struct client_s {
+	struct client_s *c_next;
+	int c_fd;
+	int c_subscribed;       /* Gets the events of all messages */
+} client_t;
+
+static int sock_listen(const char *path, int type) {
+	struct sockaddr_un addr = {
+		.sun_family = AF_UNIX,
+	};
+	int fd;
+
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+	if ((fd = socket(AF_UNIX, type | SOCK_NONBLOCK, 0)) == -1)
+		fatal("psk31: socket error: %m\n");
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(struct sockaddr_un)) == -1)
+		fatal("psk31: bind error: %m\n");
+	if (chmod(path, 0666) < 0)
+		fatal("psk31: failed to set permissions on %s: %m\n", path);
+	if (listen(fd, 5) == -1)
+		fatal("psk31: listen error: %m\n");
+	return fd;
+}
+
+static int client_fd_set(int fd_max, int fd_sock, client_t *client_head, fd_set *readfs) {
+	client_t *c;
+
+	for (c = client_head; c; c = c->c_next) {
+		fd_max = max(fd_max, c->c_fd);
+		FD_SET(c->c_fd, readfs);
+	}
+	fd_max = max(fd_max, fd_sock);
+	FD_SET(fd_sock, readfs);
+	return fd_max;
+}
+
+static void client_accept(int fd_sock, client_t **client_head, fd_set *readfs) {
+	client_t *c;
+	int fd;
+
+	if (!FD_ISSET(fd_sock, readfs))
+		return;
+	for (;;) {
+		if ((fd = accept4(fd_sock, NULL, 0, SOCK_NONBLOCK)) == -1) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return;
+			fatal("psk31: accept error: %m\n");
+		}
+		if (!(c = (client_t *)malloc(sizeof(*c))))
+			fatal("psk31: accept oom\n");
+		c->c_fd = fd;
+		c->c_subscribed = 0;
+		c->c_next = *client_head;
+		*client_head = c;
+	}
+}
+
+// Replies are best effort, a producer that does not read them loses them
+static void client_reply(tx_t *tx, int fd, uint32_t id, int type) {
+	psk31_reply_t r = {
+		.id = id,
+		.type = type,
+		.messages = tx->queue.count,
+		.bytes = tx->queue.bytes,
+		.space = MSGQ_BYTES - tx->queue.bytes,
+	};
+
+	if (fd >= 0)
+		send(fd, &r, sizeof(r), MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+static void client_message(tx_t *tx, client_t *c, const uint8_t *buf, ssize_t len) {
+	const psk31_msg_t *m = (const psk31_msg_t *)buf;
+	int fd = c->c_fd;
+	msg_t *msg;
+
+	if (len < sizeof(*m)) {
+		client_reply(tx, fd, 0, PSK31_REPLY_INVALID);
+		return;
+	}
+	if (m->type == PSK31_MSG_SUBSCRIBE && len == sizeof(*m)) {
+		c->c_subscribed = 1;
+		client_reply(tx, fd, m->id, PSK31_REPLY_SUBSCRIBED);
+		return;
+	}
+	if (m->type != PSK31_MSG_SUBMIT || m->priority >= PSK31_PRIO_COUNT ||
+			m->length == 0 || m->length > PSK31_TEXT_MAX || len != sizeof(*m) + m->length) {
+		client_reply(tx, fd, m->id, PSK31_REPLY_INVALID);
+		return;
+	}
+	if (!(msg = msgq_submit(&tx->queue, m, m + 1, fd))) {
+		client_reply(tx, fd, m->id, PSK31_REPLY_FULL);
+		return;
+	}
+	msg->jseq = journal_submit(&tx->journal, m, m + 1);
+	client_reply(tx, fd, m->id, PSK31_REPLY_QUEUED);
+}
+
+static void client_read(tx_t *tx, client_t **client_head, fd_set *readfs) {
+	uint8_t buf[sizeof(psk31_msg_t) + PSK31_TEXT_MAX + 1];
+	client_t **cp;
+	client_t *c;
+	ssize_t ss;
+
+	for (cp = client_head; (c = *cp) != NULL; ) {
+		if (!FD_ISSET(c->c_fd, readfs)) {
+			cp = &c->c_next;
+			continue;
+		}
+		/* One message per read, the socket keeps the boundaries */
+		while ((ss = recv(c->c_fd, buf, sizeof(buf), 0)) > 0)
+			client_message(tx, c, buf, ss);
+		if (ss == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			cp = &c->c_next;
+			continue;
+		}
+		/* Gone: what it queued is still sent */
+		msgq_disown(&tx->queue, c->c_fd);
+		close(c->c_fd);
+		*cp = c->c_next;
+		free(c);
+	}
+}
+
+// A message has been on air: tell its producer and the subscribers
+static void client_done(client_t *client_head, const msg_t *msg, uint64_t pos, uint64_t t_ns) {
+	psk31_event_t e = {
+		.id = msg->id,
+		.type = PSK31_EVENT_DONE,
+		.priority = msg->priority,
+		.length = msg->len,
+		.start_ns = msg->start_seen_ns ? msg->start_seen_ns : tx_sample_time(msg->start_sample, pos, t_ns),
+		.end_ns = tx_sample_time(msg->end_sample, pos, t_ns),
+	};
+	client_t *c;
+
+	if (msg->start_ns) {
+		e.start_error_ns = (int64_t)(e.start_ns - msg->start_ns);
+		printf("Scheduled %u:         start error %+.1fus\n", msg->id, e.start_error_ns / 1000.0);
+		fflush(stdout);
+	}
+	if (msg->owner >= 0)
+		send(msg->owner, &e, sizeof(e), MSG_DONTWAIT | MSG_NOSIGNAL);
+	for (c = client_head; c; c = c->c_next)
+		if (c->c_subscribed && c->c_fd != msg->owner)
+			send(c->c_fd, &e, sizeof(e), MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+// With a journal the FIFO is queued as bulk messages, so it is journaled too
+static ssize_t fifo_submit(tx_t *tx, int fd) {
+	uint8_t buf[sizeof(psk31_msg_t) + PSK31_TEXT_MAX];
+	psk31_msg_t *m = (psk31_msg_t *)buf;
+	msg_t *msg;
+	ssize_t ss;
+	int n;
+
+	n = MSGQ_BYTES - tx->queue.bytes;
+	if (n > PSK31_TEXT_MAX)
+		n = PSK31_TEXT_MAX;
+	if ((ss = read(fd, m + 1, n)) <= 0)
+		return ss;
+	memset(m, 0, sizeof(*m));
+	m->type = PSK31_MSG_SUBMIT;
+	m->priority = PSK31_PRIO_BULK;
+	m->length = ss;
+	if ((msg = msgq_submit(&tx->queue, m, m + 1, -1)) != NULL)
+		msg->jseq = journal_submit(&tx->journal, m, m + 1);
+	return ss;
+}
+
+// A message the journal had not finished, from the first character not on air
+static int journal_resume(void *ctx, uint32_t seq, const psk31_msg_t *m, const uint8_t *text, int pos) {
+	tx_t *tx = (tx_t *)ctx;
+	psk31_msg_t r = *m;
+	msg_t *msg;
+
+	if (pos >= m->length)
+		return -1;
+	/* Started already, the rest goes right away */
+	if (pos > 0)
+		r.start_ns = 0;
+	if (!(msg = msgq_submit(&tx->queue, &r, text, -1))) {
+		printf("psk31: no room to resume message %u\n", m->id);
+		return -1;
+	}
+	msgq_skip(&tx->queue, msg, pos);
+	msg->jseq = seq;
+	return 0;
+}
+
+static uint32_t handoff_cb(dma_cb_t *cb) {
+	return cb ? cb_phys_to_offset(mem_virt_to_phys(cb)) : ~0u;
+}
+
+static dma_cb_t *handoff_cbp(uint32_t cb_offset) {
+	return cb_offset == ~0u ? NULL : (dma_cb_t *)cb_offset_to_virt(cb_offset);
+}
+
+// A new process asks to take over; the other feeders are woken to stop for it
+static void handoff_accept(fd_set *readfs) {
+	uint64_t one = 1;
+	tx_t *tx;
+
+	if (fd_handoff < 0 || !FD_ISSET(fd_handoff, readfs))
+		return;
+	if ((handoff_conn = accept(fd_handoff, NULL, NULL)) < 0)
+		return;
+	printf("Handoff:              requested, finishing the messages in flight\n");
+	fflush(stdout);
+	handoff_start_ms = now_ms();
+	handoff_state = HANDOFF_PENDING;
+	for (tx = &tx_list[1]; tx < &tx_list[tx_count]; tx++)
+		if (write(tx->handoff_event, &one, sizeof(one)) < 0)
+			fatal("psk31: eventfd write error: %m\n");
+}
+
+// Called off, the feeders go on from where they stopped
+static void handoff_end(const char *why) {
+	printf("Handoff:              %s, carrying on\n", why);
+	fflush(stdout);
+	close(handoff_conn);
+	handoff_conn = -1;
+	__atomic_store_n(&handoff_state, HANDOFF_NONE, __ATOMIC_RELEASE);
+}
+
+// Leave the hardware to the new process: no DMA reset, nothing freed or unlinked
+static void handoff_exit(void) {
+	char path[96];
+	tx_t *tx;
+
+	for (tx = tx_list; tx < &tx_list[tx_count]; tx++) {
+		journal_close(&tx->journal);
+		txlog_close(&tx->log);
+		/* The new process starts a log of its own */
+		if (tx->log_path[0]) {
+			snprintf(path, sizeof(path), "%s.%d", tx->log_path, (int)getpid());
+			rename(tx->log_path, path);
+		}
+	}
+	printf("Handoff:              done in %.1fms, the DMA runs on\n", now_ms() - handoff_start_ms);
+	fflush(stdout);
+	exit(0);
+}
+
+static int handoff_send(int fd, const void *buf, size_t len) {
+	ssize_t ss;
+
+	for (; len; buf = (const uint8_t *)buf + ss, len -= ss)
+		if ((ss = send(fd, buf, len, MSG_NOSIGNAL)) <= 0)
+			return -1;
+	return 0;
+}
+
+// Once every feeder has stopped, send it all and wait for the new process to take it
+static void handoff_give(void) {
+	char cbuf[CMSG_SPACE(HANDOFF_FDS * sizeof(int))];
+	struct iovec iov = {
+		.iov_base = &handoff,
+		.iov_len = sizeof(handoff),
+	};
+	struct msghdr mh = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = cbuf,
+	};
+	struct timeval tv = {
+		.tv_sec = HANDOFF_ACK_MS / 1000,
+	};
+	struct cmsghdr *cm;
+	handoff_ts_t *ts;
+	handoff_tx_t *h;
+	ts_info_t *ti;
+	int fds[HANDOFF_FDS];
+	int nfd, i, s;
+	tx_t *tx;
+	char ack;
+
+	while (__atomic_load_n(&handoff_parked, __ATOMIC_ACQUIRE) < tx_count) {
+		if (now_ms() - handoff_start_ms > HANDOFF_WAIT_MS) {
+			handoff_end("messages still in flight");
+			return;
+		}
+		usleep(1000);
+	}
+	handoff.magic = HANDOFF_MAGIC;
+	handoff.version = HANDOFF_VERSION;
+	handoff.size = sizeof(handoff);
+	handoff.pid = getpid();
+	handoff.tx_count = tx_count;
+	handoff.ts_count = ts_count;
+	handoff.num_pages = num_pages;
+	handoff.serial = option_serial;
+	handoff.ts_stride = ts_stride;
+	handoff.mem_kind = mem_kind;
+	handoff.mem_size = mem_size;
+	handoff.mem_phys_base = mem_phys_base;
+	handoff.mbox_handle = mbox_handle;
+	handoff.lo_active = lo_active;
+	handoff.lo = lo;
+	handoff.doppler_lo = doppler_lo;
+	nfd = 0;
+	handoff.fd_mem = mem_fd >= 0 ? nfd : -1;
+	if (mem_fd >= 0)
+		fds[nfd++] = mem_fd;
+	handoff.fd_handoff = nfd;
+	fds[nfd++] = fd_handoff;
+	for (tx = tx_list; tx < &tx_list[tx_count]; tx++) {
+		h = &handoff.tx[tx - tx_list];
+		h->dma_chan = tx->dma_chan;
+		h->clock_cb = tx->clock_cb;
+		h->doppler_div = tx->doppler_div;
+		h->ts_last_cb = handoff_cb(tx->ts_last_cbp);
+		h->ts_last = tx->ts_last;
+		h->ts_last_sym = tx->ts_last_sym;
+		h->depth = tx->depth;
+		h->asleep = tx->asleep;
+		h->sample_next = tx->sample_next;
+		memcpy(h->ptt, tx->ptt, sizeof(h->ptt));
+		h->ptt_count = tx->ptt_count;
+		memcpy(h->ptt_on, tx->ptt_on, sizeof(h->ptt_on));
+		h->ptt_last = tx->ptt_last;
+		for (i = 0; i < 3; i++)
+			if (h->fd[i] >= 0) {
+				fds[nfd] = h->fd[i];
+				h->fd[i] = nfd++;
+			}
+	}
+	mh.msg_controllen = CMSG_SPACE(nfd * sizeof(int));
+	cm = CMSG_FIRSTHDR(&mh);
+	cm->cmsg_level = SOL_SOCKET;
+	cm->cmsg_type = SCM_RIGHTS;
+	cm->cmsg_len = CMSG_LEN(nfd * sizeof(int));
+	memcpy(CMSG_DATA(cm), fds, nfd * sizeof(int));
+	if (sendmsg(handoff_conn, &mh, MSG_NOSIGNAL) != sizeof(handoff)) {
+		handoff_end("the new process went away");
+		return;
+	}
+
+	if (!(ts = malloc(ts_count * sizeof(*ts))))
+		fatal("psk31: Failed to malloc handoff: %m\n");
+	for (tx = tx_list; tx < &tx_list[tx_count]; tx++) {
+		for (i = 0; i < ts_count; i++) {
+			ti = &tx->ts_info[i];
+			for (s = 0; s < SYM_COUNT; s++) {
+				ts[i].bs[s].physaddr = ti->bs[s].physaddr;
+				ts[i].bs[s].cb_offset = ti->bs[s].cb_offset;
+				ts[i].bs[s].cb_last = handoff_cb(ti->bs[s].cb_last);
+			}
+			ts[i].physaddr = ti->physaddr;
+			ts[i].start = ti->start;
+			ts[i].skip = ti->skip;
+			ts[i].entry_cb = handoff_cb(ti->entry_cb);
+			ts[i].entry_src = ti->entry_src;
+			ts[i].entry_length = ti->entry_length;
+			ts[i].ptt_patches = ti->ptt_patches;
+			for (s = 0; s < ti->ptt_patches; s++) {
+				ts[i].ptt_patch[s] = handoff_cb(ti->ptt_patch[s]);
+				ts[i].ptt_next[s] = ti->ptt_next[s];
+			}
+		}
+		if (handoff_send(handoff_conn, ts, ts_count * sizeof(*ts)) < 0)
+			break;
+	}
+	free(ts);
+	setsockopt(handoff_conn, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	if (tx < &tx_list[tx_count] || recv(handoff_conn, &ack, 1, 0) != 1) {
+		handoff_end("the new process gave up");
+		return;
+	}
+	handoff_exit();
+}
+
+/*
+ * A feeder stops at a symbol boundary and leaves where it stood. The first
+ * one sends it all once the others have stopped too; if the handoff is
+ * called off they all go on.
+ */
+static void handoff_park(tx_t *tx, int fd_send, int fd_stat, int fd_sock, int state, int fill_timeout,
+		burst_t curburst, const unsigned char *sendbuf, int sendread, int sendcount) {
+	handoff_tx_t *h = &handoff.tx[tx - tx_list];
+	int i;
+
+	h->fd[0] = fd_send;
+	h->fd[1] = fd_stat;
+	h->fd[2] = fd_sock;
+	h->state = state;
+	h->fill_timeout = fill_timeout;
+	h->curburst = curburst;
+	for (i = 0; i < sendcount; i++)
+		h->sendbuf[i] = sendbuf[(sendread + i) % SENDSIZE];
+	h->sendcount = sendcount;
+	__atomic_add_fetch(&handoff_parked, 1, __ATOMIC_ACQ_REL);
+	if (tx == tx_list)
+		handoff_give();
+	while (__atomic_load_n(&handoff_state, __ATOMIC_ACQUIRE) == HANDOFF_PENDING)
+		usleep(1000);
+	__atomic_sub_fetch(&handoff_parked, 1, __ATOMIC_ACQ_REL);
+
+	/* A long wait can run the queue dry: start again on a steady symbol, as a wakeup does */
+	if (!tx->asleep && !tx->dma_reg[DMA_CONBLK_AD]) {
+		tx->ts_last_cbp = NULL;
+		dma_start(tx, tx_sym_enqueue(tx, ts_next[tx->ts_last_sym][1], 0));
+		tx->margin_skip = 1;
+		printf("Handoff%s%s:%*s the DMA ran out, started again\n",
+			tx->name[0] ? " " : "", tx->name, (int)(13 - strlen(tx->name) - !!tx->name[0]), "");
+		fflush(stdout);
+	}
+}
+
+/*
+ * Take over from the running process: its memory, its DMA queues and its
+ * files. Whatever goes wrong before handoff_adopt(), it carries on.
+ */
+static void handoff_take(void) {
+	struct sockaddr_un addr = {
+		.sun_family = AF_UNIX,
+	};
+	char cbuf[CMSG_SPACE(HANDOFF_FDS * sizeof(int))];
+	struct iovec iov = {
+		.iov_base = &handoff,
+		.iov_len = sizeof(handoff),
+	};
+	struct msghdr mh = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = cbuf,
+		.msg_controllen = sizeof(cbuf),
+	};
+	struct cmsghdr *cm;
+	si570_bus_t bus;
+	handoff_ts_t *ts;
+	handoff_tx_t *h;
+	ts_info_t *ti;
+	int fds[HANDOFF_FDS];
+	int fd, nfd, i, s;
+	tx_t *tx;
+	void *p;
+
+	handoff_adopting = 1;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", DEVFILE_HANDOFF);
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+			connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+		fatal("psk31: Failed to connect to %s: %m\n", DEVFILE_HANDOFF);
+	if (recvmsg(fd, &mh, MSG_WAITALL) != sizeof(handoff))
+		fatal("psk31: The running process did not hand off\n");
+	nfd = 0;
+	if ((cm = CMSG_FIRSTHDR(&mh)) && cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS) {
+		nfd = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		memcpy(fds, CMSG_DATA(cm), nfd * sizeof(int));
+	}
+	if (handoff.magic != HANDOFF_MAGIC || handoff.version != HANDOFF_VERSION || handoff.size != sizeof(handoff))
+		fatal("psk31: The running process cannot hand off to this version\n");
+	if (handoff.tx_count != tx_count || handoff.ts_count != ts_count || handoff.num_pages != num_pages ||
+			handoff.serial != option_serial || handoff.ts_stride != ts_stride)
+		fatal("psk31: The running process has other transmitters, queue or waveforms\n");
+	for (i = 0; i < tx_count; i++)
+		if (handoff.tx[i].dma_chan != tx_list[i].dma_chan)
+			fatal("psk31: The running process has other transmitters, queue or waveforms\n");
+	if (handoff.fd_handoff < 0 || handoff.fd_handoff >= nfd || handoff.fd_mem >= nfd)
+		fatal("psk31: The running process passed too few files\n");
+
+	/* The same pages, so the same CB offsets */
+	sys_page_size = sysconf(_SC_PAGESIZE);
+	mem_kind = handoff.mem_kind;
+	mem_size = handoff.mem_size;
+	if (mem_kind == MEM_MBOX) {
+		if ((i = open("/dev/mem", O_RDWR | O_SYNC)) < 0)
+			fatal("psk31: Failed to open /dev/mem: %m\n");
+		p = mmap(NULL, mem_size, PROT_READ|PROT_WRITE, MAP_SHARED, i, handoff.mem_phys_base & ~0xc0000000);
+		close(i);
+		mem_phys_base = handoff.mem_phys_base;
+	} else if (handoff.fd_mem >= 0) {
+		mem_fd = fds[handoff.fd_mem];
+		p = mmap(NULL, mem_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_LOCKED|MAP_POPULATE, mem_fd, 0);
+	} else {
+		fatal("psk31: The running process passed no DMA memory\n");
+	}
+	if (p == MAP_FAILED)
+		fatal("psk31: Failed to map the DMA memory of the running process: %m\n");
+	virtbase = p;
+	make_pagemap();
+	make_physinfo();
+	samples = (uint32_t *)(virtbase + num_pages_cbs * PAGE_SIZE);
+	fd_handoff = fds[handoff.fd_handoff];
+
+	/* The LO keeps its tuning, a new init would recall the startup frequency */
+	if (handoff.lo_active && option_si570) {
+		if (si570_bus_open(&bus, option_si570, SI570_I2C_ADDR) < 0)
+			fatal("psk31: Failed to open %s: %m\n", option_si570);
+		lo = handoff.lo;
+		lo.bus = bus;
+		lo_active = 1;
+	}
+
+	if (!(ts = malloc(ts_count * sizeof(*ts))))
+		fatal("psk31: Failed to malloc handoff: %m\n");
+	for (tx = tx_list; tx < &tx_list[tx_count]; tx++) {
+		h = &handoff.tx[tx - tx_list];
+		if (recv(fd, ts, ts_count * sizeof(*ts), MSG_WAITALL) != ts_count * sizeof(*ts))
+			fatal("psk31: The running process did not hand off\n");
+		tx->cb_base = (tx - tx_list) * cb_region_size;
+		if (!(tx->ts_info = calloc(ts_count, sizeof(ts_info_t))))
+			fatal("psk31: Failed to malloc ts_info: %m\n");
+		for (i = 0; i < ts_count; i++) {
+			ti = &tx->ts_info[i];
+			for (s = 0; s < SYM_COUNT; s++) {
+				ti->bs[s].physaddr = ts[i].bs[s].physaddr;
+				ti->bs[s].cb_offset = ts[i].bs[s].cb_offset;
+				ti->bs[s].cb_last = handoff_cbp(ts[i].bs[s].cb_last);
+			}
+			ti->physaddr = ts[i].physaddr;
+			ti->start = ts[i].start;
+			ti->skip = ts[i].skip;
+			ti->entry_cb = handoff_cbp(ts[i].entry_cb);
+			ti->entry_src = ts[i].entry_src;
+			ti->entry_length = ts[i].entry_length;
+			ti->ptt_offset = ti->bs[SYM_COUNT - 1].cb_offset + sym_def[SYM_COUNT - 1].cb_count * sizeof(dma_cb_t);
+			ti->ptt_patches = ts[i].ptt_patches;
+			for (s = 0; s < ti->ptt_patches; s++) {
+				ti->ptt_patch[s] = handoff_cbp(ts[i].ptt_patch[s]);
+				ti->ptt_next[s] = ts[i].ptt_next[s];
+			}
+		}
+		tx->clock_cb = h->clock_cb;
+		tx->ts_last_cbp = handoff_cbp(h->ts_last_cb);
+		tx->ts_last = h->ts_last;
+		tx->ts_last_sym = h->ts_last_sym;
+		tx->depth = h->depth;
+		tx->sample_next = h->sample_next;
+		memcpy(tx->ptt, h->ptt, sizeof(tx->ptt));
+		tx->ptt_count = h->ptt_count;
+		memcpy(tx->ptt_on, h->ptt_on, sizeof(tx->ptt_on));
+		tx->ptt_last = h->ptt_last;
+		tx->asleep = h->asleep;
+		tx->sleep_start_ms = now_ms();
+		for (i = 0; i < 3; i++)
+			h->fd[i] = h->fd[i] >= 0 && h->fd[i] < nfd ? fds[h->fd[i]] : -1;
+		if (!tx->asleep && !tx->dma_reg[DMA_CONBLK_AD])
+			fatal("psk31: The DMA ran out during the handoff, a longer --queue gives more time\n");
+	}
+	free(ts);
+	handoff_conn = fd;
+}
+
+// The hardware is ours: the old process may go, once it has closed its journals and logs
+static void handoff_adopt(void) {
+	struct timeval tv = {
+		.tv_sec = HANDOFF_ACK_MS / 1000,
+	};
+	tx_t *tx;
+	char c = 1;
+
+	/* Doppler corrections stay relative to the carriers as configured */
+	for (tx = tx_list; tx < &tx_list[tx_count]; tx++)
+		if (handoff.tx[tx - tx_list].doppler_div)
+			tx->doppler_div = handoff.tx[tx - tx_list].doppler_div;
+	if (handoff.doppler_lo > 0)
+		doppler_lo = handoff.doppler_lo;
+	if (send(handoff_conn, &c, 1, MSG_NOSIGNAL) != 1)
+		fatal("psk31: The running process went away: %m\n");
+	handoff_adopting = 0;
+	/* The VideoCore memory is ours to free now */
+	if (mem_kind == MEM_MBOX && (mbox_fd = open("/dev/vcio", 0)) >= 0)
+		mbox_handle = handoff.mbox_handle;
+	setsockopt(handoff_conn, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	while (recv(handoff_conn, &c, 1, 0) > 0)
+		;
+	close(handoff_conn);
+	handoff_conn = -1;
+}
+
+// Endless loop to read the FIFO of a transmitter and set the servos according
+// to the values in the FIFO. Every transmitter has its own loop and state.
+static void go_go_go(tx_t *tx) {
 	int fd_send;
 	int fd_stat;
 	stat_t *stat_head;
+	int fd_sock;
+	client_t *client_head;
+	msg_t *msg;
+	msg_t *started;                 /* Scheduled, queued to the DMA and not seen on air yet */
+	msg_t *sent_head, **sent_tail;  /* Messages queued to the DMA, in order */
+	struct {
+		uint32_t jseq;
+		int pos;
+		uint64_t end_sample;
+	} *track;                       /* Journaled characters queued to the DMA, ts_count */
+	int track_head, track_count;
+	ssize_t ss;
+	uint64_t pos, t_ns, end;
+	int64_t gap, sched_ns;
+	int wait_us;
+	int c;
 	int fd_max;
-#define SENDSIZE 128
 	unsigned char sendbuf[SENDSIZE];
 	int sendread, sendwrite, sendcount;
 	fd_set readfs;
 	fd_set writefs;
 	struct timeval tv;
 	burst_t curburst;
-	int n;
-	enum {
-		STATE_START,
-		STATE_SEND,
-		STATE_FILL,
-		STATE_STOP,
-		STATE_IDLE,
-	} state;
+	int n, k;
+	int state, state_logged;
 	int fill_timeout = 0;
-
-	/* Files for communication */
-	fd_send = -1;
+	double t_input_ms = 0, t_select_ms;
+	handoff_tx_t *h = &handoff.tx[tx - tx_list];
+	uint64_t event;
+
+	/* Files for communication, those of the old process after a handoff */
+	fd_send = fd_stat = fd_sock = -1;
+	if (option_handoff) {
+		fd_send = h->fd[0];
+		fd_stat = h->fd[1];
+		fd_sock = h->fd[2];
+	}
 	stat_head = NULL;
-	if ((fd_stat = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0)) == -1)
-		fatal("psk31: socket error: %m\n");
-	if (bind(fd_stat, (struct sockaddr *)&stat_addr, sizeof(struct sockaddr_un)) == -1)
-		fatal("psk31: bind error: %m\n");
-	if (chmod(DEVFILE_STAT, 0666) < 0)
-		fatal("psk31: failed to set permissions on %s: %m\n", DEVFILE_STAT);
-	if (listen(fd_stat, 5) == -1)
-		fatal("psk31: listen error: %m\n");
+	if (fd_stat < 0)
+		fd_stat = sock_listen(tx->devfile_stat, SOCK_STREAM);
+	client_head = NULL;
+	if (fd_sock < 0)
+		fd_sock = sock_listen(tx->devfile_sock, SOCK_SEQPACKET);
+	msgq_init(&tx->queue);
+	if (tx->journal_path[0]) {
+		if (journal_open(&tx->journal, tx->journal_path, journal_resume, tx) < 0)
+			fatal("psk31: Failed to open journal %s: %m\n", tx->journal_path);
+		printf("Journal:              %s, %d messages resumed\n", tx->journal_path, tx->queue.count);
+		fflush(stdout);
+	}
+	if (tx->log_path[0]) {
+		txlog_hdr_t hdr = {
+			.magic = TXLOG_MAGIC,
+			.version = TXLOG_VERSION,
+			.start_sample = tx->sample_next,
+			.sample_us = PULSE_WIDTH_INCR_US,
+			.samples = BS_SAMPLES,
+			.amplitude = option_amplitude,
+			.rc = option_rc,
+			.frequency = tx->frequency,
+			.div = tx->clock_cb.c_div,
+			.mash = tx->clock_cb.c_mash,
+			.serial = option_serial,
+		};
+		struct timespec ts;
+
+		clock_gettime(CLOCK_REALTIME, &ts);
+		hdr.start_ns = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+		snprintf(hdr.shape, sizeof(hdr.shape), "%s", option_shape);
+		snprintf(hdr.predistort, sizeof(hdr.predistort), "%s", option_predistort ? option_predistort : "");
+		snprintf(hdr.name, sizeof(hdr.name), "%s", tx->name);
+		if (txlog_open(&tx->log, tx->log_path, &hdr) < 0)
+			fatal("psk31: Failed to open log %s: %m\n", tx->log_path);
+	}
+	if (tx->iq_path[0]) {
+		if (iqring_create(&tx->iq, tx->iq_path, IQRING_F32, 1000000 / PULSE_WIDTH_INCR_US, IQ_TAP_FRAMES) < 0)
+			fatal("psk31: Failed to create %s: %m\n", tx->iq_path);
+		printf("I/Q tap:              %s, %d Hz\n", tx->iq_path, 1000000 / PULSE_WIDTH_INCR_US);
+		fflush(stdout);
+	}
+	rt_setup(tx);
+	if (!(track = calloc(ts_count, sizeof(*track))))
+		fatal("psk31: Failed to malloc track: %m\n");
+	tx->margin_min = ts_count;
+	state_logged = -1;
+	track_head = track_count = 0;
+	sent_head = started = NULL;
+	pos = t_ns = 0;
+	sent_tail = &sent_head;
+	wait_us = TS_US * tx->depth / 4;
 	sendread = sendwrite = 0;
 	sendcount = 0;
 	curburst.b_len = 0;
 	curburst.b_val = 0; /* To avoid compiler warnings */
 	state = STATE_IDLE;
+	if (option_handoff) {
+		state = h->state;
+		fill_timeout = h->fill_timeout;
+		curburst = h->curburst;
+		memcpy(sendbuf, h->sendbuf, h->sendcount);
+		sendcount = h->sendcount;
+		sendwrite = sendcount % SENDSIZE;
+	}
 	for (;;) {
-		if (fd_send == -1 && ((fd_send = open(DEVFILE_SEND, O_RDONLY | O_NONBLOCK)) == -1))
-			fatal("psk31: Failed to open %s: %m\n", DEVFILE_SEND);
+		if (fd_send == -1 && ((fd_send = open(tx->devfile_send, O_RDONLY | O_NONBLOCK)) == -1))
+			fatal("psk31: Failed to open %s: %m\n", tx->devfile_send);
 #if 0
 		if (fd_ctrl == -1 && ((fd_ctrl = open(DEVFILE_CTRL, O_RDONLY | O_NONBLOCK)) == -1))
 			fatal("rpio-pwm: Failed to open %s: %m\n", DEVFILE_CTRL);
@@ -1216,25 +3062,66 @@ static void go_go_go(void) {
 		FD_ZERO(&readfs);
 		FD_ZERO(&writefs);
 		fd_max = 0;
-		if (sendcount < SENDSIZE) {
-			FD_SET(fd_send, &readfs);
-			fd_max = max(fd_max, fd_send);
+		/* No new input while stopping for a handoff, it waits for the new process */
+		if (handoff_state != HANDOFF_PENDING) {
+			if (tx->journal.base ? tx->queue.free && tx->queue.bytes < MSGQ_BYTES : sendcount < SENDSIZE) {
+				FD_SET(fd_send, &readfs);
+				fd_max = max(fd_max, fd_send);
+			}
+			fd_max = client_fd_set(fd_max, fd_sock, client_head, &readfs);
+			if (tx == tx_list && fd_handoff >= 0) {
+				FD_SET(fd_handoff, &readfs);
+				fd_max = max(fd_max, fd_handoff);
+			}
 		}
 		fd_max = stat_fd_set(fd_max, fd_stat, stat_head, &readfs, &writefs);
-		tv.tv_sec = 0;
-		tv.tv_usec = TS_US * TS_COUNT / 4;
-		n = select(fd_max + 1, &readfs, &writefs, NULL, &tv);
+		FD_SET(tx->handoff_event, &readfs);
+		fd_max = max(fd_max, tx->handoff_event);
+		tv.tv_sec = wait_us / 1000000;
+		tv.tv_usec = wait_us % 1000000;
+		/* Asleep, only the files and a scheduled message coming up wake the feeder */
+		sched_ns = tx->asleep ? tx_sched_wait_ns(tx) : INT64_MAX;
+		if (sched_ns != INT64_MAX) {
+			sched_ns = max(sched_ns, 0);
+			tv.tv_sec = sched_ns / 1000000000;
+			tv.tv_usec = sched_ns % 1000000000 / 1000;
+		}
+		t_select_ms = now_ms();
+		n = select(fd_max + 1, &readfs, &writefs, NULL, tx->asleep && sched_ns == INT64_MAX ? NULL : &tv);
 		if (n < 0)
 			fatal("psk31: select error: %m\n");
+		if (tx->asleep) {
+			tx->sleep_wakeups++;
+			t_input_ms = now_ms();
+		} else if (n == 0) {
+			late_record(tx, (now_ms() - t_select_ms) * 1000 - wait_us);
+		}
+		if (FD_ISSET(tx->handoff_event, &readfs) && read(tx->handoff_event, &event, sizeof(event)) < 0)
+			fatal("psk31: eventfd read error: %m\n");
+		if (tx == tx_list) {
+			handoff_accept(&readfs);
+			if (handoff_state == HANDOFF_PENDING && now_ms() - handoff_start_ms > HANDOFF_WAIT_MS)
+				handoff_end("messages still in flight");
+		}
 
 		/* Status */
-		stat_accept(fd_stat, &stat_head, &readfs, sendcount);
+		stat_accept(tx, fd_stat, &stat_head, &readfs, sendcount);
 		stat_write(&stat_head, &writefs);
 
+		/* Messages */
+		client_accept(fd_sock, &client_head, &readfs);
+		client_read(tx, &client_head, &readfs);
+
 		/* Fill in the buffer */
-		if (FD_ISSET(fd_send, &readfs))
+		if (FD_ISSET(fd_send, &readfs) && tx->journal.base) {
+			if ((ss = fifo_submit(tx, fd_send)) == 0) {
+				close(fd_send);
+				fd_send = -1;
+			} else if (ss == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
+				fatal("psk31: %s read error: %m\n", tx->devfile_send);
+			}
+		} else if (FD_ISSET(fd_send, &readfs))
 			while (sendcount < SENDSIZE) {
-				ssize_t ss;
 				int n;
 
 				n = SENDSIZE - sendcount;
@@ -1244,7 +3131,7 @@ static void go_go_go(void) {
 				if (ss == -1) {
 					if (errno == EAGAIN || errno == EWOULDBLOCK)
 						break;
-					fatal("rpio-pwm: %s read error: %m\n", DEVFILE_SEND);
+					fatal("rpio-pwm: %s read error: %m\n", tx->devfile_send);
 				} else if (ss <= 0) {
 					close(fd_send);
 					fd_send = -1;
@@ -1256,8 +3143,78 @@ static void go_go_go(void) {
 				}
 			}
 
-		/* Feed the hw */
-		for (n = TS_COUNT - 1 - tx_sym_pending(); n > 0; n--) {
+		/* Anything to send wakes the transmitter up */
+		if (tx->asleep) {
+			if (!sendcount && !msgq_ready(&tx->queue) && tx_sched_wait_ns(tx) > 0) {
+				if (handoff_state == HANDOFF_PENDING)
+					handoff_park(tx, fd_send, fd_stat, fd_sock, state, fill_timeout, curburst,
+						sendbuf, sendread, sendcount);
+				continue;
+			}
+			tx_wake(tx, t_input_ms);
+			state_logged = -1;
+		}
+
+		doppler_apply(tx);
+
+		/* Off the air once the last symbols queued have gone out */
+		if (option_sleep && option_timeout >= 0 && state == STATE_IDLE && !sendcount && !msgq_ready(&tx->queue) &&
+				tx_sched_wait_ns(tx) > 0 && !sent_head && !track_count && !tx->ptt_count && handoff_state != HANDOFF_PENDING) {
+			/* The PA and RF switch off from the chain, so that has to have run too */
+			if (tx_drained(tx) && (!tx->dma_reg[DMA_CONBLK_AD] || tx_position(tx, &t_ns) > tx->ptt_last))
+				tx_sleep(tx);
+			else
+				wait_us = BS_US / 2;
+			continue;
+		}
+
+		/* Feed the hw, all of the queue for a handoff, the longest the new process can take */
+		if (handoff_state == HANDOFF_PENDING)
+			tx->depth = ts_count - 1;
+		if (msgq_scheduled(&tx->queue))
+			pos = tx_position(tx, &t_ns);
+		if ((n = tx_sym_pending(tx)) < tx->margin_min && !tx->margin_skip)
+			tx->margin_min = n;
+		tx->margin_skip = 0;
+		for (n = tx->depth - n; n > 0; n--) {
+			/*
+			 * Scheduled start, checked every symbol. Once it is less than
+			 * a symbol away, a shortened steady symbol moves the symbol
+			 * grid onto it. The preamble, the fill and the carrier are cut
+			 * where they stand, a character is let finish. Late ones start
+			 * right away.
+			 */
+			if ((curburst.b_len == 0 || state != STATE_SEND) && (msg = msgq_scheduled(&tx->queue)) &&
+					!msgq_sched_running(&tx->queue)) {
+				gap = ((int64_t)(msg->start_ns - t_ns) + PULSE_WIDTH_INCR_US * 500) / (PULSE_WIDTH_INCR_US * 1000);
+				gap += (int64_t)(pos - tx->sample_next);
+				if (gap < BS_SAMPLES + max(ptt_lead[PTT_PA], ptt_lead[PTT_RF]))
+					ptt_key_up(tx, tx->sample_next + max(gap, 0));
+				if (gap >= BS_SAMPLES)
+					goto burst;
+				msgq_start(&tx->queue);
+				curburst.b_len = 0;
+				started = msg;
+				if (gap > 0) {
+					tx_sym_enqueue(tx, ts_next[tx->ts_last_sym][1], BS_SAMPLES - gap);
+					n--;
+				}
+				msg->start_sample = tx->sample_next;
+				if (state == STATE_IDLE || state == STATE_STOP || state == STATE_KEY || state == STATE_START) {
+					state = STATE_START;
+					curburst = starting_burst;
+				} else {
+					state = STATE_SEND;
+				}
+				if (n == 0)
+					break;
+			}
+burst:
+			/* Padding only tops up the shallow depth, text may come meanwhile */
+			if (curburst.b_len == 0 && !sendcount && !msgq_ready(&tx->queue) && tx->depth - n >= ts_depth_min &&
+					handoff_state != HANDOFF_PENDING)
+				break;
+
 			/* Get burst of bits to be sent */
 			while (curburst.b_len == 0) {
 				switch (state) {
@@ -1266,8 +3223,31 @@ static void go_go_go(void) {
 //						printf("state start->send\n");
 						break;
 					case STATE_SEND:
-						if (sendcount) {
+						/* Messages go first, the FIFO is the lowest priority */
+						if ((c = msgq_next_char(&tx->queue, &msg)) >= 0) {
+							curburst = varicode_table[c];
+							txlog_put(&tx->log, TXLOG_CHAR, c, msg->id, tx->sample_next);
+							if (msg->pos == 1 && !msg->start_ns)
+								msg->start_sample = tx->sample_next;
+							if (msg->jseq) {
+								if (track_count == ts_count) {
+									track_head = (track_head + 1) % ts_count;
+									track_count--;
+								}
+								k = (track_head + track_count++) % ts_count;
+								track[k].jseq = msg->jseq;
+								track[k].pos = msg->pos;
+								track[k].end_sample = tx->sample_next + curburst.b_len * BS_SAMPLES;
+							}
+							if (msg->pos == msg->len) {
+								/* Kept until it has been on air */
+								msg->end_sample = tx->sample_next + curburst.b_len * BS_SAMPLES;
+								*sent_tail = msg;
+								sent_tail = &msg->next;
+							}
+						} else if (sendcount) {
 							curburst = varicode_table[sendbuf[sendread]];
+							txlog_put(&tx->log, TXLOG_CHAR, sendbuf[sendread], 0, tx->sample_next);
 							sendcount--;
 							if (++sendread == SENDSIZE)
 								sendread = 0;
@@ -1279,7 +3259,7 @@ static void go_go_go(void) {
 						}
 						break;
 					case STATE_FILL:
-						if (sendcount) {
+						if (sendcount || msgq_ready(&tx->queue)) {
 							state = STATE_SEND;
 //							printf("state fill->send\n");
 						} else if (fill_timeout != 0) {
@@ -1295,12 +3275,24 @@ static void go_go_go(void) {
 						break;
 					case STATE_STOP:
 						state = STATE_IDLE;
+						ptt_key_down(tx, tx->sample_next);
 //						printf("state stop->idle\n");
 						break;
+					case STATE_KEY:
+						state = STATE_START;
+						curburst = starting_burst;
+						break;
 					case STATE_IDLE:
-						if (option_timeout < 0 || sendcount) {
-							state = STATE_START;
-							curburst = starting_burst;
+						if (option_timeout < 0 || sendcount || msgq_ready(&tx->queue)) {
+							/* Steady carrier while the PA and the RF switch come up */
+							if ((k = ptt_key_up(tx, 0) / BS_SAMPLES) > 0) {
+								state = STATE_KEY;
+								curburst.b_len = k;
+								curburst.b_val = (1 << k) - 1;
+							} else {
+								state = STATE_START;
+								curburst = starting_burst;
+							}
 //							printf("state idle->start\n");
 						} else {
 							curburst = idle_burst;
@@ -1310,11 +3302,62 @@ static void go_go_go(void) {
 				}
 			}
 
+			/* Only the states that get on air are logged */
+			if (state != state_logged) {
+				txlog_put(&tx->log, TXLOG_STATE, state, 0, tx->sample_next);
+				state_logged = state;
+			}
+
 			/* Send one bit from burst */
-			tx_sym_enqueue(ts_next[ts_last_sym][curburst.b_val & 1]);
+			tx_sym_enqueue(tx, ts_next[tx->ts_last_sym][curburst.b_val & 1], 0);
 			curburst.b_val >>= 1;
 			curburst.b_len--;
 		}
+
+		/*
+		 * Deeper while text is left over, so the feeder sleeps longer
+		 * through a long message, and back to shallow once it runs out.
+		 */
+		if (sendcount || msgq_ready(&tx->queue)) {
+			if (n <= 0)
+				tx->depth = tx->depth * 2 < ts_count - 1 ? tx->depth * 2 : ts_count - 1;
+		} else if (tx->depth > ts_depth_min) {
+			tx->depth = max(tx->depth / 2, ts_depth_min);
+		}
+
+		/* Completion events, and wake up in time for the next one */
+		wait_us = TS_US * (tx_sym_pending(tx) + 1) / 4;
+		if (sent_head || track_count || started)
+			pos = tx_position(tx, &t_ns);
+		/* The start is timed from a reading of the DMA just after it, not the one that placed it */
+		if (started && started->start_sample <= pos) {
+			started->start_seen_ns = tx_sample_time(started->start_sample, pos, t_ns);
+			started = NULL;
+		} else if (started && (started->start_sample - pos) * PULSE_WIDTH_INCR_US < wait_us) {
+			wait_us = (started->start_sample - pos) * PULSE_WIDTH_INCR_US + PULSE_WIDTH_INCR_US;
+		}
+		while (track_count && track[track_head].end_sample <= pos) {
+			journal_sent(&tx->journal, track[track_head].jseq, track[track_head].pos);
+			track_head = (track_head + 1) % ts_count;
+			track_count--;
+		}
+		if (sent_head) {
+			while (sent_head && (end = sent_head->end_sample) <= pos) {
+				msg = sent_head;
+				if (!(sent_head = msg->next))
+					sent_tail = &sent_head;
+				client_done(client_head, msg, pos, t_ns);
+				journal_done(&tx->journal, msg->jseq);
+				msgq_release(&tx->queue, msg);
+			}
+			if (sent_head && (end - pos) * PULSE_WIDTH_INCR_US < wait_us)
+				wait_us = (end - pos) * PULSE_WIDTH_INCR_US;
+		}
+
+		/* The queue is full and only the FIFO is left: stop here for a handoff */
+		if (handoff_state == HANDOFF_PENDING && !tx->queue.count && !sent_head && !track_count)
+			handoff_park(tx, fd_send, fd_stat, fd_sock, state, fill_timeout, curburst,
+				sendbuf, sendread, sendcount);
 	}
 #if 0
 finish:
@@ -1323,20 +3366,301 @@ finish:
 #endif
 }
 
+static void *tx_thread(void *arg) {
+	go_go_go((tx_t *)arg);
+	return NULL;
+}
+
+/*
+ * Polar mode feeder: the I/Q of the ring, resampled to the sample rate of
+ * the DMA, goes into the CB ring as soon as it is there. When it runs dry
+ * silence keeps the DMA POLAR_LEAD_MIN samples ahead.
+ */
+static void polar_go(tx_t *tx) {
+	float in[2 * POLAR_BLOCK], out[2 * (POLAR_BLOCK + 2)];
+	uint32_t div[POLAR_BLOCK + 2];
+	uint8_t up[POLAR_BLOCK + 2];
+	uint64_t dma, next;
+	uint32_t slot, slot_last;
+	unsigned rate = 1000000 / PULSE_WIDTH_INCR_US;
+	unsigned n, k, late = 0;
+	int64_t room;
+	resample_t rs;
+	iqring_t r;
+
+	if (iqring_attach(&r, option_polar) < 0)
+		fatal("psk31: Failed to open %s: %m\n", option_polar);
+	if (r.hdr->rate != rate && resample_init(&rs, r.hdr->rate, rate, 16) < 0)
+		fatal("psk31: Cannot resample %u Hz to %u Hz: %m\n", r.hdr->rate, rate);
+	printf("Polar:                %s, %u Hz%s\n", option_polar, r.hdr->rate,
+		r.hdr->rate != rate ? ", resampled" : "");
+	fflush(stdout);
+	rt_setup(tx);
+	slot_last = (cb_phys_to_offset(tx->dma_reg[DMA_CONBLK_AD]) - tx->cb_base) / (POLAR_CBS * sizeof(dma_cb_t));
+	dma = slot_last;
+	next = dma + POLAR_LEAD_MIN;
+	for (;;) {
+		/* Where the DMA is, counted on from the last time */
+		slot = (cb_phys_to_offset(tx->dma_reg[DMA_CONBLK_AD]) - tx->cb_base) / (POLAR_CBS * sizeof(dma_cb_t));
+		dma += (slot - slot_last) & (POLAR_RING - 1);
+		slot_last = slot;
+		if (next < dma + POLAR_GUARD) {
+			printf("Polar:                late, the DMA played %llu old samples (%u times)\n",
+				(unsigned long long)(dma + POLAR_GUARD - next), ++late);
+			fflush(stdout);
+			next = dma + POLAR_LEAD_MIN;
+		}
+
+		/* Everything there is, up to the ring */
+		room = dma + POLAR_RING - POLAR_GUARD - next;
+		while (room > POLAR_BLOCK + 2) {
+			if (r.hdr->rate == rate) {
+				if (!(n = iqring_read_float(&r, out, POLAR_BLOCK)))
+					break;
+			} else {
+				/* Input that fills out at most, and no more than in holds */
+				k = POLAR_BLOCK * rs.down / rs.up;
+				if (!(k = iqring_read_float(&r, in, k < POLAR_BLOCK ? k : POLAR_BLOCK)))
+					break;
+				n = resample_run(&rs, in, k, out);
+			}
+			polar_run(&tx->polar, out, n, div, up);
+			polar_write(tx, next, div, up, n);
+			next += n;
+			room -= n;
+		}
+		if (next < dma + POLAR_LEAD_MIN) {
+			polar_silence(tx, next, dma + POLAR_LEAD_MIN - next);
+			next = dma + POLAR_LEAD_MIN;
+		}
+		usleep(POLAR_WAIT_US);
+	}
+}
+
+/*
+ * Extra transmitter, "name=<s>,clock=<n>,dma=<n>,gpio=<pos>:<neg>,frequency=<f>,clock-div=<n>".
+ * It gets the pacing peripheral the first transmitter does not use.
+ */
+static void tx_add(char *spec) {
+	enum { TX_NAME, TX_CLOCK, TX_DMA, TX_GPIO, TX_FREQUENCY, TX_DIV };
+	char *const tokens[] = {
+		[TX_NAME] = "name",
+		[TX_CLOCK] = "clock",
+		[TX_DMA] = "dma",
+		[TX_GPIO] = "gpio",
+		[TX_FREQUENCY] = "frequency",
+		[TX_DIV] = "clock-div",
+		NULL
+	};
+	char *value;
+	tx_t *tx;
+
+	if (tx_count == TX_MAX)
+		fatal("psk31: At most %d transmitters, one per PWM and PCM\n", TX_MAX);
+	tx = &tx_list[tx_count];
+	snprintf(tx->name, sizeof(tx->name), "tx%d", tx_count);
+	tx->gpclk = tx_count;
+	tx->dma_chan = 4 + tx_count;
+	tx->gpio_pos = 22;
+	tx->gpio_neg = 27;
+	while (*spec) {
+		switch (getsubopt(&spec, tokens, &value)) {
+			case TX_NAME:
+				if (!value || !*value || strlen(value) >= sizeof(tx->name) || strchr(value, '/'))
+					fatal("psk31: invalid transmitter name\n");
+				strcpy(tx->name, value);
+				break;
+			case TX_CLOCK:
+				tx->gpclk = value ? atoi(value) : -1;
+				break;
+			case TX_DMA:
+				tx->dma_chan = value ? atoi(value) : -1;
+				break;
+			case TX_GPIO:
+				if (!value || sscanf(value, "%d:%d", &tx->gpio_pos, &tx->gpio_neg) != 2)
+					fatal("psk31: gpio needs <pos>:<neg>\n");
+				break;
+			case TX_FREQUENCY:
+				tx->frequency = value ? atof(value) : 0;
+				break;
+			case TX_DIV:
+				tx->div = value ? atoi(value) : 0;
+				break;
+			default:
+				fatal("psk31: invalid transmitter option %s\n", value);
+		}
+	}
+	tx_count++;
+}
+
+/*
+ * PTT of the first transmitter, "pa=<gpio>,rf=<gpio>,rf2=<gpio>,pa-lead=<ms>,
+ * rf-lead=<ms>,pa-lag=<ms>,rf-lag=<ms>". rf2 is the other line of an RF
+ * switch that takes a complementary pair.
+ */
+static void ptt_add(char *spec) {
+	enum { PTT_PA_LEAD = PTT_RF2 + 1, PTT_RF_LEAD, PTT_PA_LAG, PTT_RF_LAG };
+	char *const tokens[] = {
+		[PTT_PA] = "pa",
+		[PTT_RF] = "rf",
+		[PTT_RF2] = "rf2",
+		[PTT_PA_LEAD] = "pa-lead",
+		[PTT_RF_LEAD] = "rf-lead",
+		[PTT_PA_LAG] = "pa-lag",
+		[PTT_RF_LAG] = "rf-lag",
+		NULL
+	};
+	char *value;
+	int opt, ms;
+
+	while (*spec) {
+		opt = getsubopt(&spec, tokens, &value);
+		if (opt < 0 || !value)
+			fatal("psk31: invalid PTT option %s\n", value);
+		ms = atoi(value);
+		switch (opt) {
+			case PTT_PA:
+			case PTT_RF:
+			case PTT_RF2:
+				if (ms < 0 || ms > 31)
+					fatal("psk31: invalid PTT GPIO %d\n", ms);
+				ptt_gpio[opt] = ms;
+				break;
+			case PTT_PA_LEAD:
+			case PTT_RF_LEAD:
+				if (ms < 0 || ms > PTT_LEAD_MAX_MS)
+					fatal("psk31: PTT lead %d ms, at most %d\n", ms, PTT_LEAD_MAX_MS);
+				ptt_lead[opt - PTT_PA_LEAD] = ms * 1000 / PULSE_WIDTH_INCR_US;
+				break;
+			case PTT_PA_LAG:
+			case PTT_RF_LAG:
+				if (ms < 0)
+					fatal("psk31: invalid PTT lag %d ms\n", ms);
+				ptt_lag[opt - PTT_PA_LAG] = ms * 1000 / PULSE_WIDTH_INCR_US;
+				break;
+		}
+	}
+	option_ptt = 1;
+}
+
+// Check that no two transmitters share hardware, and name their device files
+static void tx_setup(void) {
+	tx_t *tx, *t;
+	int i, k;
+
+	if (option_polar && (tx_count > 1 || option_serial))
+		fatal("psk31: --polar needs a single transmitter, without --serial\n");
+	if (option_polar && option_handoff)
+		fatal("psk31: --handoff does not take over polar mode\n");
+	if (option_ptt && option_polar)
+		fatal("psk31: --ptt needs the symbol chains, not --polar\n");
+	if (option_ptt && ptt_gpio[PTT_PA] < 0 && ptt_gpio[PTT_RF] < 0)
+		fatal("psk31: --ptt needs pa or rf\n");
+	if (ptt_gpio[PTT_RF2] >= 0 && ptt_gpio[PTT_RF] < 0)
+		fatal("psk31: --ptt rf2 goes with rf\n");
+	/* The symbols of the serializer are built for one pair of outputs */
+	if (option_serial) {
+		if (tx_count > 1 || tx_list[0].delay_hw != DELAY_VIA_PWM)
+			fatal("psk31: --serial needs a single transmitter, on PWM\n");
+		tx_list[0].gpio_pos = SERIAL_GPIO_POS;
+		tx_list[0].gpio_neg = SERIAL_GPIO_NEG;
+	}
+	for (tx = tx_list; tx < &tx_list[tx_count]; tx++) {
+		if (tx > tx_list)
+			tx->delay_hw = tx_list[0].delay_hw == DELAY_VIA_PWM ? DELAY_VIA_PCM : DELAY_VIA_PWM;
+		if (tx->gpclk < 0 || tx->gpclk >= ARRAY_SIZE(gpclk_gpio))
+			fatal("psk31: invalid clock %d\n", tx->gpclk);
+		if (tx->dma_chan < 0 || tx->dma_chan > DMA_CHAN_MAX)
+			fatal("psk31: invalid DMA channel %d\n", tx->dma_chan);
+		if (tx->gpio_pos < 0 || tx->gpio_pos > 31 || tx->gpio_neg < 0 || tx->gpio_neg > 31 ||
+				tx->gpio_pos == tx->gpio_neg)
+			fatal("psk31: invalid GPIO pair %d:%d\n", tx->gpio_pos, tx->gpio_neg);
+		for (t = tx_list; t < tx; t++)
+			if (t->gpclk == tx->gpclk || t->dma_chan == tx->dma_chan ||
+					!strcmp(t->name, tx->name) ||
+					t->gpio_pos == tx->gpio_pos || t->gpio_pos == tx->gpio_neg ||
+					t->gpio_neg == tx->gpio_pos || t->gpio_neg == tx->gpio_neg)
+				fatal("psk31: transmitters %d and %d share hardware\n", (int)(t - tx_list), (int)(tx - tx_list));
+		for (t = tx_list; t < &tx_list[tx_count]; t++)
+			if (t != tx && (gpclk_gpio[tx->gpclk] == t->gpio_pos || gpclk_gpio[tx->gpclk] == t->gpio_neg))
+				fatal("psk31: GPIO %d is the clock output of transmitter %d\n",
+					gpclk_gpio[tx->gpclk], (int)(tx - tx_list));
+		if (tx->name[0]) {
+			snprintf(tx->devfile_send, sizeof(tx->devfile_send), "/dev/psk31.%.15s.data", tx->name);
+			snprintf(tx->devfile_ctrl, sizeof(tx->devfile_ctrl), "/dev/psk31.%.15s.ctrl", tx->name);
+			snprintf(tx->devfile_stat, sizeof(tx->devfile_stat), "/dev/psk31.%.15s.stat", tx->name);
+			snprintf(tx->devfile_sock, sizeof(tx->devfile_sock), "/dev/psk31.%.15s.sock", tx->name);
+		} else {
+			strcpy(tx->devfile_send, DEVFILE_SEND);
+			strcpy(tx->devfile_ctrl, DEVFILE_CTRL);
+			strcpy(tx->devfile_stat, DEVFILE_STAT);
+			strcpy(tx->devfile_sock, DEVFILE_SOCK);
+		}
+		if (option_iq_tap && tx->name[0])
+			snprintf(tx->iq_path, sizeof(tx->iq_path), "%.62s.%.15s", option_iq_tap, tx->name);
+		else if (option_iq_tap)
+			snprintf(tx->iq_path, sizeof(tx->iq_path), "%.79s", option_iq_tap);
+		if (option_log && tx->name[0])
+			snprintf(tx->log_path, sizeof(tx->log_path), "%.62s.%.15s", option_log, tx->name);
+		else if (option_log)
+			snprintf(tx->log_path, sizeof(tx->log_path), "%.79s", option_log);
+		if (option_journal && tx->name[0])
+			snprintf(tx->journal_path, sizeof(tx->journal_path), "%.62s.%.15s", option_journal, tx->name);
+		else if (option_journal)
+			snprintf(tx->journal_path, sizeof(tx->journal_path), "%.79s", option_journal);
+	}
+	/* The lines of the PTT, once the transmitters have their outputs */
+	for (i = PTT_PA; i <= PTT_RF2; i++) {
+		if (ptt_gpio[i] < 0)
+			continue;
+		for (k = PTT_PA; k < i; k++)
+			if (ptt_gpio[k] == ptt_gpio[i])
+				fatal("psk31: PTT GPIO %d twice\n", ptt_gpio[i]);
+		for (tx = tx_list; tx < &tx_list[tx_count]; tx++)
+			if (ptt_gpio[i] == tx->gpio_pos || ptt_gpio[i] == tx->gpio_neg ||
+					ptt_gpio[i] == gpclk_gpio[tx->gpclk])
+				fatal("psk31: PTT GPIO %d is in use by transmitter %d\n", ptt_gpio[i],
+					(int)(tx - tx_list));
+	}
+}
+
 static const struct option long_options[] = {
 	{"amplitude", required_argument, NULL, 'a'},
 	{"clock-div", required_argument, NULL, 'd'},
+	{"cpu", required_argument, NULL, 'C'},
+	{"doppler", required_argument, NULL, 'D'},
 	{"frequency", required_argument, NULL, 'f'},
+	{"handoff", no_argument, NULL, 'H'},
 	{"help", no_argument, NULL, 'h'},
+	{"iq-tap", required_argument, NULL, 'q'},
+	{"journal", required_argument, NULL, 'j'},
+	{"lo-frequency", required_argument, NULL, 'l'},
+	{"log", required_argument, NULL, 'g'},
+	{"lo-startup", required_argument, NULL, 'L'},
 	{"mash", required_argument, NULL, 'm'},
+	{"memory", required_argument, NULL, 'M'},
 	{"pcm", no_argument, NULL, 'p'},
+	{"polar", required_argument, NULL, 'o'},
+	{"predistort", required_argument, NULL, 'P'},
+	{"ptt", required_argument, NULL, 'K'},
+	{"queue", required_argument, NULL, 'Q'},
 	{"rc", required_argument, NULL, 'r'},
+	{"realtime", required_argument, NULL, 'F'},
+	{"replay", required_argument, NULL, 'R'},
+	{"serial", required_argument, NULL, 'B'},
+	{"shape", required_argument, NULL, 'S'},
+	{"si570", required_argument, NULL, 's'},
+	{"sleep", no_argument, NULL, 'z'},
+	{"threads", required_argument, NULL, 'T'},
 	{"timeout", required_argument, NULL, 't'},
+	{"tx", required_argument, NULL, 'x'},
 	{NULL, 0, NULL, 0}
 };
 
 int main(int argc, char **argv) {
-	pi = atan(1) * 4;
+	double t_ms;
+	tx_t *tx;
+	int i;
 
 	while (1) {
 		int opt;
@@ -1351,10 +3675,16 @@ int main(int argc, char **argv) {
 				option_amplitude = atof(optarg);
 				break;
 			case 'd':
-				option_div = atoi(optarg);
+				tx_list[0].div = atoi(optarg);
+				break;
+			case 'D':
+				option_doppler = optarg;
 				break;
 			case 'f':
-				option_frequency = atof(optarg);
+				tx_list[0].frequency = atof(optarg);
+				break;
+			case 'H':
+				option_handoff = 1;
 				break;
 			case 'h':
 				fprintf(stderr,
@@ -1362,82 +3692,271 @@ int main(int argc, char **argv) {
 					"  --amplitude=<n>     Signal amplitude (0 .. 1]\n"
 					"  --clock-div=<n>     Fractional divisor for carrier [4096 .. 16773120]\n"
 					"                      Note: frequency = 500 MHz / (clock-div / 4096)\n"
+					"  --cpu=<n>           Run the feeders on CPU <n> only, the disk threads elsewhere\n"
+					"  --doppler=<file>    Doppler trajectory to apply to the carriers\n"
 					"  --frequency=<f>     Carrier frequency, in MHz [0.125 .. 500]\n"
 					"                      Note: this is overridden by clock-div\n"
+					"  --handoff           Take over the DMA of the running psk31, which then exits;\n"
+					"                      the settings have to be the same\n"
 					"  --help              Show this help\n"
+					"  --iq-tap=<file>     Ring of the modelled output for other processes,\n"
+					"                      e.g. /dev/shm/psk31.iq; see iqring.h\n"
+					"  --journal=<file>    Keep the queued messages in <file> and resume them on a\n"
+					"                      restart; a second transmitter uses <file>.<name>\n"
+					"  --lo-frequency=<f>  Si570 local oscillator frequency, in MHz [10 .. 945]\n"
+					"  --log=<file>        Log every symbol sent; a second transmitter uses <file>.<name>\n"
+					"  --lo-startup=<f>    Si570 factory startup frequency, in MHz [10]\n"
 					"  --mash=<n>          Set number of MASH stages [0 .. 3]\n"
+					"  --memory=<kind>     DMA memory: auto, mbox, huge or pages [auto]\n"
 					"  --pcm               Use PCM clock instead of PWM clock for signal generation\n"
+					"  --polar=<ring>      Send the I/Q of the ring, as carrier frequency and envelope\n"
+					"  --predistort=<file> PA calibration, \"<input dBm> <output dBm>\" per line\n"
+					"  --ptt=<spec>        Switch the PA and the RF switch of the first transmitter\n"
+					"                      from the DMA: pa=<gpio>,rf=<gpio>,rf2=<gpio>,\n"
+					"                      pa-lead=<ms>,rf-lead=<ms>,pa-lag=<ms>,rf-lag=<ms>\n"
+					"                      [5, 10, 5, 10 ms; leads up to 500]\n"
+					"  --queue=[<min>:]<n> DMA queue of <n> symbols [4 .. 128, a power of 2],\n"
+					"                      <min> of them while typing [8:16]; a slot takes\n"
+					"                      about 600 kB, all transmitters at most 128 MB\n"
 					"  --rc=<f>            Set signal filter RC value (s)\n"
-					"  --timeout=<n>       Number of zeros before switching off. 0 for infinite.\n");
+					"  --realtime=<n>      Feeders at SCHED_FIFO priority <n> [1 .. 99], memory locked\n"
+					"  --replay=<file>     Generate the waveform of a log again, as float samples\n"
+					"                      on stdout, and print what was sent\n"
+					"  --serial=<n>        Shift <n> bits per sample out of the PWM serializer on\n"
+					"                      GPIO 18:19 [32 .. 256, a power of 2]\n"
+					"  --shape=<s>         Transition shape, or a file with one value per line [rc]\n");
+				shape_list();
+				fprintf(stderr,
+					"  --si570=<dev>       I2C adapter of the Si570 local oscillator\n"
+					"  --sleep             Stop the DMA and the clocks while idle, with --timeout\n"
+					"  --threads=<n>       Threads building the DMA waveforms [number of CPUs]\n"
+					"  --timeout=<n>       Number of zeros before switching off. 0 for infinite.\n"
+					"  --tx=<spec>         Second transmitter, on the other of PWM and PCM:\n"
+					"                      name=<s>,clock=<0..2>,dma=<n>,gpio=<pos>:<neg>,\n"
+					"                      frequency=<f>,clock-div=<n>\n"
+					"                      [tx1,1,5,22:27]; data goes to /dev/psk31.<name>.data\n");
 				return 0;
+			case 'q':
+				option_iq_tap = optarg;
+				break;
+			case 'j':
+				option_journal = optarg;
+				break;
+			case 'g':
+				option_log = optarg;
+				break;
+			case 'l':
+				option_lo_frequency = atof(optarg);
+				break;
+			case 'L':
+				option_lo_startup = atof(optarg);
+				break;
 			case 'm':
 				option_mash = atoi(optarg);
 				break;
+			case 'M':
+				for (mem_kind = 0; mem_kind < ARRAY_SIZE(mem_names); mem_kind++)
+					if (strcmp(optarg, mem_names[mem_kind]) == 0)
+						break;
+				if (mem_kind == ARRAY_SIZE(mem_names))
+					fatal("psk31: invalid memory kind %s\n", optarg);
+				break;
+			case 'K':
+				ptt_add(optarg);
+				break;
+			case 'o':
+				option_polar = optarg;
+				break;
 			case 'p':
-				delay_hw = DELAY_VIA_PCM;
+				tx_list[0].delay_hw = DELAY_VIA_PCM;
+				break;
+			case 'B':
+				option_serial = atoi(optarg);
+				if (option_serial < 32 || option_serial > 256 || (option_serial & (option_serial - 1)))
+					fatal("psk31: invalid serializer bits %s\n", optarg);
+				break;
+			case 'C':
+				option_cpu = atoi(optarg);
+				break;
+			case 'F':
+				option_rt_priority = atoi(optarg);
+				if (option_rt_priority < 1 || option_rt_priority > 99)
+					fatal("psk31: invalid real-time priority %s\n", optarg);
+				break;
+			case 'P':
+				option_predistort = optarg;
+				break;
+			case 'Q':
+				if (sscanf(optarg, "%d:%d", &ts_depth_min, &ts_count) == 1) {
+					ts_count = ts_depth_min;
+					ts_depth_min = ts_count / 2 < 8 ? ts_count / 2 : 8;
+				}
+				if (ts_count < 4 || ts_count > TS_MAX || (ts_count & (ts_count - 1)) ||
+						ts_depth_min < 1 || ts_depth_min >= ts_count)
+					fatal("psk31: invalid queue %s\n", optarg);
 				break;
 			case 'r':
 				option_rc = atof(optarg);
 				break;
+			case 'R':
+				return replay(optarg) ? 1 : ptt_check(optarg);
+			case 'S':
+				option_shape = optarg;
+				break;
+			case 's':
+				option_si570 = optarg;
+				break;
+			case 'T':
+				option_threads = atoi(optarg);
+				break;
 			case 't':
 				option_timeout = atoi(optarg);
 				break;
+			case 'x':
+				tx_add(optarg);
+				break;
+			case 'z':
+				option_sleep = 1;
+				break;
 			default:
 				fatal("psk31: invalid options\n");
 		}
 	}
 
-	printf("Using hardware:       %s\n", delay_hw == DELAY_VIA_PWM ? "PWM" : "PCM");
+	tx_setup();
+	printf("Using hardware:       %s\n", tx_list[0].delay_hw == DELAY_VIA_PWM ? "PWM" : "PCM");
+	if (option_serial)
+		printf("Serializer:           %d bits per sample, %.1f MHz, GPIO %d:%d\n", option_serial,
+			(double)option_serial / PULSE_WIDTH_INCR_US, SERIAL_GPIO_POS, SERIAL_GPIO_NEG);
+	if (option_ptt)
+		printf("PTT:                  GPIO pa %d, rf %d, rf2 %d; lead %d/%d ms, lag %d/%d ms\n",
+			ptt_gpio[PTT_PA], ptt_gpio[PTT_RF], ptt_gpio[PTT_RF2],
+			ptt_lead[PTT_PA] * PULSE_WIDTH_INCR_US / 1000, ptt_lead[PTT_RF] * PULSE_WIDTH_INCR_US / 1000,
+			ptt_lag[PTT_PA] * PULSE_WIDTH_INCR_US / 1000, ptt_lag[PTT_RF] * PULSE_WIDTH_INCR_US / 1000);
 	printf("RC:                   %fs\n", option_rc);
 	printf("Amplitude:            %f\n", option_amplitude);
-	printf("Timeout:              %d\n", option_timeout);
+	printf("Timeout:              %d%s\n", option_timeout, option_sleep ? ", sleep when idle" : "");
+	printf("Shape:                %s\n", option_shape);
 	printf("Symbol time:          %dus\n", BS_US);
-	printf("Buffer time:          %dus\n", TS_COUNT * TS_US);
-	printf("Clock div:            %d\n", option_div);
+	printf("Queue:                %d to %d symbols, %dms to %dms\n", ts_depth_min, ts_count - 1,
+		ts_depth_min * TS_US / 1000, (ts_count - 1) * TS_US / 1000);
+	printf("Clock div:            %d\n", tx_list[0].div);
 	printf("Mash:                 %d\n", option_mash);
-	printf("Frequency:            %f\n", option_frequency);
+	printf("Frequency:            %f\n", tx_list[0].frequency);
+	for (tx = &tx_list[1]; tx < &tx_list[tx_count]; tx++)
+		printf("Transmitter %s:%*s GPCLK%d, DMA %d, GPIO %d/%d, %s, %f\n", tx->name,
+			(int)(8 - strlen(tx->name)), "", tx->gpclk, tx->dma_chan, tx->gpio_pos, tx->gpio_neg,
+			tx->delay_hw == DELAY_VIA_PWM ? "PWM" : "PCM", tx->frequency);
+	if (option_si570)
+		printf("LO frequency:         %f\n", option_lo_frequency);
+	if (option_doppler)
+		printf("Doppler:              %s\n", option_doppler);
+	if (option_rt_priority || option_cpu >= 0) {
+		printf("Real time:            ");
+		if (option_rt_priority)
+			printf("SCHED_FIFO %d, memory locked%s", option_rt_priority, option_cpu >= 0 ? ", " : "");
+		if (option_cpu >= 0)
+			printf("CPU %d", option_cpu);
+		printf("\n");
+	}
+	if (option_predistort) {
+		if (predistort_load(&pd, option_predistort) < 0)
+			fatal("psk31: Failed to load %s: %m\n", option_predistort);
+		pd_active = 1;
+		printf("Predistortion:        %d points, %.1fdB gain, %.1fdB compression\n",
+			pd.points, pd.gain_db, pd.compression_db);
+	}
 
 	setup_sighandlers();
 
-	dma_reg = map_peripheral(DMA_BASE, DMA_LEN);
+	dma_base_reg = map_peripheral(DMA_BASE, DMA_CHAN_LEN);
+	for (tx = tx_list; tx < &tx_list[tx_count]; tx++)
+		tx->dma_reg = dma_base_reg + tx->dma_chan * 0x100 / 4;
 	pwm_reg = map_peripheral(PWM_BASE, PWM_LEN);
 	pcm_reg = map_peripheral(PCM_BASE, PCM_LEN);
 	clk_reg = map_peripheral(CLK_BASE, CLK_LEN);
 	gpio_reg = map_peripheral(GPIO_BASE, GPIO_LEN);
 
-	/* TODO: retrieve PAGE_SIZE from system */
-	virtbase = mmap(NULL, NUM_PAGES * PAGE_SIZE, PROT_READ|PROT_WRITE,
-	        MAP_SHARED|MAP_ANONYMOUS|MAP_NORESERVE|MAP_LOCKED,
-	        -1, 0);
-	if (virtbase == MAP_FAILED)
-		fatal("rpio-pwm: Failed to mmap physical pages: %m\n");
-	if ((unsigned long)virtbase & (PAGE_SIZE-1))
-		fatal("rpio-pwm: Virtual address is not page aligned\n");
-
-	make_pagemap();
-	make_physinfo();
-
-	gpio_set(GPIO_POS_NUM, 1);
-	gpio_set(GPIO_NEG_NUM, 0);
-	gpio_set_mode(GPIO_POS_NUM, GPIO_MODE_OUT);
-	gpio_set_mode(GPIO_NEG_NUM, GPIO_MODE_OUT);
-
-	clock_start();
-
-	init_ctrl_data();
-	printf("Max. error:           %fmV\n", level_error_max * 3300);
-	init_hardware();
-
-	devfiles_unlink();
-	devfiles_create();
+	/* The symbol models are shared by all transmitters and size the DMA memory */
+	init_waveforms();
+	/* Nothing has been started yet, and with --handoff the clocks are the old process's */
+	if ((size_t)num_pages * PAGE_SIZE > (size_t)DMA_MEM_MAX_MB << 20) {
+		fprintf(stderr, "psk31: --queue=%d takes %zu MB of DMA memory, more than %d MB\n", ts_count,
+			((size_t)num_pages * PAGE_SIZE) >> 20, DMA_MEM_MAX_MB);
+		exit(1);
+	}
+	t_ms = now_ms();
+	if (option_handoff) {
+		handoff_take();
+	} else {
+		mem_alloc();
+		make_pagemap();
+		make_physinfo();
+	}
+	printf("DMA memory:           %s, %s, %d pages in %.1fms\n", mem_names[mem_kind],
+		mem_contiguous ? "contiguous" : "scattered", num_pages, now_ms() - t_ms);
+
+	/* After a handoff the clocks, the GPIOs, the LO and the DMA are running already */
+	if (option_handoff) {
+		doppler_load();
+		handoff_adopt();
+		printf("Handoff:              from process %d, %d symbols queued, %.1fms\n", (int)handoff.pid,
+			tx_list[0].asleep ? 0 : tx_sym_pending(tx_list), now_ms() - t_ms);
+	} else {
+		for (tx = tx_list; tx < &tx_list[tx_count]; tx++) {
+			gpio_set(tx->gpio_pos, 1);
+			gpio_set(tx->gpio_neg, 0);
+			gpio_set_mode(tx->gpio_pos, TX_GPIO_MODE);
+			gpio_set_mode(tx->gpio_neg, TX_GPIO_MODE);
+			clock_start(tx);
+		}
+		if (option_ptt) {
+			ptt_off();
+			for (i = PTT_PA; i <= PTT_RF2; i++)
+				if (ptt_gpio[i] >= 0)
+					gpio_set_mode(ptt_gpio[i], GPIO_MODE_OUT);
+		}
+		lo_start();
+		doppler_load();
+
+		t_ms = now_ms();
+		init_ctrl_data();
+		printf("DMA waveforms:        %d threads, %.1fms\n", ctrl_threads, now_ms() - t_ms);
+		printf("Max. error:           %fmV\n", level_error_max * 3300);
+		for (tx = tx_list; tx < &tx_list[tx_count]; tx++)
+			init_hardware(tx);
+
+		devfiles_unlink();
+		devfiles_create();
+		/* Only root may take the hardware over */
+		if (!option_polar) {
+			fd_handoff = sock_listen(DEVFILE_HANDOFF, SOCK_STREAM);
+			if (chmod(DEVFILE_HANDOFF, 0600) < 0)
+				fatal("psk31: failed to set permissions on %s: %m\n", DEVFILE_HANDOFF);
+		}
+	}
 
 	if (daemon(0,1) < 0)
 		fatal("rpio-pwm: Failed to daemonize process: %m\n");
-
-	go_go_go();
+	/* After the fork, locks are not inherited */
+	if (option_rt_priority && mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+		fatal("psk31: Failed to lock memory: %m\n");
+
+	for (tx = tx_list; tx < &tx_list[tx_count]; tx++)
+		if ((tx->handoff_event = eventfd(0, EFD_NONBLOCK)) < 0)
+			fatal("psk31: eventfd error: %m\n");
+	/* The first transmitter is fed from here, the others from their own threads */
+	for (tx = &tx_list[1]; tx < &tx_list[tx_count]; tx++)
+		if (pthread_create(&tx->thread, NULL, tx_thread, tx) != 0)
+			fatal("psk31: Failed to start feeder of %s: %m\n", tx->name);
+	if (option_polar)
+		polar_go(tx_list);
+	else
+		go_go_go(tx_list);
 
 	term_hardware();
-	clock_stop();
+	for (tx = tx_list; tx < &tx_list[tx_count]; tx++)
+		clock_stop(tx);
 	devfiles_unlink();
 
 	return 0;
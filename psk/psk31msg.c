@@ -0,0 +1,301 @@
+/*
+ * Submit text to psk31 as framed messages, see psk31msg.h.
+ *
+ * The text comes from the command line, or from stdin when there is none.
+ * Long text is cut into several messages of the same priority, which stay
+ * in order. A full queue is retried with --wait, otherwise it is an error.
+ * With --done it waits until the text has been on air and prints when, and
+ * --monitor prints the completion of every message. --at schedules the text
+ * to start at a given time.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "psk31msg.h"
+
+#define RETRY_US        250000
+
+static const struct option long_options[] = {
+	{"at", required_argument, NULL, 'a'},
+	{"done", no_argument, NULL, 'd'},
+	{"help", no_argument, NULL, 'h'},
+	{"id", required_argument, NULL, 'i'},
+	{"monitor", no_argument, NULL, 'm'},
+	{"priority", required_argument, NULL, 'p'},
+	{"socket", required_argument, NULL, 's'},
+	{"tx", required_argument, NULL, 'x'},
+	{"wait", no_argument, NULL, 'w'},
+	{NULL, 0, NULL, 0}
+};
+
+static const char *prio_names[PSK31_PRIO_COUNT] = {"bulk", "normal", "high", "urgent"};
+
+static int events;              /* Completion events received */
+
+/*
+ * Start time: "+<s>" from now, "next:<s>" for the next multiple of <s> since
+ * the epoch (next:120 for even minutes), "@<unix s>", or UTC as
+ * "YYYY-mm-ddTHH:MM:SS". Seconds can have a fraction.
+ */
+static uint64_t parse_time(const char *str) {
+	struct timespec now;
+	struct tm tm;
+	double frac = 0;
+	const char *p;
+	uint64_t n, t;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	t = now.tv_sec * 1000000000ULL + now.tv_nsec;
+	if (str[0] == '+')
+		return t + (uint64_t)(atof(str + 1) * 1e9);
+	if (strncmp(str, "next:", 5) == 0) {
+		if ((n = atof(str + 5) * 1e9) == 0)
+			return 0;
+		return (t / n + 1) * n;
+	}
+	if (str[0] == '@')
+		return (uint64_t)(atof(str + 1) * 1e9);
+	memset(&tm, 0, sizeof(tm));
+	if (!(p = strptime(str, "%Y-%m-%dT%H:%M:%S", &tm)))
+		return 0;
+	if (*p == '.')
+		frac = atof(p);
+	return (uint64_t)timegm(&tm) * 1000000000ULL + (uint64_t)(frac * 1e9 + 0.5);
+}
+
+static void print_time(uint64_t ns) {
+	time_t t = ns / 1000000000;
+	char buf[32];
+
+	strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", gmtime(&t));
+	printf("%s.%06u", buf, (unsigned)(ns % 1000000000 / 1000));
+}
+
+// Receive a reply (0) or a completion event (1), which is printed
+static int receive(int fd, psk31_reply_t *r) {
+	union {
+		psk31_reply_t r;
+		psk31_event_t e;
+	} u;
+	ssize_t ss;
+
+	if ((ss = recv(fd, &u, sizeof(u), 0)) < (ssize_t)sizeof(u.r)) {
+		fprintf(stderr, "psk31msg: no reply\n");
+		return -1;
+	}
+	if (u.r.type != PSK31_EVENT_DONE || ss != sizeof(u.e)) {
+		*r = u.r;
+		return 0;
+	}
+	printf("%u %s %u bytes, ", u.e.id, prio_names[u.e.priority % PSK31_PRIO_COUNT], u.e.length);
+	print_time(u.e.start_ns);
+	printf(" .. ");
+	print_time(u.e.end_ns);
+	printf(" UTC, %.3fs", (u.e.end_ns - u.e.start_ns) / 1e9);
+	if (u.e.start_error_ns)
+		printf(", start error %+.1fus", u.e.start_error_ns / 1000.0);
+	printf("\n");
+	fflush(stdout);
+	events++;
+	return 1;
+}
+
+static int submit(int fd, uint32_t id, int priority, uint64_t start_ns, const char *text, int len, int wait) {
+	uint8_t buf[sizeof(psk31_msg_t) + PSK31_TEXT_MAX];
+	psk31_msg_t *m = (psk31_msg_t *)buf;
+	psk31_reply_t r;
+	int k;
+
+	m->id = id;
+	m->type = PSK31_MSG_SUBMIT;
+	m->priority = priority;
+	m->length = len;
+	m->start_ns = start_ns;
+	memcpy(m + 1, text, len);
+	for (;;) {
+		if (send(fd, buf, sizeof(*m) + len, 0) == -1) {
+			fprintf(stderr, "psk31msg: send: %m\n");
+			return -1;
+		}
+		while ((k = receive(fd, &r)) == 1)
+			;
+		if (k < 0)
+			return -1;
+		switch (r.type) {
+			case PSK31_REPLY_QUEUED:
+				return 0;
+			case PSK31_REPLY_FULL:
+				if (!wait) {
+					fprintf(stderr, "psk31msg: queue full, %u bytes free\n", r.space);
+					return -1;
+				}
+				usleep(RETRY_US);
+				break;
+			default:
+				fprintf(stderr, "psk31msg: message %u refused\n", id);
+				return -1;
+		}
+	}
+}
+
+int main(int argc, char **argv) {
+	struct sockaddr_un addr = {
+		.sun_family = AF_UNIX,
+	};
+	const char *sock = NULL;
+	const char *tx = NULL;
+	uint32_t id = getpid() << 16;
+	int priority = PSK31_PRIO_NORMAL;
+	int wait = 0;
+	int done = 0;
+	int monitor = 0;
+	uint64_t start_ns = 0;
+	uint32_t first;
+	psk31_reply_t r;
+	char *text;
+	size_t len, size;
+	int fd, i, n;
+
+	while (1) {
+		int opt;
+		int opt_index;
+
+		opt_index = 0;
+		opt = getopt_long(argc, argv, "a:dhi:mp:s:wx:", long_options, &opt_index);
+		if (opt == -1)
+			break;
+		switch (opt) {
+			case 'a':
+				if (!(start_ns = parse_time(optarg))) {
+					fprintf(stderr, "psk31msg: invalid time %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'd':
+				done = 1;
+				break;
+			case 'h':
+				fprintf(stderr,
+					"Usage: psk31msg [options] [text ...]\n"
+					"Options:\n"
+					"  --at=<time>         Start at +<s> from now, next:<s> for the next multiple\n"
+					"                      of <s>, @<unix s> or YYYY-mm-ddTHH:MM:SS UTC\n"
+					"  --done              Wait until the text has been sent, print when\n"
+					"  --help              Show this help\n"
+					"  --id=<n>            Id of the first message [pid << 16]\n"
+					"  --monitor           Print when each message of any producer was sent\n"
+					"  --priority=<p>      bulk, normal, high, urgent or 0 .. 3 [normal]\n"
+					"  --socket=<path>     Submission socket [/dev/psk31.sock]\n"
+					"  --tx=<name>         Second transmitter, /dev/psk31.<name>.sock\n"
+					"  --wait              Retry while the queue is full\n");
+				return 0;
+			case 'i':
+				id = strtoul(optarg, NULL, 0);
+				break;
+			case 'm':
+				monitor = 1;
+				break;
+			case 'p':
+				for (priority = 0; priority < PSK31_PRIO_COUNT; priority++)
+					if (strcmp(optarg, prio_names[priority]) == 0)
+						break;
+				if (priority == PSK31_PRIO_COUNT)
+					priority = atoi(optarg);
+				if (priority < 0 || priority >= PSK31_PRIO_COUNT) {
+					fprintf(stderr, "psk31msg: invalid priority %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 's':
+				sock = optarg;
+				break;
+			case 'w':
+				wait = 1;
+				break;
+			case 'x':
+				tx = optarg;
+				break;
+			default:
+				fprintf(stderr, "psk31msg: invalid options\n");
+				return 1;
+		}
+	}
+
+	if (sock)
+		snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", sock);
+	else if (tx)
+		snprintf(addr.sun_path, sizeof(addr.sun_path), "/dev/psk31.%s.sock", tx);
+	else
+		snprintf(addr.sun_path, sizeof(addr.sun_path), "/dev/psk31.sock");
+
+	if ((fd = socket(AF_UNIX, SOCK_SEQPACKET, 0)) == -1 ||
+			connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+		fprintf(stderr, "psk31msg: cannot connect to %s: %m\n", addr.sun_path);
+		return 1;
+	}
+	if (monitor) {
+		psk31_msg_t m = {
+			.id = id,
+			.type = PSK31_MSG_SUBSCRIBE,
+		};
+
+		if (send(fd, &m, sizeof(m), 0) == -1) {
+			fprintf(stderr, "psk31msg: send: %m\n");
+			return 1;
+		}
+		/* Only events follow, so this returns when the daemon goes away */
+		while (receive(fd, &r) >= 0)
+			;
+		return 0;
+	}
+
+	/* Text from the arguments, separated by spaces, or all of stdin */
+	size = 4096;
+	len = 0;
+	if (!(text = malloc(size)))
+		return 1;
+	if (optind < argc) {
+		for (i = optind; i < argc; i++) {
+			n = strlen(argv[i]);
+			while (len + n + 1 >= size)
+				if (!(text = realloc(text, size *= 2)))
+					return 1;
+			if (i > optind)
+				text[len++] = ' ';
+			memcpy(text + len, argv[i], n);
+			len += n;
+		}
+	} else {
+		while ((n = fread(text + len, 1, size - len, stdin)) > 0)
+			if ((len += n) == size && !(text = realloc(text, size *= 2)))
+				return 1;
+	}
+	if (len == 0)
+		return 0;
+
+	first = id;
+	if (start_ns && len > PSK31_TEXT_MAX) {
+		fprintf(stderr, "psk31msg: a scheduled message has at most %d bytes\n", PSK31_TEXT_MAX);
+		return 1;
+	}
+	for (i = 0; i < len; i += n, id++) {
+		n = len - i > PSK31_TEXT_MAX ? PSK31_TEXT_MAX : len - i;
+		if (submit(fd, id, priority, start_ns, text + i, n, wait) < 0)
+			return 2;
+	}
+	/* The events of our own messages come back on this connection */
+	while (done && events < id - first)
+		if (receive(fd, &r) < 0)
+			return 2;
+	close(fd);
+	free(text);
+	return 0;
+}
@@ -0,0 +1,87 @@
+/*
+ * Message submission protocol of psk31.
+ *
+ * Producers connect a SOCK_SEQPACKET socket to /dev/psk31.sock (or
+ * /dev/psk31.<name>.sock for a second transmitter), so every send() is one
+ * message and messages from different producers never interleave. A message
+ * is a psk31_msg_t followed by the text. The daemon answers each one with a
+ * psk31_reply_t carrying the same id.
+ *
+ * Messages are sent highest priority first. A message of higher priority
+ * pre-empts the one on air at the next character boundary; the pre-empted
+ * message resumes once the higher priorities are empty. Equal priorities go
+ * in order of arrival. When the queue is full the message is refused with
+ * PSK31_REPLY_FULL and nothing of it is queued; the producer retries later.
+ *
+ * Once the last symbol of a message has been on air, the producer gets a
+ * psk31_event_t with the times its first symbol started and its last symbol
+ * ended. They come from the position of the DMA, so they are exact to a
+ * sample (10 us) whenever the events are delivered. A connection that sends
+ * PSK31_MSG_SUBSCRIBE gets the events of all messages.
+ *
+ * A message with a start time waits for it instead of its turn. The symbol
+ * grid is shifted so that its first symbol, the first reversal of the
+ * preamble when the transmitter was idle, starts on air at that time to
+ * within a sample. Idle time, the preamble and the fill are cut at the
+ * symbol the start falls in, but a character of other text on air is let
+ * finish, which delays the start by up to a character, 14 symbols. It then
+ * runs to its end without being pre-empted, so a scheduled message whose
+ * start falls while an earlier one is still being sent waits for it, and
+ * starts late. The measured error of the start is in its completion event.
+ */
+#ifndef PSK31MSG_H
+#define PSK31MSG_H
+
+#include <stdint.h>
+
+#define PSK31_TEXT_MAX  1024
+
+enum {
+	PSK31_PRIO_BULK,
+	PSK31_PRIO_NORMAL,
+	PSK31_PRIO_HIGH,
+	PSK31_PRIO_URGENT,
+	PSK31_PRIO_COUNT
+};
+
+enum {
+	PSK31_MSG_SUBMIT = 1,
+	PSK31_MSG_SUBSCRIBE,    /* No text */
+};
+
+typedef struct {
+	uint32_t id;            /* Chosen by the producer, echoed in replies */
+	uint8_t type;           /* PSK31_MSG_* */
+	uint8_t priority;       /* PSK31_PRIO_* */
+	uint16_t length;        /* Bytes of text after the header */
+	uint64_t start_ns;      /* CLOCK_REALTIME to start at, 0 for its turn */
+} psk31_msg_t;
+
+enum {
+	PSK31_REPLY_QUEUED = 1,
+	PSK31_REPLY_FULL,       /* Queue full, retry later */
+	PSK31_REPLY_INVALID,    /* Malformed message */
+	PSK31_REPLY_SUBSCRIBED,
+	PSK31_EVENT_DONE,       /* A psk31_event_t */
+};
+
+typedef struct {
+	uint32_t id;
+	uint8_t type;           /* PSK31_REPLY_* */
+	uint8_t pad;
+	uint16_t messages;      /* Messages queued, this one included */
+	uint32_t bytes;         /* Bytes queued, this one included */
+	uint32_t space;         /* Bytes that can still be queued */
+} psk31_reply_t;
+
+typedef struct {
+	uint32_t id;
+	uint8_t type;           /* PSK31_EVENT_DONE */
+	uint8_t priority;
+	uint16_t length;
+	uint64_t start_ns;      /* On air, CLOCK_REALTIME */
+	uint64_t end_ns;
+	int64_t start_error_ns; /* Start on air minus the scheduled start */
+} psk31_event_t;
+
+#endif
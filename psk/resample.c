@@ -0,0 +1,135 @@
+/*
+ * Polyphase rational resampler. See resample.h.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include "resample.h"
+
+#define RESAMPLE_BETA   8.0     /* Kaiser window, about 80 dB down */
+#define RESAMPLE_CUTOFF 0.45    /* Of the lower rate */
+
+typedef float v4sf __attribute__((vector_size(16)));
+
+static unsigned gcd(unsigned a, unsigned b) {
+	unsigned t;
+
+	while (b) {
+		t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+// Modified Bessel function of the first kind, order 0
+static double bessel_i0(double x) {
+	double sum = 1, term = 1;
+	int k;
+
+	for (k = 1; k < 100 && term > 1e-12 * sum; k++) {
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum += term;
+	}
+	return sum;
+}
+
+int resample_init(resample_t *r, unsigned in_rate, unsigned out_rate, unsigned taps) {
+	unsigned g, len, k, j, p;
+	double fc, x, h, sum;
+	double *proto;
+
+	memset(r, 0, sizeof(*r));
+	if (!in_rate || !out_rate || !taps) {
+		errno = EINVAL;
+		return -1;
+	}
+	g = gcd(in_rate, out_rate);
+	r->up = out_rate / g;
+	r->down = in_rate / g;
+	if (r->down > r->up)
+		taps = (unsigned)((unsigned long long)taps * r->down / r->up);
+	r->taps = taps = (taps + 3) & ~3u;
+	len = taps * r->up;
+
+	/* Windowed sinc at up times the input rate */
+	if (!(proto = malloc(len * sizeof(double))))
+		return -1;
+	fc = RESAMPLE_CUTOFF / (r->up > r->down ? r->up : r->down);
+	sum = 0;
+	for (k = 0; k < len; k++) {
+		x = k - (len - 1) / 2.0;
+		h = x == 0 ? 2 * fc : sin(2 * M_PI * fc * x) / (M_PI * x);
+		x = 2.0 * k / (len - 1) - 1;
+		h *= bessel_i0(RESAMPLE_BETA * sqrt(1 - x * x)) / bessel_i0(RESAMPLE_BETA);
+		proto[k] = h;
+		sum += h;
+	}
+
+	/* Cut into phases, each tap twice, scaled for a gain of 1 */
+	if (posix_memalign((void **)&r->bank, 16, (size_t)len * 2 * sizeof(float)) ||
+			!(r->line = calloc((size_t)taps * 4, sizeof(float)))) {
+		free(proto);
+		resample_free(r);
+		errno = ENOMEM;
+		return -1;
+	}
+	for (k = 0; k < len; k++) {
+		p = k % r->up;
+		j = k / r->up;
+		h = proto[k] * r->up / sum;
+		r->bank[(p * taps + taps - 1 - j) * 2] = h;
+		r->bank[(p * taps + taps - 1 - j) * 2 + 1] = h;
+	}
+	free(proto);
+	return 0;
+}
+
+static inline v4sf load(const float *p) {
+	v4sf v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+// n floats of the phase h times the window x, summed apart for I and Q
+static inline void dot(const float *h, const float *x, unsigned n, float *out) {
+	v4sf a = {0, 0, 0, 0}, b = {0, 0, 0, 0};
+	unsigned i;
+
+	for (i = 0; i < n; i += 8) {
+		a += *(const v4sf *)(h + i) * load(x + i);
+		b += *(const v4sf *)(h + i + 4) * load(x + i + 4);
+	}
+	a += b;
+	out[0] = a[0] + a[2];
+	out[1] = a[1] + a[3];
+}
+
+unsigned resample_run(resample_t *r, const float *in, unsigned n, float *out) {
+	unsigned i, done = 0, len = r->taps * 2;
+	const float *w;
+	float *f;
+
+	for (i = 0; i < n; i++) {
+		if (++r->pos == r->taps)
+			r->pos = 0;
+		f = r->line + r->pos * 2;
+		f[0] = f[len] = in[i * 2];
+		f[1] = f[len + 1] = in[i * 2 + 1];
+		/* The newest frame is at pos + taps */
+		w = f + 2;
+		for (; r->phase < r->up; r->phase += r->down, done++)
+			dot(r->bank + r->phase * len, w, len, out + done * 2);
+		r->phase -= r->up;
+	}
+	return done;
+}
+
+void resample_free(resample_t *r) {
+	free(r->bank);
+	free(r->line);
+	r->bank = NULL;
+	r->line = NULL;
+}
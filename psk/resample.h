@@ -0,0 +1,36 @@
+/*
+ * Polyphase rational resampler for I/Q, from one rate to another by up/down.
+ *
+ * A PSK31 signal is a few tens of hertz wide, so a modulator can work at a
+ * low rate (1 kHz, 32 samples a symbol) and leave the codec rate to this.
+ * The lowpass filter is designed once, at up times the input rate, and cut
+ * into up phases; every output sample is the inner product of one phase
+ * with the newest input, so the zeros of the upsampling are never computed.
+ * The phases hold every tap twice, for I and for Q, to match the frames in
+ * the delay line, and the inner product is done four floats at a time with
+ * the vector extension of GCC, which is NEON or SSE as the target has.
+ */
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+typedef struct {
+	unsigned up, down;      /* Reduced ratio */
+	unsigned taps;          /* Per phase, a multiple of 4 */
+	float *bank;            /* up phases of taps I/Q pairs, newest last */
+	float *line;            /* Delay line, kept twice over so it never wraps */
+	unsigned pos;
+	unsigned phase;
+} resample_t;
+
+/* Output frames for n input frames, at most */
+#define RESAMPLE_OUT_MAX(r, n)  (((n) * (r)->up + (r)->down - 1) / (r)->down + 1)
+
+// taps per phase when interpolating, in proportion more when decimating
+int resample_init(resample_t *r, unsigned in_rate, unsigned out_rate, unsigned taps);
+
+// n interleaved I/Q frames in, the number of frames out returned
+unsigned resample_run(resample_t *r, const float *in, unsigned n, float *out);
+
+void resample_free(resample_t *r);
+
+#endif
@@ -0,0 +1,88 @@
+/*
+ * Sigma-delta model of the GPIO output. See sdmodel.h.
+ */
+#include <math.h>
+#include "sdmodel.h"
+
+double sdmodel_decay(double sample_us, double rc) {
+	return exp(-sample_us / (1000000.0 * rc));
+}
+
+double sdmodel_symbol(const double *level, int samples, double decay, uint8_t *up) {
+	double v_old, v_new, v, v_error, error_max;
+	int i;
+
+	v_old = level[0];
+	error_max = 0;
+	for (i = 0; i < samples; i++) {
+		/* Get new target value */
+		v = level[i + 1];
+		up[i] = (v > v_old);
+		v_new = v_old * decay;
+		if (up[i])
+			v_new += 1.0 - decay;
+		/* Compute error statistics */
+		v_error = fabs(v - v_new);
+		if (v_error > error_max)
+			error_max = v_error;
+		v_old = v_new;
+	}
+	return error_max;
+}
+
+int sdmodel_step(double level, double decay, double *v) {
+	int up = level > *v;
+
+	*v *= decay;
+	if (up)
+		*v += 1.0 - decay;
+	return up;
+}
+
+double sdmodel_serial(const double *level, int samples, int oversample, double decay, uint32_t *fifo) {
+	double v_old, v_new, v, v_error, error_max;
+	uint32_t word = 0;
+	int i, k, n = 0;
+
+	v_old = level[0];
+	error_max = 0;
+	for (i = 0; i < samples; i++) {
+		for (k = 1; k <= oversample; k++) {
+			v = level[i] + (level[i + 1] - level[i]) * k / oversample;
+			word = word << 1 | (v > v_old);
+			v_new = v_old * decay;
+			if (v > v_old)
+				v_new += 1.0 - decay;
+			v_error = fabs(v - v_new);
+			if (v_error > error_max)
+				error_max = v_error;
+			v_old = v_new;
+			/* The channels take the words in turn */
+			if (++n == 32) {
+				*fifo++ = word;
+				*fifo++ = ~word;
+				n = 0;
+			}
+		}
+	}
+	return error_max;
+}
+
+int sdmodel_serializer(const uint32_t *fifo, int words, int oversample, double decay, double *v, float *out) {
+	uint32_t pos, neg;
+	int i, b, n = 0, samples = 0;
+
+	for (i = 0; i + 1 < words; i += 2) {
+		pos = fifo[i];
+		neg = fifo[i + 1];
+		for (b = 31; b >= 0; b--) {
+			/* Both outputs alike leave the filter at the middle */
+			*v = *v * decay + (1.0 - decay) * (1 + (int)(pos >> b & 1) - (int)(neg >> b & 1)) / 2;
+			if (++n == oversample) {
+				out[samples++] = *v;
+				n = 0;
+			}
+		}
+	}
+	return samples;
+}
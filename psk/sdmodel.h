@@ -0,0 +1,40 @@
+/*
+ * Model of a GPIO pair driven by a 1 bit sigma-delta behind an RC filter.
+ *
+ * Every sample the output goes up when the wanted level is above what the
+ * filter holds, down otherwise. The model gives those bits for a symbol
+ * from its table of levels, and how far the filter strays from the table.
+ * It is what the DMA waveforms are built from, and what the waveform of a
+ * log is generated again with, so both agree with each other and with the
+ * parameter sweep.
+ *
+ * In serializer mode the PWM shifts out precomputed bits instead, many per
+ * sample, on two channels: the positive output on the first, its complement
+ * on the second. The model gives the FIFO words for that, and plays FIFO
+ * words back the way the serializer does, so the output can be checked
+ * without the hardware.
+ */
+#ifndef SDMODEL_H
+#define SDMODEL_H
+
+#include <stdint.h>
+
+// Filter decay over one sample
+double sdmodel_decay(double sample_us, double rc);
+
+// Bits for samples + 1 levels, starting at level[0]; returns the largest error
+double sdmodel_symbol(const double *level, int samples, double decay, uint8_t *up);
+
+// The bit for one level of a stream, the filter holding *v
+int sdmodel_step(double level, double decay, double *v);
+
+// FIFO words for samples * oversample bits, the levels interpolated between
+// samples and decay over one bit; returns the largest error
+double sdmodel_serial(const double *level, int samples, int oversample, double decay, uint32_t *fifo);
+
+// Serializer output of FIFO words, whole samples of them, through the filter
+// holding *v; the filter at the end of every sample goes to out. Returns the
+// samples.
+int sdmodel_serializer(const uint32_t *fifo, int words, int oversample, double decay, double *v, float *out);
+
+#endif
@@ -0,0 +1,421 @@
+/*
+ * SGP4 orbit propagation. See sgp4.h.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "sgp4.h"
+
+/* WGS-72 constants, as used to generate the element sets */
+#define RE              6378.135        /* km */
+#define MU              398600.8        /* km^3/s^2 */
+#define J2              0.001082616
+#define J3              -0.00000253881
+#define J4              -0.00000165597
+#define J3OJ2           (J3 / J2)
+#define X2O3            (2.0 / 3.0)
+#define TWOPI           (2.0 * M_PI)
+#define DEG2RAD         (M_PI / 180.0)
+#define OMEGA_EARTH     7.29211514670698e-5     /* rad/s */
+
+/* WGS-84 ellipsoid for the ground station */
+#define WGS84_A         6378.137
+#define WGS84_F         (1.0 / 298.257223563)
+
+static double xke;
+static double vkmpersec;
+
+// Julian date of a fractional day of year, 1.0 being January 1st 0h UT
+static double jday(int year, double doy) {
+	return 367.0 * year - floor(7.0 * (year + floor(10.0 / 12.0)) * 0.25) +
+		floor(275.0 / 9.0) + 1721013.5 + doy;
+}
+
+static double jd_to_unix(double jd) {
+	return (jd - 2440587.5) * 86400.0;
+}
+
+// Greenwich mean sidereal time, in rad
+static double gstime(double t) {
+	double jd = t / 86400.0 + 2440587.5;
+	double tut1 = (jd - 2451545.0) / 36525.0;
+	double temp;
+
+	temp = -6.2e-6 * tut1 * tut1 * tut1 + 0.093104 * tut1 * tut1 +
+		(876600.0 * 3600 + 8640184.812866) * tut1 + 67310.54841;
+	temp = fmod(temp * DEG2RAD / 240.0, TWOPI);
+	if (temp < 0.0)
+		temp += TWOPI;
+	return temp;
+}
+
+// Fixed column field of a TLE line, columns are 1 based and inclusive
+static double tle_field(const char *line, int c1, int c2) {
+	char buf[32];
+	int n = c2 - c1 + 1;
+
+	memcpy(buf, line + c1 - 1, n);
+	buf[n] = 0;
+	return atof(buf);
+}
+
+// Field with implied decimal point and exponent, " 12345-3" = 0.12345e-3
+static double tle_exp_field(const char *line, int c1) {
+	char buf[16];
+	int i, n;
+
+	n = 0;
+	if (line[c1 - 1] == '-')
+		buf[n++] = '-';
+	buf[n++] = '.';
+	for (i = 0; i < 5; i++)
+		buf[n++] = line[c1 + i];
+	buf[n++] = 'e';
+	for (i = 6; i < 8; i++)
+		buf[n++] = line[c1 - 1 + i];
+	buf[n] = 0;
+	return atof(buf);
+}
+
+static int tle_checksum(const char *line) {
+	int i, sum = 0;
+
+	for (i = 0; i < 68; i++) {
+		if (line[i] >= '0' && line[i] <= '9')
+			sum += line[i] - '0';
+		else if (line[i] == '-')
+			sum++;
+	}
+	return (sum % 10) == line[68] - '0';
+}
+
+int sgp4_parse_tle(sgp4_t *sat, const char *line1, const char *line2) {
+	int year;
+	double doy;
+
+	if (strlen(line1) < 69 || strlen(line2) < 69 || line1[0] != '1' || line2[0] != '2')
+		return -1;
+	if (!tle_checksum(line1) || !tle_checksum(line2))
+		return -1;
+	year = (int)tle_field(line1, 19, 20);
+	year += year < 57 ? 2000 : 1900;
+	doy = tle_field(line1, 21, 32);
+	sat->epoch = jd_to_unix(jday(year, doy));
+	sat->bstar = tle_exp_field(line1, 54);
+	sat->inclo = tle_field(line2, 9, 16) * DEG2RAD;
+	sat->nodeo = tle_field(line2, 18, 25) * DEG2RAD;
+	sat->ecco = tle_field(line2, 27, 33) * 1e-7;
+	sat->argpo = tle_field(line2, 35, 42) * DEG2RAD;
+	sat->mo = tle_field(line2, 44, 51) * DEG2RAD;
+	sat->no = tle_field(line2, 53, 63) * TWOPI / 1440.0;
+	return 0;
+}
+
+int sgp4_init(sgp4_t *s) {
+	double eccsq, omeosq, rteosq, cosio, cosio2, cosio4, sinio;
+	double ak, d1, del, adel, po, posq, rp, con42;
+	double ss, qzms2t, sfour, qzms24, perige, pinvsq, tsi, etasq, eeta, psisq;
+	double coef, coef1, cc2, cc3, temp1, temp2, temp3, xhdot1;
+
+	xke = 60.0 / sqrt(RE * RE * RE / MU);
+	vkmpersec = RE * xke / 60.0;
+
+	/* Recover the original mean motion and semi-major axis */
+	eccsq = s->ecco * s->ecco;
+	omeosq = 1.0 - eccsq;
+	rteosq = sqrt(omeosq);
+	cosio = cos(s->inclo);
+	cosio2 = cosio * cosio;
+	ak = pow(xke / s->no, X2O3);
+	d1 = 0.75 * J2 * (3.0 * cosio2 - 1.0) / (rteosq * omeosq);
+	del = d1 / (ak * ak);
+	adel = ak * (1.0 - del * del - del * (1.0 / 3.0 + 134.0 * del * del / 81.0));
+	del = d1 / (adel * adel);
+	s->no = s->no / (1.0 + del);
+	if (TWOPI / s->no >= 225.0)
+		return -1;
+	s->ao = pow(xke / s->no, X2O3);
+	sinio = sin(s->inclo);
+	s->sinio = sinio;
+	s->cosio = cosio;
+	po = s->ao * omeosq;
+	con42 = 1.0 - 5.0 * cosio2;
+	s->con41 = -con42 - cosio2 - cosio2;
+	posq = po * po;
+	rp = s->ao * (1.0 - s->ecco);
+	if (rp < 1.0)
+		return -1;
+
+	/* Perigee below 220 km uses the simplified drag terms */
+	s->isimp = (rp < 220.0 / RE + 1.0);
+	ss = 78.0 / RE + 1.0;
+	qzms2t = pow((120.0 - 78.0) / RE, 4);
+	sfour = ss;
+	qzms24 = qzms2t;
+	perige = (rp - 1.0) * RE;
+	if (perige < 156.0) {
+		sfour = perige - 78.0;
+		if (perige < 98.0)
+			sfour = 20.0;
+		qzms24 = pow((120.0 - sfour) / RE, 4.0);
+		sfour = sfour / RE + 1.0;
+	}
+	pinvsq = 1.0 / posq;
+	tsi = 1.0 / (s->ao - sfour);
+	s->eta = s->ao * s->ecco * tsi;
+	etasq = s->eta * s->eta;
+	eeta = s->ecco * s->eta;
+	psisq = fabs(1.0 - etasq);
+	coef = qzms24 * pow(tsi, 4.0);
+	coef1 = coef / pow(psisq, 3.5);
+	cc2 = coef1 * s->no * (s->ao * (1.0 + 1.5 * etasq + eeta * (4.0 + etasq)) +
+		0.375 * J2 * tsi / psisq * s->con41 * (8.0 + 3.0 * etasq * (8.0 + etasq)));
+	s->cc1 = s->bstar * cc2;
+	cc3 = 0.0;
+	if (s->ecco > 1.0e-4)
+		cc3 = -2.0 * coef * tsi * J3OJ2 * s->no * sinio / s->ecco;
+	s->x1mth2 = 1.0 - cosio2;
+	s->cc4 = 2.0 * s->no * coef1 * s->ao * omeosq *
+		(s->eta * (2.0 + 0.5 * etasq) + s->ecco * (0.5 + 2.0 * etasq) -
+		J2 * tsi / (s->ao * psisq) * (-3.0 * s->con41 * (1.0 - 2.0 * eeta + etasq * (1.5 - 0.5 * eeta)) +
+		0.75 * s->x1mth2 * (2.0 * etasq - eeta * (1.0 + etasq)) * cos(2.0 * s->argpo)));
+	s->cc5 = 2.0 * coef1 * s->ao * omeosq * (1.0 + 2.75 * (etasq + eeta) + eeta * etasq);
+	cosio4 = cosio2 * cosio2;
+	temp1 = 1.5 * J2 * pinvsq * s->no;
+	temp2 = 0.5 * temp1 * J2 * pinvsq;
+	temp3 = -0.46875 * J4 * pinvsq * pinvsq * s->no;
+	s->mdot = s->no + 0.5 * temp1 * rteosq * s->con41 +
+		0.0625 * temp2 * rteosq * (13.0 - 78.0 * cosio2 + 137.0 * cosio4);
+	s->argpdot = -0.5 * temp1 * con42 + 0.0625 * temp2 * (7.0 - 114.0 * cosio2 + 395.0 * cosio4) +
+		temp3 * (3.0 - 36.0 * cosio2 + 49.0 * cosio4);
+	xhdot1 = -temp1 * cosio;
+	s->nodedot = xhdot1 + (0.5 * temp2 * (4.0 - 19.0 * cosio2) + 2.0 * temp3 * (3.0 - 7.0 * cosio2)) * cosio;
+	s->omgcof = s->bstar * cc3 * cos(s->argpo);
+	s->xmcof = 0.0;
+	if (s->ecco > 1.0e-4)
+		s->xmcof = -X2O3 * coef * s->bstar / eeta;
+	s->nodecf = 3.5 * omeosq * xhdot1 * s->cc1;
+	s->t2cof = 1.5 * s->cc1;
+	if (fabs(cosio + 1.0) > 1.5e-12)
+		s->xlcof = -0.25 * J3OJ2 * sinio * (3.0 + 5.0 * cosio) / (1.0 + cosio);
+	else
+		s->xlcof = -0.25 * J3OJ2 * sinio * (3.0 + 5.0 * cosio) / 1.5e-12;
+	s->aycof = -0.5 * J3OJ2 * sinio;
+	s->delmo = pow(1.0 + s->eta * cos(s->mo), 3);
+	s->sinmao = sin(s->mo);
+	s->x7thm1 = 7.0 * cosio2 - 1.0;
+	if (!s->isimp) {
+		double cc1sq = s->cc1 * s->cc1;
+		double temp;
+
+		s->d2 = 4.0 * s->ao * tsi * cc1sq;
+		temp = s->d2 * tsi * s->cc1 / 3.0;
+		s->d3 = (17.0 * s->ao + sfour) * temp;
+		s->d4 = 0.5 * temp * s->ao * tsi * (221.0 * s->ao + 31.0 * sfour) * s->cc1;
+		s->t3cof = s->d2 + 2.0 * cc1sq;
+		s->t4cof = 0.25 * (3.0 * s->d3 + s->cc1 * (12.0 * s->d2 + 10.0 * cc1sq));
+		s->t5cof = 0.2 * (3.0 * s->d4 + 12.0 * s->cc1 * s->d3 + 6.0 * s->d2 * s->d2 +
+			15.0 * cc1sq * (2.0 * s->d2 + cc1sq));
+	}
+	return 0;
+}
+
+// Position (km) and velocity (km/s) in TEME, tsince minutes from epoch
+int sgp4_propagate(const sgp4_t *s, double t, double r[3], double v[3]) {
+	double xmdf, argpdf, nodedf, argpm, mm, t2, nodem, tempa, tempe, templ;
+	double am, nm, em, xlm, axnl, aynl, xl, u, eo1, tem5, sineo1, coseo1;
+	double ecose, esine, el2, pl, rl, rdotl, rvdotl, betal, temp, temp1, temp2;
+	double sinu, cosu, su, sin2u, cos2u, mrt, xnode, xinc, mvt, rvdot;
+	double sinsu, cossu, snod, cnod, sini, cosi, xmx, xmy, ux, uy, uz, vx, vy, vz;
+	double cosip, sinip;
+	int ktr;
+
+	/* Secular gravity and atmospheric drag */
+	xmdf = s->mo + s->mdot * t;
+	argpdf = s->argpo + s->argpdot * t;
+	nodedf = s->nodeo + s->nodedot * t;
+	argpm = argpdf;
+	mm = xmdf;
+	t2 = t * t;
+	nodem = nodedf + s->nodecf * t2;
+	tempa = 1.0 - s->cc1 * t;
+	tempe = s->bstar * s->cc4 * t;
+	templ = s->t2cof * t2;
+	if (!s->isimp) {
+		double delomg = s->omgcof * t;
+		double delm = 1.0 + s->eta * cos(xmdf);
+		double t3 = t2 * t, t4 = t3 * t;
+
+		delm = s->xmcof * (delm * delm * delm - s->delmo);
+		temp = delomg + delm;
+		mm = xmdf + temp;
+		argpm = argpdf - temp;
+		tempa = tempa - s->d2 * t2 - s->d3 * t3 - s->d4 * t4;
+		tempe = tempe + s->bstar * s->cc5 * (sin(mm) - s->sinmao);
+		templ = templ + s->t3cof * t3 + t4 * (s->t4cof + t * s->t5cof);
+	}
+	am = s->ao * tempa * tempa;
+	nm = xke / (am * sqrt(am));
+	em = s->ecco - tempe;
+	if (em >= 1.0 || em < -0.001 || am < 0.95)
+		return -1;
+	if (em < 1.0e-6)
+		em = 1.0e-6;
+	mm = mm + s->no * templ;
+	xlm = mm + argpm + nodem;
+	nodem = fmod(nodem, TWOPI);
+	argpm = fmod(argpm, TWOPI);
+	xlm = fmod(xlm, TWOPI);
+	mm = fmod(xlm - argpm - nodem, TWOPI);
+
+	/* Long period periodics */
+	sinip = s->sinio;
+	cosip = s->cosio;
+	axnl = em * cos(argpm);
+	temp = 1.0 / (am * (1.0 - em * em));
+	aynl = em * sin(argpm) + temp * s->aycof;
+	xl = mm + argpm + nodem + temp * s->xlcof * axnl;
+
+	/* Kepler's equation */
+	u = fmod(xl - nodem, TWOPI);
+	eo1 = u;
+	tem5 = 9999.9;
+	ktr = 1;
+	sineo1 = coseo1 = 0;
+	while (fabs(tem5) >= 1.0e-12 && ktr <= 10) {
+		sineo1 = sin(eo1);
+		coseo1 = cos(eo1);
+		tem5 = 1.0 - coseo1 * axnl - sineo1 * aynl;
+		tem5 = (u - aynl * coseo1 + axnl * sineo1 - eo1) / tem5;
+		if (fabs(tem5) >= 0.95)
+			tem5 = tem5 > 0.0 ? 0.95 : -0.95;
+		eo1 += tem5;
+		ktr++;
+	}
+
+	/* Short period periodics */
+	ecose = axnl * coseo1 + aynl * sineo1;
+	esine = axnl * sineo1 - aynl * coseo1;
+	el2 = axnl * axnl + aynl * aynl;
+	pl = am * (1.0 - el2);
+	if (pl < 0.0)
+		return -1;
+	rl = am * (1.0 - ecose);
+	rdotl = sqrt(am) * esine / rl;
+	rvdotl = sqrt(pl) / rl;
+	betal = sqrt(1.0 - el2);
+	temp = esine / (1.0 + betal);
+	sinu = am / rl * (sineo1 - aynl - axnl * temp);
+	cosu = am / rl * (coseo1 - axnl + aynl * temp);
+	su = atan2(sinu, cosu);
+	sin2u = (cosu + cosu) * sinu;
+	cos2u = 1.0 - 2.0 * sinu * sinu;
+	temp = 1.0 / pl;
+	temp1 = 0.5 * J2 * temp;
+	temp2 = temp1 * temp;
+	mrt = rl * (1.0 - 1.5 * temp2 * betal * s->con41) + 0.5 * temp1 * s->x1mth2 * cos2u;
+	su = su - 0.25 * temp2 * s->x7thm1 * sin2u;
+	xnode = nodem + 1.5 * temp2 * cosip * sin2u;
+	xinc = s->inclo + 1.5 * temp2 * cosip * sinip * cos2u;
+	mvt = rdotl - nm * temp1 * s->x1mth2 * sin2u / xke;
+	rvdot = rvdotl + nm * temp1 * (s->x1mth2 * cos2u + 1.5 * s->con41) / xke;
+
+	/* Orientation vectors */
+	sinsu = sin(su);
+	cossu = cos(su);
+	snod = sin(xnode);
+	cnod = cos(xnode);
+	sini = sin(xinc);
+	cosi = cos(xinc);
+	xmx = -snod * cosi;
+	xmy = cnod * cosi;
+	ux = xmx * sinsu + cnod * cossu;
+	uy = xmy * sinsu + snod * cossu;
+	uz = sini * sinsu;
+	vx = xmx * cossu - cnod * sinsu;
+	vy = xmy * cossu - snod * sinsu;
+	vz = sini * cossu;
+	if (mrt < 1.0)
+		return -1;
+	r[0] = mrt * ux * RE;
+	r[1] = mrt * uy * RE;
+	r[2] = mrt * uz * RE;
+	v[0] = (mvt * ux + rvdot * vx) * vkmpersec;
+	v[1] = (mvt * uy + rvdot * vy) * vkmpersec;
+	v[2] = (mvt * uz + rvdot * vz) * vkmpersec;
+	return 0;
+}
+
+void sgp4_site(sgp4_site_t *site, double lat_deg, double lon_deg, double alt_m) {
+	double e2 = WGS84_F * (2.0 - WGS84_F);
+	double slat, clat, n;
+
+	site->lat = lat_deg * DEG2RAD;
+	site->lon = lon_deg * DEG2RAD;
+	site->alt = alt_m / 1000.0;
+	slat = sin(site->lat);
+	clat = cos(site->lat);
+	n = WGS84_A / sqrt(1.0 - e2 * slat * slat);
+	site->r[0] = (n + site->alt) * clat * cos(site->lon);
+	site->r[1] = (n + site->alt) * clat * sin(site->lon);
+	site->r[2] = (n * (1.0 - e2) + site->alt) * slat;
+	site->up[0] = clat * cos(site->lon);
+	site->up[1] = clat * sin(site->lon);
+	site->up[2] = slat;
+}
+
+// Look angles from TEME state, with the earth rotation given as cos/sin of GMST
+static void look_from_state(const sgp4_site_t *site, const double r[3], const double v[3],
+		double cg, double sg, sgp4_look_t *look) {
+	double re[3], ve[3], rho[3], range;
+
+	/* TEME to earth fixed, polar motion ignored */
+	re[0] = cg * r[0] + sg * r[1];
+	re[1] = -sg * r[0] + cg * r[1];
+	re[2] = r[2];
+	ve[0] = cg * v[0] + sg * v[1] + OMEGA_EARTH * re[1];
+	ve[1] = -sg * v[0] + cg * v[1] - OMEGA_EARTH * re[0];
+	ve[2] = v[2];
+	rho[0] = re[0] - site->r[0];
+	rho[1] = re[1] - site->r[1];
+	rho[2] = re[2] - site->r[2];
+	range = sqrt(rho[0] * rho[0] + rho[1] * rho[1] + rho[2] * rho[2]);
+	look->range = range;
+	look->range_rate = (rho[0] * ve[0] + rho[1] * ve[1] + rho[2] * ve[2]) / range;
+	look->el = asin((rho[0] * site->up[0] + rho[1] * site->up[1] + rho[2] * site->up[2]) / range);
+}
+
+int sgp4_look(const sgp4_t *sat, const sgp4_site_t *site, double t, sgp4_look_t *look) {
+	double r[3], v[3], g;
+
+	if (sgp4_propagate(sat, (t - sat->epoch) / 60.0, r, v) < 0)
+		return -1;
+	g = gstime(t);
+	look->t = t;
+	look_from_state(site, r, v, cos(g), sin(g), look);
+	return 0;
+}
+
+// Evenly spaced look angles. GMST is advanced by rotation rather than recomputed.
+int sgp4_look_batch(const sgp4_t *sat, const sgp4_site_t *site, double t0, double step, int n, sgp4_look_t *look) {
+	double r[3], v[3], g, cg, sg, cd, sd, c;
+	int i;
+
+	g = gstime(t0);
+	cg = cos(g);
+	sg = sin(g);
+	/* Sidereal rotation per step, 1.00273790935 turns per solar day */
+	cd = cos(step * OMEGA_EARTH);
+	sd = sin(step * OMEGA_EARTH);
+	for (i = 0; i < n; i++) {
+		look[i].t = t0 + i * step;
+		if (sgp4_propagate(sat, (look[i].t - sat->epoch) / 60.0, r, v) < 0)
+			return -1;
+		look_from_state(site, r, v, cg, sg, &look[i]);
+		c = cg * cd - sg * sd;
+		sg = sg * cd + cg * sd;
+		cg = c;
+	}
+	return 0;
+}
@@ -0,0 +1,47 @@
+/*
+ * SGP4 orbit propagation (near earth, WGS-72), after Hoots & Roehrich,
+ * Spacetrack Report #3, as revised by Vallado et al. (AIAA 2006-6753).
+ *
+ * Deep space (SDP4) elements, with periods of 225 minutes or more, are
+ * rejected: the cubesats this is meant for are all in low earth orbit.
+ *
+ * sgp4_init() computes all the per satellite constants once, so propagating
+ * a batch of time steps only costs the secular and periodic updates.
+ */
+#ifndef SGP4_H
+#define SGP4_H
+
+typedef struct {
+	char name[25];
+	double epoch;           /* Unix time, s */
+	/* Mean elements */
+	double bstar, inclo, nodeo, ecco, argpo, mo, no;
+	/* Derived constants */
+	int isimp;
+	double sinio, cosio;
+	double ao, con41, x1mth2, x7thm1, cc1, cc4, cc5, d2, d3, d4;
+	double delmo, eta, argpdot, omgcof, sinmao, t2cof, t3cof, t4cof, t5cof;
+	double mdot, nodedot, xlcof, xmcof, nodecf, aycof;
+} sgp4_t;
+
+typedef struct {
+	double lat, lon, alt;   /* rad, rad, km */
+	double r[3];            /* ECEF, km */
+	double up[3];           /* Local vertical unit vector */
+} sgp4_site_t;
+
+typedef struct {
+	double t;               /* Unix time, s */
+	double el;              /* Elevation, rad */
+	double range;           /* km */
+	double range_rate;      /* km/s, positive when receding */
+} sgp4_look_t;
+
+int sgp4_parse_tle(sgp4_t *sat, const char *line1, const char *line2);
+int sgp4_init(sgp4_t *sat);
+int sgp4_propagate(const sgp4_t *sat, double tsince, double r[3], double v[3]);
+void sgp4_site(sgp4_site_t *site, double lat_deg, double lon_deg, double alt_m);
+int sgp4_look(const sgp4_t *sat, const sgp4_site_t *site, double t, sgp4_look_t *look);
+int sgp4_look_batch(const sgp4_t *sat, const sgp4_site_t *site, double t0, double step, int n, sgp4_look_t *look);
+
+#endif
@@ -0,0 +1,127 @@
+/*
+ * Pulse shapes for the symbol transitions. See shape.h.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include "shape.h"
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof(a[0]))
+
+#define FILE_POINTS_MAX 65536
+
+typedef struct {
+	const char *name;
+	double (*fn)(double t, double param);
+	double param;           /* Default parameter */
+	const char *help;
+} shape_def_t;
+
+// Raised cosine, the classic PSK31 envelope
+static double shape_rc(double t, double param) {
+	return 0.5 - 0.5 * cos(M_PI * t);
+}
+
+// Gaussian filtered step, param is the steepness, scaled to hit 0 and 1 exactly
+static double shape_gauss(double t, double param) {
+	double e = erf(param / 2);
+
+	return (erf(param * (t - 0.5)) + e) / (2 * e);
+}
+
+static const shape_def_t shape_defs[] = {
+	{"rc", shape_rc, 0, "raised cosine"},
+	{"gauss", shape_gauss, 4.0, "gaussian step, gauss:<steepness> [4]"},
+};
+
+// One value per line, '#' comments, resampled linearly to the symbol length
+static int shape_load(shape_t *sh, const char *fn) {
+	double *pt;
+	char line[128];
+	int i, n;
+	double x;
+	FILE *f;
+
+	if (!(f = fopen(fn, "r")))
+		return -1;
+	if (!(pt = malloc(FILE_POINTS_MAX * sizeof(*pt)))) {
+		fclose(f);
+		return -1;
+	}
+	n = 0;
+	while (fgets(line, sizeof(line), f) && n < FILE_POINTS_MAX) {
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+		if (sscanf(line, "%lf", &pt[n]) != 1)
+			break;
+		n++;
+	}
+	fclose(f);
+	if (n < 2) {
+		free(pt);
+		errno = EINVAL;
+		return -1;
+	}
+	for (i = 0; i <= sh->samples; i++) {
+		int j;
+
+		x = (double)i * (n - 1) / sh->samples;
+		j = (int)x;
+		if (j >= n - 1)
+			sh->rise[i] = pt[n - 1];
+		else
+			sh->rise[i] = pt[j] + (pt[j + 1] - pt[j]) * (x - j);
+	}
+	free(pt);
+	return 0;
+}
+
+int shape_init(shape_t *sh, const char *spec, int samples) {
+	const shape_def_t *sd;
+	const char *colon;
+	size_t len;
+	double param;
+	int i;
+
+	sh->samples = samples;
+	snprintf(sh->name, sizeof(sh->name), "%s", spec);
+	if (!(sh->rise = malloc((samples + 1) * sizeof(*sh->rise))))
+		return -1;
+	colon = strchr(spec, ':');
+	len = colon ? colon - spec : strlen(spec);
+	for (sd = shape_defs; sd < &shape_defs[ARRAY_SIZE(shape_defs)]; sd++) {
+		if (strlen(sd->name) != len || strncmp(sd->name, spec, len) != 0)
+			continue;
+		param = colon ? atof(colon + 1) : sd->param;
+		/* A shape with a parameter needs it positive */
+		if (sd->param > 0 && !(param > 0)) {
+			free(sh->rise);
+			sh->rise = NULL;
+			errno = EINVAL;
+			return -1;
+		}
+		for (i = 0; i <= samples; i++)
+			sh->rise[i] = sd->fn((double)i / samples, param);
+		return 0;
+	}
+	if (shape_load(sh, spec) < 0) {
+		free(sh->rise);
+		sh->rise = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+void shape_free(shape_t *sh) {
+	free(sh->rise);
+	sh->rise = NULL;
+}
+
+void shape_list(void) {
+	const shape_def_t *sd;
+
+	for (sd = shape_defs; sd < &shape_defs[ARRAY_SIZE(shape_defs)]; sd++)
+		fprintf(stderr, "                      %-8s %s\n", sd->name, sd->help);
+}
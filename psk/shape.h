@@ -0,0 +1,27 @@
+/*
+ * Pulse shapes for the symbol transitions.
+ *
+ * A shape is the rising edge of a transition, from 0 at the start of the
+ * symbol to 1 at its end, sampled once for a given symbol length. Falling
+ * edges and steady levels are derived from it by the user. The table is
+ * generated once and shared by everything that renders symbols, so no
+ * shape function is evaluated per sample.
+ *
+ * Shapes are named in the registry ("rc", "gauss"), optionally with a
+ * parameter after a colon ("gauss:3"). Any other name is read as a file
+ * with one value per line, which is resampled to the symbol length.
+ */
+#ifndef SHAPE_H
+#define SHAPE_H
+
+typedef struct {
+	char name[64];
+	int samples;            /* Symbol length; the table has samples + 1 entries */
+	double *rise;
+} shape_t;
+
+int shape_init(shape_t *sh, const char *spec, int samples);
+void shape_free(shape_t *sh);
+void shape_list(void);
+
+#endif
@@ -0,0 +1,351 @@
+/*
+ * Si570 I2C programmable oscillator driver. See si570.h.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <linux/i2c-dev.h>
+#include "si570.h"
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof(a[0]))
+
+#define REG_FREEZE_M    135
+#define REG_FREEZE_DCO  137
+
+#define CTRL_RECALL     (1<<0)
+#define CTRL_FREEZE_M   (1<<5)
+#define CTRL_NEWFREQ    (1<<6)
+#define CTRL_FREEZE_DCO (1<<4)
+
+#define RFREQ_ONE       ((double)(1 << 28))
+
+/* Valid HS_DIV values; 8 and 10 are not implemented in the part */
+static const int hs_div_list[] = {11, 9, 7, 6, 5, 4};
+
+typedef struct {
+	uint16_t product;
+	uint8_t hs_div;
+	uint8_t n1;
+} div_entry_t;
+
+/* All HS_DIV * N1 products, unique and sorted. Built once. */
+static div_entry_t div_table[ARRAY_SIZE(hs_div_list) * 65];
+static int div_count;
+
+static int div_cmp(const void *v1, const void *v2) {
+	const div_entry_t *d1 = (const div_entry_t *)v1;
+	const div_entry_t *d2 = (const div_entry_t *)v2;
+
+	if (d1->product != d2->product)
+		return d1->product < d2->product ? -1 : 1;
+	/* Same product: highest HS_DIV (lowest N1) first, that one is kept */
+	return d2->hs_div - d1->hs_div;
+}
+
+static void div_table_init(void) {
+	int h, n1, i, j;
+
+	if (div_count)
+		return;
+	i = 0;
+	for (h = 0; h < ARRAY_SIZE(hs_div_list); h++)
+		for (n1 = 1; n1 <= 128; n1 = (n1 == 1) ? 2 : n1 + 2) {
+			div_table[i].product = hs_div_list[h] * n1;
+			div_table[i].hs_div = hs_div_list[h];
+			div_table[i].n1 = n1;
+			i++;
+		}
+	qsort(div_table, i, sizeof(div_table[0]), div_cmp);
+	for (j = 1, div_count = 1; j < i; j++)
+		if (div_table[j].product != div_table[div_count - 1].product)
+			div_table[div_count++] = div_table[j];
+}
+
+// Lowest fdco (and so lowest power) divider pair for a frequency
+int si570_dividers(double f, int *hs_div, int *n1) {
+	double p_min;
+	int l, u, m;
+
+	div_table_init();
+	if (f <= 0)
+		return -1;
+	p_min = SI570_FDCO_MIN / f;
+	l = 0;
+	u = div_count;
+	while (l < u) {
+		m = (l + u) / 2;
+		if (div_table[m].product < p_min)
+			l = m + 1;
+		else
+			u = m;
+	}
+	if (l == div_count || div_table[l].product * f > SI570_FDCO_MAX)
+		return -1;
+	*hs_div = div_table[l].hs_div;
+	*n1 = div_table[l].n1;
+	return 0;
+}
+
+static void regs_encode(uint8_t *r, int hs_div, int n1, uint64_t rfreq) {
+	r[0] = ((hs_div - 4) << 5) | (((n1 - 1) >> 2) & 0x1f);
+	r[1] = (((n1 - 1) & 3) << 6) | ((rfreq >> 32) & 0x3f);
+	r[2] = rfreq >> 24;
+	r[3] = rfreq >> 16;
+	r[4] = rfreq >> 8;
+	r[5] = rfreq;
+}
+
+static void regs_decode(const uint8_t *r, int *hs_div, int *n1, uint64_t *rfreq) {
+	*hs_div = ((r[0] >> 5) & 7) + 4;
+	*n1 = (((r[0] & 0x1f) << 2) | (r[1] >> 6)) + 1;
+	*rfreq = (uint64_t)(r[1] & 0x3f) << 32 | (uint32_t)r[2] << 24 |
+		(uint32_t)r[3] << 16 | (uint32_t)r[4] << 8 | r[5];
+}
+
+static double now_us(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+/*
+ * Linux i2c-dev bus
+ */
+typedef struct {
+	int fd;
+} i2c_dev_t;
+
+static int i2c_dev_write(void *ctx, uint8_t reg, const uint8_t *buf, int len) {
+	i2c_dev_t *d = (i2c_dev_t *)ctx;
+	uint8_t msg[16];
+
+	if (len + 1 > sizeof(msg))
+		return -1;
+	msg[0] = reg;
+	memcpy(&msg[1], buf, len);
+	return write(d->fd, msg, len + 1) == len + 1 ? 0 : -1;
+}
+
+static int i2c_dev_read(void *ctx, uint8_t reg, uint8_t *buf, int len) {
+	i2c_dev_t *d = (i2c_dev_t *)ctx;
+
+	if (write(d->fd, &reg, 1) != 1)
+		return -1;
+	return read(d->fd, buf, len) == len ? 0 : -1;
+}
+
+static void i2c_dev_settle(void *ctx, int us) {
+	struct timespec ts = { us / 1000000, (us % 1000000) * 1000 };
+
+	nanosleep(&ts, NULL);
+}
+
+static void i2c_dev_close(void *ctx) {
+	i2c_dev_t *d = (i2c_dev_t *)ctx;
+
+	close(d->fd);
+	free(d);
+}
+
+int si570_bus_open(si570_bus_t *bus, const char *dev, int addr) {
+	i2c_dev_t *d;
+
+	if (!(d = (i2c_dev_t *)malloc(sizeof(*d))))
+		return -1;
+	if ((d->fd = open(dev, O_RDWR)) < 0) {
+		free(d);
+		return -1;
+	}
+	if (ioctl(d->fd, I2C_SLAVE, addr) < 0) {
+		close(d->fd);
+		free(d);
+		return -1;
+	}
+	bus->write = i2c_dev_write;
+	bus->read = i2c_dev_read;
+	bus->settle = i2c_dev_settle;
+	bus->close = i2c_dev_close;
+	bus->ctx = d;
+	return 0;
+}
+
+/*
+ * Mock bus. Bus time is modelled as 9 SCL periods per byte plus start/stop.
+ */
+static void mock_account(si570_mock_t *m, int bytes, int conditions) {
+	m->transactions++;
+	m->bytes += bytes;
+	m->bus_us += (bytes * 9 + conditions) * 1000000.0 / m->bus_hz;
+}
+
+static int mock_write(void *ctx, uint8_t reg, const uint8_t *buf, int len) {
+	si570_mock_t *m = (si570_mock_t *)ctx;
+	int i;
+
+	/* Address + register + data, start and stop */
+	mock_account(m, 2 + len, 2);
+	for (i = 0; i < len; i++, reg++) {
+		if (reg >= 7 && reg <= 18) {
+			/* Dividers need the DCO frozen, RFREQ alone may use freeze M */
+			if (!(m->reg[REG_FREEZE_DCO] & CTRL_FREEZE_DCO) &&
+			    (reg == 7 || reg == 13 || !(m->reg[REG_FREEZE_M] & CTRL_FREEZE_M)))
+				m->glitches++;
+		}
+		if (reg == REG_FREEZE_M) {
+			/* RECALL and NEWFREQ self clear */
+			m->reg[reg] = buf[i] & ~(CTRL_RECALL | CTRL_NEWFREQ);
+			continue;
+		}
+		m->reg[reg] = buf[i];
+	}
+	return 0;
+}
+
+static int mock_read(void *ctx, uint8_t reg, uint8_t *buf, int len) {
+	si570_mock_t *m = (si570_mock_t *)ctx;
+
+	/* Address + register, repeated start, address + data */
+	mock_account(m, 3 + len, 3);
+	memcpy(buf, &m->reg[reg], len);
+	return 0;
+}
+
+static void mock_settle(void *ctx, int us) {
+	si570_mock_t *m = (si570_mock_t *)ctx;
+
+	m->settle_us += us;
+}
+
+static void mock_close(void *ctx) {
+}
+
+void si570_bus_mock(si570_bus_t *bus, si570_mock_t *mock, double f_startup) {
+	int hs_div, n1;
+	uint64_t rfreq;
+
+	memset(mock->reg, 0, sizeof(mock->reg));
+	if (mock->fxtal == 0)
+		mock->fxtal = 114.285e6;
+	if (mock->bus_hz == 0)
+		mock->bus_hz = 100000;
+	/* Factory configuration for the startup frequency */
+	if (si570_dividers(f_startup, &hs_div, &n1) == 0) {
+		rfreq = (uint64_t)(f_startup * hs_div * n1 / mock->fxtal * RFREQ_ONE + 0.5);
+		regs_encode(&mock->reg[7], hs_div, n1, rfreq);
+	}
+	mock->transactions = 0;
+	mock->bytes = 0;
+	mock->bus_us = 0;
+	mock->settle_us = 0;
+	mock->glitches = 0;
+	bus->write = mock_write;
+	bus->read = mock_read;
+	bus->settle = mock_settle;
+	bus->close = mock_close;
+	bus->ctx = mock;
+}
+
+/*
+ * Driver
+ */
+static int reg_write(si570_t *si, uint8_t reg, uint8_t val) {
+	return si->bus.write(si->bus.ctx, reg, &val, 1);
+}
+
+int si570_init(si570_t *si, const si570_bus_t *bus, double f_startup) {
+	uint8_t ctrl;
+	int i;
+
+	memset(si, 0, sizeof(*si));
+	si->bus = *bus;
+	si->reg_base = 7;
+	div_table_init();
+	/* Reload the factory configuration so the startup frequency is known */
+	if (reg_write(si, REG_FREEZE_M, CTRL_RECALL) < 0)
+		return -1;
+	for (i = 0; i < 100; i++) {
+		if (si->bus.read(si->bus.ctx, REG_FREEZE_M, &ctrl, 1) < 0)
+			return -1;
+		if (!(ctrl & CTRL_RECALL))
+			break;
+	}
+	if (si->bus.read(si->bus.ctx, si->reg_base, si->regs, sizeof(si->regs)) < 0)
+		return -1;
+	regs_decode(si->regs, &si->hs_div, &si->n1, &si->rfreq);
+	if (si->rfreq == 0 || si->hs_div == 8 || si->hs_div == 10) {
+		errno = ENODEV;
+		return -1;
+	}
+	si->fxtal = f_startup * si->hs_div * si->n1 / (si->rfreq / RFREQ_ONE);
+	si->f_out = f_startup;
+	si->f_center = f_startup;
+	return 0;
+}
+
+int si570_set_frequency(si570_t *si, double f) {
+	uint8_t regs[6];
+	double t0, fdco;
+	int hs_div, n1;
+	uint64_t rfreq;
+	int first, last;
+
+	t0 = now_us();
+	/* Small change: same dividers, RFREQ only, output keeps running */
+	fdco = f * si->hs_div * si->n1;
+	if (f >= si->f_center * (1.0 - SI570_SMALL_PPM * 1e-6) &&
+	    f <= si->f_center * (1.0 + SI570_SMALL_PPM * 1e-6) &&
+	    fdco >= SI570_FDCO_MIN && fdco <= SI570_FDCO_MAX) {
+		rfreq = (uint64_t)(fdco / si->fxtal * RFREQ_ONE + 0.5);
+		regs_encode(regs, si->hs_div, si->n1, rfreq);
+		/* Only the RFREQ bytes that actually changed go on the bus */
+		for (first = 1; first < 6 && regs[first] == si->regs[first]; first++)
+			;
+		for (last = 5; last >= first && regs[last] == si->regs[last]; last--)
+			;
+		if (first <= last) {
+			if (reg_write(si, REG_FREEZE_M, CTRL_FREEZE_M) < 0 ||
+			    si->bus.write(si->bus.ctx, si->reg_base + first, &regs[first], last - first + 1) < 0 ||
+			    reg_write(si, REG_FREEZE_M, 0) < 0)
+				return -1;
+		}
+		si->last_small = 1;
+		si->n_small++;
+	} else {
+		if (si570_dividers(f, &hs_div, &n1) < 0) {
+			errno = ERANGE;
+			return -1;
+		}
+		rfreq = (uint64_t)(f * hs_div * n1 / si->fxtal * RFREQ_ONE + 0.5);
+		regs_encode(regs, hs_div, n1, rfreq);
+		if (reg_write(si, REG_FREEZE_DCO, CTRL_FREEZE_DCO) < 0 ||
+		    si->bus.write(si->bus.ctx, si->reg_base, regs, sizeof(regs)) < 0 ||
+		    reg_write(si, REG_FREEZE_DCO, 0) < 0 ||
+		    reg_write(si, REG_FREEZE_M, CTRL_NEWFREQ) < 0)
+			return -1;
+		si->bus.settle(si->bus.ctx, SI570_SETTLE_US);
+		si->hs_div = hs_div;
+		si->n1 = n1;
+		si->f_center = f;
+		si->last_small = 0;
+		si->n_large++;
+	}
+	memcpy(si->regs, regs, sizeof(regs));
+	si->rfreq = rfreq;
+	si->f_out = f;
+	si->last_us = now_us() - t0;
+	return 0;
+}
+
+void si570_close(si570_t *si) {
+	if (si->bus.close)
+		si->bus.close(si->bus.ctx);
+	si->bus.close = NULL;
+}
@@ -0,0 +1,71 @@
+/*
+ * Si570 I2C programmable oscillator driver.
+ *
+ * The Si570 on the board is the local oscillator for the IQ mixer. The output
+ * frequency is fdco / (HS_DIV * N1), where fdco = fxtal * RFREQ must stay in
+ * the 4.85 .. 5.67 GHz range. The divider pair is looked up in a table of all
+ * valid HS_DIV/N1 combinations, precomputed once and sorted by product.
+ *
+ * Changes within 3500 ppm of the last "large" change only rewrite RFREQ with
+ * the M divider frozen, which keeps the output running. Anything else freezes
+ * the DCO, rewrites the whole register set and waits for it to settle.
+ */
+#ifndef SI570_H
+#define SI570_H
+
+#include <stdint.h>
+
+#define SI570_I2C_ADDR          0x55
+
+#define SI570_FDCO_MIN          4850.0e6
+#define SI570_FDCO_MAX          5670.0e6
+#define SI570_SMALL_PPM         3500.0
+#define SI570_SETTLE_US         10000
+
+/* Register access, either a real i2c-dev adapter or the mock below */
+typedef struct {
+	int (*write)(void *ctx, uint8_t reg, const uint8_t *buf, int len);
+	int (*read)(void *ctx, uint8_t reg, uint8_t *buf, int len);
+	void (*settle)(void *ctx, int us);
+	void (*close)(void *ctx);
+	void *ctx;
+} si570_bus_t;
+
+/* In-memory device model, used for testing without the board */
+typedef struct {
+	uint8_t reg[256];
+	double fxtal;           /* Hz */
+	double bus_hz;          /* SCL rate, used for the modelled bus time */
+	uint32_t transactions;
+	uint32_t bytes;
+	double bus_us;          /* Accumulated modelled bus time */
+	double settle_us;       /* Accumulated settle time requested */
+	int glitches;           /* Register writes with the output unfrozen */
+} si570_mock_t;
+
+typedef struct {
+	si570_bus_t bus;
+	int reg_base;           /* 7, or 13 for the 7 ppm parts */
+	double fxtal;           /* Hz, computed from the startup frequency */
+	double f_out;           /* Hz */
+	double f_center;        /* Hz, frequency of the last large change */
+	int hs_div;
+	int n1;
+	uint64_t rfreq;         /* 10.28 fixed point */
+	uint8_t regs[6];        /* Current image of reg_base .. reg_base + 5 */
+	/* Statistics */
+	unsigned n_small;
+	unsigned n_large;
+	double last_us;         /* Latency of the last retune */
+	int last_small;
+} si570_t;
+
+int si570_bus_open(si570_bus_t *bus, const char *dev, int addr);
+void si570_bus_mock(si570_bus_t *bus, si570_mock_t *mock, double f_startup);
+
+int si570_init(si570_t *si, const si570_bus_t *bus, double f_startup);
+int si570_set_frequency(si570_t *si, double f);
+int si570_dividers(double f, int *hs_div, int *n1);
+void si570_close(si570_t *si);
+
+#endif
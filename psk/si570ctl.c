@@ -0,0 +1,162 @@
+/*
+ * Set the Si570 local oscillator from the command line, or measure the
+ * retune latency of the driver on the real bus or on the mock bus.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <getopt.h>
+#include "si570.h"
+
+static const struct option long_options[] = {
+	{"address", required_argument, NULL, 'a'},
+	{"bench", no_argument, NULL, 'b'},
+	{"device", required_argument, NULL, 'd'},
+	{"frequency", required_argument, NULL, 'f'},
+	{"help", no_argument, NULL, 'h'},
+	{"mock", no_argument, NULL, 'm'},
+	{"startup", required_argument, NULL, 's'},
+	{NULL, 0, NULL, 0}
+};
+
+typedef struct {
+	unsigned n;
+	double min, max, sum;
+} lat_t;
+
+static void lat_add(lat_t *l, double us) {
+	if (l->n == 0 || us < l->min)
+		l->min = us;
+	if (l->n == 0 || us > l->max)
+		l->max = us;
+	l->sum += us;
+	l->n++;
+}
+
+static void lat_print(const char *name, const lat_t *l) {
+	if (l->n == 0)
+		return;
+	printf("%-8s %6u retunes, latency min %9.1fus avg %9.1fus max %9.1fus\n",
+		name, l->n, l->min, l->sum / l->n, l->max);
+}
+
+static si570_mock_t mock;
+
+// Latency of the last retune, including the modelled bus and settle time on the mock
+static double retune(si570_t *si, double f, int use_mock) {
+	double bus_us = mock.bus_us, settle_us = mock.settle_us;
+
+	if (si570_set_frequency(si, f) < 0) {
+		fprintf(stderr, "si570ctl: cannot set %f MHz: %m\n", f / 1e6);
+		exit(1);
+	}
+	if (!use_mock)
+		return si->last_us;
+	return si->last_us + (mock.bus_us - bus_us) + (mock.settle_us - settle_us);
+}
+
+static void bench(si570_t *si, double f0, int use_mock) {
+	static const double bands[] = {145.8e6, 435.0e6, 144.39e6, 437.5e6};
+	lat_t small = {0}, large = {0};
+	double f, us;
+	int i, b;
+
+	/* Doppler tracking: +-3.5 kHz in 10 Hz steps around each band */
+	for (b = 0; b < sizeof(bands) / sizeof(bands[0]); b++) {
+		us = retune(si, bands[b], use_mock);
+		lat_add(si->last_small ? &small : &large, us);
+		for (i = 0; i < 700; i++) {
+			f = bands[b] + 3500.0 - 10.0 * i;
+			us = retune(si, f, use_mock);
+			lat_add(si->last_small ? &small : &large, us);
+		}
+	}
+	retune(si, f0, use_mock);
+	lat_print("small", &small);
+	lat_print("large", &large);
+	if (use_mock)
+		printf("bus: %u transactions, %u bytes, %d unfrozen writes\n",
+			mock.transactions, mock.bytes, mock.glitches);
+}
+
+int main(int argc, char **argv) {
+	const char *device = "/dev/i2c-0";
+	int address = SI570_I2C_ADDR;
+	double f_startup = 10.0;
+	double frequency = 0;
+	int use_mock = 0;
+	int do_bench = 0;
+	si570_bus_t bus;
+	si570_t si;
+
+	while (1) {
+		int opt;
+		int opt_index;
+
+		opt_index = 0;
+		opt = getopt_long(argc, argv, "a:bd:f:hms:", long_options, &opt_index);
+		if (opt == -1)
+			break;
+		switch (opt) {
+			case 'a':
+				address = strtol(optarg, NULL, 0);
+				break;
+			case 'b':
+				do_bench = 1;
+				break;
+			case 'd':
+				device = optarg;
+				break;
+			case 'f':
+				frequency = atof(optarg);
+				break;
+			case 'h':
+				fprintf(stderr,
+					"Options:\n"
+					"  --address=<n>       I2C address [0x55]\n"
+					"  --bench             Measure retune latency\n"
+					"  --device=<dev>      I2C adapter [/dev/i2c-0]\n"
+					"  --frequency=<f>     Output frequency, in MHz [10 .. 945]\n"
+					"  --help              Show this help\n"
+					"  --mock              Use a simulated device instead of the I2C bus\n"
+					"  --startup=<f>       Factory startup frequency, in MHz [10]\n");
+				return 0;
+			case 'm':
+				use_mock = 1;
+				break;
+			case 's':
+				f_startup = atof(optarg);
+				break;
+			default:
+				fprintf(stderr, "si570ctl: invalid options\n");
+				return 1;
+		}
+	}
+
+	if (use_mock)
+		si570_bus_mock(&bus, &mock, f_startup * 1e6);
+	else if (si570_bus_open(&bus, device, address) < 0) {
+		fprintf(stderr, "si570ctl: cannot open %s: %m\n", device);
+		return 1;
+	}
+	if (si570_init(&si, &bus, f_startup * 1e6) < 0) {
+		fprintf(stderr, "si570ctl: init failed: %m\n");
+		return 1;
+	}
+	printf("fxtal:                %f MHz\n", si.fxtal / 1e6);
+	if (frequency > 0) {
+		double us = retune(&si, frequency * 1e6, use_mock);
+
+		printf("Frequency:            %f MHz\n", si.f_out / 1e6);
+		printf("HS_DIV, N1:           %d, %d\n", si.hs_div, si.n1);
+		printf("RFREQ:                %f\n", si.rfreq / (double)(1 << 28));
+		printf("Retune:               %s, %.1fus\n", si.last_small ? "small" : "large", us);
+	}
+	if (do_bench)
+		bench(&si, frequency > 0 ? frequency * 1e6 : f_startup * 1e6, use_mock);
+	si570_close(&si);
+	return 0;
+}
@@ -0,0 +1,446 @@
+/*
+ * Sweep the settings of the psk31 waveforms: RC time constant, amplitude and
+ * sample period (PULSE_WIDTH_INCR_US, fixed when psk31 is built).
+ *
+ * Every combination is modelled the way psk31 builds its DMA waveforms and
+ * scored three ways: the largest envelope error of the RC filter (what psk31
+ * prints as "Max. error"), the splatter of a random symbol stream, which is
+ * the power above the PSK31 band against the power in it, and the number of
+ * CBs a TS takes, which is the DMA memory and bus load. The combinations are
+ * shared out between threads, ranked by the sum of their ranks in the three
+ * scores, and the best one is printed as psk31 options.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include "shape.h"
+#include "predistort.h"
+#include "sdmodel.h"
+
+#define BS_US           32000           /* Symbol time, as in psk31 */
+#define CB_SIZE         32
+#define PAGE_SIZE       4096
+#define SPEC_POINTS     256             /* Per symbol for the spectrum, 8 kHz */
+#define PERIOD_MAX      16
+
+enum {
+	SYM_L,
+	SYM_H,
+	SYM_LH,
+	SYM_HL,
+
+	SYM_COUNT
+};
+
+/* Next symbol for a 0 (reversal) and a 1 (steady) bit, as in psk31 */
+static const int ts_next[SYM_COUNT][2] = {
+	[SYM_L] = {SYM_LH, SYM_L},
+	[SYM_H] = {SYM_HL, SYM_H},
+	[SYM_LH] = {SYM_HL, SYM_H},
+	[SYM_HL] = {SYM_LH, SYM_L},
+};
+
+typedef struct {
+	int period_us;
+	double rc;
+	double amplitude;
+	/* Scores */
+	double error;           /* Volts */
+	double splatter_db;
+	int cbs;                /* Per TS */
+	int rank;
+} result_t;
+
+typedef struct {
+	pthread_t thread;
+	int first;              /* Every threads-th result from first */
+} job_t;
+
+static const struct option long_options[] = {
+	{"amplitude", required_argument, NULL, 'a'},
+	{"bandwidth", required_argument, NULL, 'b'},
+	{"help", no_argument, NULL, 'h'},
+	{"period", required_argument, NULL, 'p'},
+	{"predistort", required_argument, NULL, 'P'},
+	{"queue", required_argument, NULL, 'Q'},
+	{"rc", required_argument, NULL, 'r'},
+	{"shape", required_argument, NULL, 'S'},
+	{"symbols", required_argument, NULL, 's'},
+	{"threads", required_argument, NULL, 'T'},
+	{"top", required_argument, NULL, 't'},
+	{NULL, 0, NULL, 0}
+};
+
+static const char *option_shape = "rc";
+static double option_bandwidth = 100.0;
+static int option_symbols = 64;
+static int option_queue = 16;           /* Slots of the DMA queue, as psk31 --queue */
+static predistort_t pd;
+static int pd_active;
+
+static int periods[PERIOD_MAX];
+static int period_count;
+static shape_t shapes[PERIOD_MAX];
+static uint8_t *bits;           /* Random data, the same for every combination */
+
+static result_t *results;
+static int result_count;
+static int threads;
+
+static double now_ms(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+// "<min>:<max>:<steps>", or a single value
+static int parse_range(const char *str, double *min, double *max, int *steps) {
+	if (sscanf(str, "%lf:%lf:%d", min, max, steps) == 3)
+		return *steps >= 1 && *max >= *min ? 0 : -1;
+	*min = *max = atof(str);
+	*steps = 1;
+	return *min > 0 ? 0 : -1;
+}
+
+static double range_value(double min, double max, int steps, int i) {
+	return steps > 1 ? min + (max - min) * i / (steps - 1) : min;
+}
+
+// In place radix 2 FFT, n a power of 2
+static void fft(double *re, double *im, int n) {
+	double wr, wi, tr, ti, a;
+	int i, j, k, len;
+
+	for (i = 1, j = 0; i < n; i++) {
+		for (k = n >> 1; j & k; k >>= 1)
+			j ^= k;
+		j |= k;
+		if (i < j) {
+			tr = re[i]; re[i] = re[j]; re[j] = tr;
+			ti = im[i]; im[i] = im[j]; im[j] = ti;
+		}
+	}
+	for (len = 2; len <= n; len <<= 1) {
+		a = -2 * M_PI / len;
+		for (i = 0; i < n; i += len)
+			for (k = 0; k < len / 2; k++) {
+				wr = cos(a * k);
+				wi = sin(a * k);
+				j = i + k + len / 2;
+				tr = re[j] * wr - im[j] * wi;
+				ti = re[j] * wi + im[j] * wr;
+				re[j] = re[i + k] - tr;
+				im[j] = im[i + k] - ti;
+				re[i + k] += tr;
+				im[i + k] += ti;
+			}
+	}
+}
+
+static double level_predistort(double v) {
+	if (!pd_active)
+		return v;
+	return 0.5 + predistort(&pd, (v - 0.5) * 2) / 2;
+}
+
+static void evaluate(result_t *res, int period) {
+	int samples = BS_US / res->period_us;
+	double level[SYM_COUNT][samples + 1];
+	uint8_t up[SYM_COUNT][samples];
+	const shape_t *sh = &shapes[period];
+	double lo, hi, rise, decay, v, sum, error;
+	double *re, *im, p_in, p_out, f;
+	int n, i, j, s, b, k;
+
+	/* Levels and bits of the symbols, as psk31 builds them */
+	lo = 0.5 - res->amplitude / 2;
+	hi = 0.5 + res->amplitude / 2;
+	for (i = 0; i <= samples; i++) {
+		rise = sh->rise[i];
+		level[SYM_L][i] = level_predistort(lo);
+		level[SYM_H][i] = level_predistort(hi);
+		level[SYM_LH][i] = level_predistort(lo + rise * (hi - lo));
+		level[SYM_HL][i] = level_predistort(hi - rise * (hi - lo));
+	}
+	decay = sdmodel_decay(res->period_us, res->rc);
+	res->error = 0;
+	res->cbs = 0;
+	for (s = 0; s < SYM_COUNT; s++) {
+		if ((error = sdmodel_symbol(level[s], samples, decay, up[s])) > res->error)
+			res->error = error;
+		/* A delay per sample, two pads on every change */
+		for (i = 0; i < samples; i++)
+			res->cbs += 1 + (i == 0 || up[s][i] != up[s][i - 1] ? 2 : 0);
+	}
+
+	/* Filter output for the random stream, averaged down to SPEC_POINTS a symbol */
+	for (n = 1; n < option_symbols * SPEC_POINTS; n <<= 1)
+		;
+	re = calloc(n, sizeof(*re));
+	im = calloc(n, sizeof(*im));
+	if (!re || !im) {
+		fprintf(stderr, "sweep: oom\n");
+		exit(1);
+	}
+	s = SYM_H;
+	v = level[s][0];
+	for (b = 0; b < option_symbols; b++) {
+		s = ts_next[s][bits[b]];
+		for (k = 0, j = 0; k < SPEC_POINTS; k++) {
+			sum = 0;
+			for (i = j; i < (k + 1) * samples / SPEC_POINTS; i++) {
+				v = v * decay + (up[s][i] ? 1.0 - decay : 0);
+				sum += v;
+			}
+			re[b * SPEC_POINTS + k] = (sum / (i - j) - 0.5) *
+				(0.5 - 0.5 * cos(2 * M_PI * (b * SPEC_POINTS + k) / (option_symbols * SPEC_POINTS)));
+			j = i;
+		}
+	}
+	fft(re, im, n);
+	p_in = p_out = 0;
+	for (i = 1; i < n / 2; i++) {
+		f = (double)i * SPEC_POINTS * 1000000.0 / BS_US / n;
+		if (f <= option_bandwidth)
+			p_in += re[i] * re[i] + im[i] * im[i];
+		else
+			p_out += re[i] * re[i] + im[i] * im[i];
+	}
+	res->splatter_db = 10 * log10((p_out + 1e-30) / (p_in + 1e-30));
+	free(re);
+	free(im);
+}
+
+static void *sweep_job(void *arg) {
+	job_t *job = (job_t *)arg;
+	int i, p;
+
+	for (i = job->first; i < result_count; i += threads) {
+		for (p = 0; periods[p] != results[i].period_us; p++)
+			;
+		evaluate(&results[i], p);
+	}
+	return NULL;
+}
+
+static int cmp_error(const void *a, const void *b) {
+	const result_t *ra = *(const result_t **)a, *rb = *(const result_t **)b;
+
+	return (ra->error > rb->error) - (ra->error < rb->error);
+}
+
+static int cmp_splatter(const void *a, const void *b) {
+	const result_t *ra = *(const result_t **)a, *rb = *(const result_t **)b;
+
+	return (ra->splatter_db > rb->splatter_db) - (ra->splatter_db < rb->splatter_db);
+}
+
+static int cmp_cbs(const void *a, const void *b) {
+	const result_t *ra = *(const result_t **)a, *rb = *(const result_t **)b;
+
+	return (ra->cbs > rb->cbs) - (ra->cbs < rb->cbs);
+}
+
+static int cmp_rank(const void *a, const void *b) {
+	const result_t *ra = (const result_t *)a, *rb = (const result_t *)b;
+
+	if (ra->rank != rb->rank)
+		return ra->rank - rb->rank;
+	return (ra->error > rb->error) - (ra->error < rb->error);
+}
+
+// Sum of the ranks in each score; equal scores share a rank
+static void rank(void) {
+	int (*const cmp[])(const void *, const void *) = {cmp_error, cmp_splatter, cmp_cbs};
+	result_t **order;
+	int c, i, r;
+
+	if (!(order = malloc(result_count * sizeof(*order)))) {
+		fprintf(stderr, "sweep: oom\n");
+		exit(1);
+	}
+	for (i = 0; i < result_count; i++)
+		results[i].rank = 0;
+	for (c = 0; c < 3; c++) {
+		for (i = 0; i < result_count; i++)
+			order[i] = &results[i];
+		qsort(order, result_count, sizeof(*order), cmp[c]);
+		for (i = 0, r = 0; i < result_count; i++) {
+			if (i > 0 && cmp[c](&order[i - 1], &order[i]) != 0)
+				r = i;
+			order[i]->rank += r;
+		}
+	}
+	free(order);
+	qsort(results, result_count, sizeof(*results), cmp_rank);
+}
+
+int main(int argc, char **argv) {
+	double rc_min = 0.001, rc_max = 0.010;
+	double amp_min = 0.5, amp_max = 1.0;
+	int rc_steps = 10, amp_steps = 11;
+	char period_list[64] = "5,8,10,16,20,25,32,40";
+	const char *predistort_fn = NULL;
+	int top = 20;
+	job_t *job;
+	char *tok, *save;
+	double t_ms;
+	int i, j, k, p;
+
+	threads = 0;
+	while (1) {
+		int opt;
+		int opt_index;
+
+		opt_index = 0;
+		opt = getopt_long(argc, argv, "a:r:", long_options, &opt_index);
+		if (opt == -1)
+			break;
+		switch (opt) {
+			case 'a':
+				if (parse_range(optarg, &amp_min, &amp_max, &amp_steps) < 0 || amp_max > 1.0) {
+					fprintf(stderr, "sweep: invalid amplitude %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'b':
+				option_bandwidth = atof(optarg);
+				break;
+			case 'h':
+				fprintf(stderr,
+					"Usage: sweep [options]\n"
+					"Options:\n"
+					"  --amplitude=<a>     Amplitudes, <min>:<max>:<steps> or one value [0.5:1:11]\n"
+					"  --bandwidth=<f>     Edge of the PSK31 band for the splatter, in Hz [100]\n"
+					"  --help              Show this help\n"
+					"  --period=<list>     Sample periods in us, dividing 32000 [5,8,10,16,20,25,32,40]\n"
+					"  --predistort=<file> PA calibration, as for psk31\n"
+					"  --queue=<n>         DMA queue slots the pages are given for, as psk31 [16]\n"
+					"  --rc=<s>            RC values, <min>:<max>:<steps> or one value [0.001:0.01:10]\n"
+					"  --shape=<s>         Transition shape, as for psk31 [rc]\n"
+					"  --symbols=<n>       Random symbols for the splatter [64]\n"
+					"  --threads=<n>       Threads [number of CPUs]\n"
+					"  --top=<n>           Results to print [20]\n");
+				return 0;
+			case 'p':
+				snprintf(period_list, sizeof(period_list), "%s", optarg);
+				break;
+			case 'P':
+				predistort_fn = optarg;
+				break;
+			case 'Q':
+				option_queue = atoi(optarg);
+				if (option_queue < 4 || option_queue > 128 || (option_queue & (option_queue - 1))) {
+					fprintf(stderr, "sweep: invalid queue %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'r':
+				if (parse_range(optarg, &rc_min, &rc_max, &rc_steps) < 0) {
+					fprintf(stderr, "sweep: invalid rc %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'S':
+				option_shape = optarg;
+				break;
+			case 's':
+				option_symbols = atoi(optarg);
+				break;
+			case 'T':
+				threads = atoi(optarg);
+				break;
+			case 't':
+				top = atoi(optarg);
+				break;
+			default:
+				fprintf(stderr, "sweep: invalid options\n");
+				return 1;
+		}
+	}
+	if (option_symbols < 8) {
+		fprintf(stderr, "sweep: at least 8 symbols\n");
+		return 1;
+	}
+	if (predistort_fn) {
+		if (predistort_load(&pd, predistort_fn) < 0) {
+			fprintf(stderr, "sweep: cannot load %s: %m\n", predistort_fn);
+			return 1;
+		}
+		pd_active = 1;
+	}
+	for (tok = strtok_r(period_list, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+		p = atoi(tok);
+		if (p <= 0 || BS_US % p || BS_US / p < SPEC_POINTS || period_count == PERIOD_MAX) {
+			fprintf(stderr, "sweep: invalid period %s\n", tok);
+			return 1;
+		}
+		if (shape_init(&shapes[period_count], option_shape, BS_US / p) < 0) {
+			fprintf(stderr, "sweep: invalid shape %s: %m\n", option_shape);
+			return 1;
+		}
+		periods[period_count++] = p;
+	}
+
+	/* The same pseudo random data for every combination */
+	if (!(bits = malloc(option_symbols)))
+		return 1;
+	srand(31);
+	for (i = 0; i < option_symbols; i++)
+		bits[i] = rand() & 1;
+
+	result_count = period_count * rc_steps * amp_steps;
+	if (!(results = calloc(result_count, sizeof(*results))))
+		return 1;
+	for (p = 0, k = 0; p < period_count; p++)
+		for (i = 0; i < rc_steps; i++)
+			for (j = 0; j < amp_steps; j++, k++) {
+				results[k].period_us = periods[p];
+				results[k].rc = range_value(rc_min, rc_max, rc_steps, i);
+				results[k].amplitude = range_value(amp_min, amp_max, amp_steps, j);
+			}
+
+	/* Interleaved, so the costly short periods are spread over all threads */
+	if (threads <= 0)
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (threads < 1)
+		threads = 1;
+	if (threads > result_count)
+		threads = result_count;
+	if (!(job = calloc(threads, sizeof(*job))))
+		return 1;
+	t_ms = now_ms();
+	for (i = 0; i < threads; i++) {
+		job[i].first = i;
+		if (i == 0 || pthread_create(&job[i].thread, NULL, sweep_job, &job[i]) != 0)
+			job[i].thread = 0;
+	}
+	for (i = 0; i < threads; i++)
+		if (!job[i].thread)
+			sweep_job(&job[i]);
+	for (i = 0; i < threads; i++)
+		if (job[i].thread)
+			pthread_join(job[i].thread, NULL);
+	rank();
+
+	printf("Combinations:         %d on %d threads, %.1fms\n", result_count, threads, now_ms() - t_ms);
+	printf("Rank  Period  RC         Amplitude  Error      Splatter   CBs/TS  Pages\n");
+	for (i = 0; i < result_count && i < top; i++)
+		printf("%4d  %4dus  %.6fs  %.3f      %7.2fmV  %7.2fdB  %6d  %5d\n", results[i].rank,
+			results[i].period_us, results[i].rc, results[i].amplitude, results[i].error * 3300,
+			results[i].splatter_db, results[i].cbs,
+			(option_queue * results[i].cbs * CB_SIZE + PAGE_SIZE - 1) / PAGE_SIZE);
+	printf("Best:                 psk31 --rc=%f --amplitude=%.3f", results[0].rc, results[0].amplitude);
+	if (results[0].period_us != 10)
+		printf(", built with PULSE_WIDTH_INCR_US %d", results[0].period_us);
+	printf("\n");
+	return 0;
+}
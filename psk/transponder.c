@@ -0,0 +1,620 @@
+/*
+ * Linear transponder: I/Q in from the receiver, the passband filtered, moved
+ * and levelled, and I/Q out to the codec.
+ *
+ * There is a thread for every stage, and the stages hand blocks of frames on
+ * through queues that have one writer and one reader each and no locks:
+ *
+ *   input   reads a block from a file, stdin or an I/Q ring (see iqring.h)
+ *   filter  keeps the passband, by overlap-save with an FFT
+ *   shift   inverts the spectrum if asked, moves it with an NCO, sets the
+ *           level (AGC) with the peaks held under a limit (ALC), and
+ *           resamples to the rate of the output
+ *   output  plays the block on the codec (see audio.h) or puts it in a ring
+ *
+ * The blocks go round, the output hands them back to the input. A block
+ * carries the time it was read, so the latency to the codec is measured,
+ * and every stage adds up its CPU time, which gives the CPU per sample.
+ * Recordings, f32 as GNU Radio writes complex files or s16, can be played
+ * through it for tests.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <getopt.h>
+#include <pthread.h>
+#include "audio.h"
+#include "iqring.h"
+#include "fft.h"
+#include "resample.h"
+
+#define TP_BLOCKS       8       /* Going round the stages */
+#define TP_POLL_US      200
+#define TP_REPORT_S     5
+#define TP_AGC_ATTACK_S 0.01    /* Time constants of the AGC */
+#define TP_AGC_DECAY_S  0.5
+#define TP_ALC_S        0.05    /* Release of the ALC */
+
+enum {
+	STAGE_INPUT,
+	STAGE_FILTER,
+	STAGE_SHIFT,
+	STAGE_OUTPUT,
+
+	STAGE_COUNT
+};
+
+static const char *const stage_names[] = {
+	[STAGE_INPUT] = "input",
+	[STAGE_FILTER] = "filter",
+	[STAGE_SHIFT] = "shift",
+	[STAGE_OUTPUT] = "output",
+};
+
+typedef struct {
+	float *iq;              /* Frames */
+	unsigned n;
+	uint64_t t_read;        /* ns, when read */
+	int last;               /* End of the input */
+} block_t;
+
+// One writer, one reader; never full, as there are only TP_BLOCKS blocks
+typedef struct {
+	block_t *slot[TP_BLOCKS];
+	uint32_t put __attribute__((aligned(64)));
+	uint32_t get __attribute__((aligned(64)));
+} queue_t;
+
+static const struct option long_options[] = {
+	{"device", required_argument, NULL, 'd'},
+	{"fft", required_argument, NULL, 'N'},
+	{"format", required_argument, NULL, 'f'},
+	{"help", no_argument, NULL, 'h'},
+	{"input", required_argument, NULL, 'i'},
+	{"invert", no_argument, NULL, 'v'},
+	{"level", required_argument, NULL, 'l'},
+	{"limit", required_argument, NULL, 'L'},
+	{"max-gain", required_argument, NULL, 'g'},
+	{"out-rate", required_argument, NULL, 'o'},
+	{"out-ring", required_argument, NULL, 'O'},
+	{"passband", required_argument, NULL, 'b'},
+	{"period", required_argument, NULL, 'p'},
+	{"periods", required_argument, NULL, 'n'},
+	{"rate", required_argument, NULL, 'r'},
+	{"ring", required_argument, NULL, 'I'},
+	{"shift", required_argument, NULL, 's'},
+	{NULL, 0, NULL, 0}
+};
+
+static volatile sig_atomic_t stop;
+
+/* Settings */
+static int in_fd = -1;
+static int in_format = IQRING_F32;
+static iqring_t in_ring;
+static unsigned in_rate = 48000, out_rate;
+static double pass_low = -10000, pass_high = 10000;
+static double shift_hz;
+static int invert;
+static double level_db = -20, limit_db = -1, max_gain_db = 60;
+static double level, limit, max_gain;
+
+/* Pipeline */
+static unsigned fft_n = 512, taps, hop;         /* Overlap-save: hop = fft_n - taps + 1 */
+static unsigned block_max;                      /* Frames a block holds */
+static block_t blocks[TP_BLOCKS];
+static queue_t queue[STAGE_COUNT];              /* Into each stage */
+static double stage_cpu_s[STAGE_COUNT];
+static uint64_t frames_in, frames_out;
+static double gain_db;
+static double latency_sum_ms, latency_max_ms;
+static unsigned long latency_count;
+
+static void on_signal(int sig) {
+	stop = 1;
+}
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static double cpu_s(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void queue_put(queue_t *q, block_t *b) {
+	q->slot[q->put % TP_BLOCKS] = b;
+	__atomic_store_n(&q->put, q->put + 1, __ATOMIC_RELEASE);
+}
+
+// NULL when stopped
+static block_t *queue_get(queue_t *q) {
+	block_t *b;
+
+	while (__atomic_load_n(&q->put, __ATOMIC_ACQUIRE) == q->get) {
+		if (stop)
+			return NULL;
+		usleep(TP_POLL_US);
+	}
+	b = q->slot[q->get % TP_BLOCKS];
+	__atomic_store_n(&q->get, q->get + 1, __ATOMIC_RELEASE);
+	return b;
+}
+
+// A block from the file, whole unless at the end; -1 on errors
+static int input_file(float *iq, unsigned n) {
+	size_t fs = in_format == IQRING_S16 ? 2 * sizeof(int16_t) : 2 * sizeof(float);
+	size_t len = n * fs, got = 0;
+	int16_t *s = (int16_t *)iq;
+	ssize_t ss;
+	unsigned i;
+
+	/* s16 is read into the second half and widened from the front */
+	if (in_format == IQRING_S16)
+		s = (int16_t *)iq + n * 2;
+	while (got < len && !stop) {
+		if ((ss = read(in_fd, (uint8_t *)s + got, len - got)) < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (ss == 0)
+			break;
+		got += ss;
+	}
+	n = got / fs;
+	if (in_format == IQRING_S16)
+		for (i = 0; i < n * 2; i++)
+			iq[i] = s[i] / 32767.0f;
+	return n;
+}
+
+// A whole block from the ring, waiting for it
+static int input_ring(float *iq, unsigned n) {
+	unsigned done = 0, k;
+
+	while (done < n && !stop) {
+		if (!(k = iqring_read_float(&in_ring, iq + done * 2, n - done)))
+			usleep(TP_POLL_US);
+		done += k;
+	}
+	return done;
+}
+
+static void *input_thread(void *arg) {
+	block_t *b;
+	double t0;
+	int n;
+
+	while ((b = queue_get(&queue[STAGE_INPUT]))) {
+		t0 = cpu_s();
+		n = in_ring.hdr ? input_ring(b->iq, hop) : input_file(b->iq, hop);
+		if (n < 0)
+			fprintf(stderr, "transponder: read: %m\n");
+		b->n = n > 0 ? n : 0;
+		b->t_read = now_ns();
+		b->last = n < (int)hop;
+		frames_in += b->n;
+		stage_cpu_s[STAGE_INPUT] += cpu_s() - t0;
+		queue_put(&queue[STAGE_FILTER], b);
+		if (b->last)
+			break;
+	}
+	return NULL;
+}
+
+// The passband as a windowed sinc moved to its centre, in the frequency domain
+static float *filter_response(const fft_t *f) {
+	double fc = (pass_high - pass_low) / 2 / in_rate;
+	double f0 = (pass_high + pass_low) / 2 / in_rate;
+	double x, h, w;
+	float *resp;
+	unsigned k;
+
+	if (!(resp = calloc(fft_n * 2, sizeof(float))))
+		return NULL;
+	for (k = 0; k < taps; k++) {
+		x = k - (taps - 1) / 2.0;
+		h = x == 0 ? 2 * fc : sin(2 * M_PI * fc * x) / (M_PI * x);
+		/* Blackman */
+		w = 0.42 - 0.5 * cos(2 * M_PI * k / (taps - 1)) + 0.08 * cos(4 * M_PI * k / (taps - 1));
+		resp[k * 2] = h * w * cos(2 * M_PI * f0 * x) / fft_n;
+		resp[k * 2 + 1] = h * w * sin(2 * M_PI * f0 * x) / fft_n;
+	}
+	fft_run(f, resp, 0);
+	return resp;
+}
+
+static void *filter_thread(void *arg) {
+	float *resp, *x, *line, xr, xi;
+	block_t *b;
+	double t0;
+	unsigned i;
+	fft_t f;
+
+	if (fft_init(&f, fft_n) < 0 || !(resp = filter_response(&f)) ||
+			!(x = malloc(fft_n * 2 * sizeof(float))) ||
+			!(line = calloc(fft_n * 2, sizeof(float)))) {
+		fprintf(stderr, "transponder: out of memory\n");
+		stop = 1;
+		return NULL;
+	}
+	/* line holds the last taps - 1 frames, then the block */
+	while ((b = queue_get(&queue[STAGE_FILTER]))) {
+		t0 = cpu_s();
+		memcpy(line + (taps - 1) * 2, b->iq, b->n * 2 * sizeof(float));
+		memset(line + (taps - 1 + b->n) * 2, 0, (hop - b->n) * 2 * sizeof(float));
+		memcpy(x, line, fft_n * 2 * sizeof(float));
+		fft_run(&f, x, 0);
+		for (i = 0; i < fft_n; i++) {
+			xr = x[i * 2];
+			xi = x[i * 2 + 1];
+			x[i * 2] = xr * resp[i * 2] - xi * resp[i * 2 + 1];
+			x[i * 2 + 1] = xr * resp[i * 2 + 1] + xi * resp[i * 2];
+		}
+		fft_run(&f, x, 1);
+		/* The first taps - 1 frames are wrapped round, the rest is the block */
+		memcpy(b->iq, x + (taps - 1) * 2, b->n * 2 * sizeof(float));
+		memmove(line, line + b->n * 2, (taps - 1) * 2 * sizeof(float));
+		stage_cpu_s[STAGE_FILTER] += cpu_s() - t0;
+		queue_put(&queue[STAGE_SHIFT], b);
+		if (b->last)
+			break;
+	}
+	fft_free(&f);
+	free(resp);
+	free(x);
+	free(line);
+	return NULL;
+}
+
+static void *shift_thread(void *arg) {
+	double wr = cos(2 * M_PI * shift_hz / in_rate), wi = sin(2 * M_PI * shift_hz / in_rate);
+	double attack = 1 - exp(-1 / (TP_AGC_ATTACK_S * in_rate));
+	double decay = 1 - exp(-1 / (TP_AGC_DECAY_S * in_rate));
+	double release = exp(-1 / (TP_ALC_S * in_rate));
+	double zr = 1, zi = 0, t, power = 0, peak = 0, g, m, t0;
+	float *tmp = NULL, ir, iq;
+	resample_t rs;
+	block_t *b;
+	unsigned i;
+
+	if (out_rate != in_rate) {
+		if (resample_init(&rs, in_rate, out_rate, 16) < 0 || !(tmp = malloc(hop * 2 * sizeof(float)))) {
+			fprintf(stderr, "transponder: cannot resample: %m\n");
+			stop = 1;
+			return NULL;
+		}
+	}
+	while ((b = queue_get(&queue[STAGE_SHIFT]))) {
+		t0 = cpu_s();
+		for (i = 0; i < b->n; i++) {
+			ir = b->iq[i * 2];
+			iq = invert ? -b->iq[i * 2 + 1] : b->iq[i * 2 + 1];
+			/* AGC on the mean power, ALC on the peaks it leaves */
+			m = ir * ir + iq * iq;
+			power += (m > power ? attack : decay) * (m - power);
+			g = level / sqrt(power + 1e-20);
+			if (g > max_gain)
+				g = max_gain;
+			m = sqrt(m) * g;
+			peak = m > peak ? m : peak * release;
+			if (peak > limit)
+				g *= limit / peak;
+			b->iq[i * 2] = (ir * zr - iq * zi) * g;
+			b->iq[i * 2 + 1] = (ir * zi + iq * zr) * g;
+			t = zr * wr - zi * wi;
+			zi = zr * wi + zi * wr;
+			zr = t;
+		}
+		/* The NCO is kept on the unit circle */
+		t = 1 / sqrt(zr * zr + zi * zi);
+		zr *= t;
+		zi *= t;
+		gain_db = 10 * log10(level * level / (power + 1e-20));
+		if (tmp) {
+			memcpy(tmp, b->iq, b->n * 2 * sizeof(float));
+			b->n = resample_run(&rs, tmp, b->n, b->iq);
+		}
+		stage_cpu_s[STAGE_SHIFT] += cpu_s() - t0;
+		queue_put(&queue[STAGE_OUTPUT], b);
+		if (b->last)
+			break;
+	}
+	if (tmp) {
+		resample_free(&rs);
+		free(tmp);
+	}
+	return NULL;
+}
+
+static int16_t to_s16(float v) {
+	if (v >= 1.0f)
+		return 32767;
+	if (v <= -1.0f)
+		return -32767;
+	return (int16_t)lrintf(v * 32767.0f);
+}
+
+// The block into the codec, or into the ring if there is room
+static int output(audio_t *a, iqring_t *r, const block_t *b) {
+	unsigned done, k, i;
+	int16_t *out;
+	float *p;
+
+	for (done = 0; done < b->n; done += k) {
+		if (r->hdr) {
+			if (!(k = iqring_writable(r, (void **)&p))) {
+				__atomic_store_n(&r->hdr->overruns, r->hdr->overruns + b->n - done, __ATOMIC_RELAXED);
+				return 0;
+			}
+			if (k > b->n - done)
+				k = b->n - done;
+			memcpy(p, b->iq + done * 2, k * 2 * sizeof(float));
+			iqring_commit(r, k);
+			continue;
+		}
+		if (!(out = audio_begin(a, &k)))
+			return -1;
+		if (k > b->n - done)
+			k = b->n - done;
+		for (i = 0; i < k * 2; i++)
+			out[i] = to_s16(b->iq[done * 2 + i]);
+		if (audio_commit(a, k) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+static void report(const audio_t *a, const iqring_t *r) {
+	double cpu = 0;
+	int i;
+
+	printf("Frames:               %llu in, %llu out, gain %.1f dB\n", (unsigned long long)frames_in,
+		(unsigned long long)frames_out, gain_db);
+	printf("Latency:              %.1f ms avg, %.1f ms max\n",
+		latency_count ? latency_sum_ms / latency_count : 0, latency_max_ms);
+	if (r->hdr)
+		printf("Overruns:             %llu frames\n", (unsigned long long)r->hdr->overruns);
+	else
+		printf("Codec:                %.1f ms latency, %u xruns\n", a->latency_us / 1e3, a->xruns);
+	for (i = 0; i < STAGE_COUNT; i++)
+		cpu += stage_cpu_s[i];
+	if (frames_in) {
+		printf("CPU:                  %.0f ns/sample:", cpu * 1e9 / frames_in);
+		for (i = 0; i < STAGE_COUNT; i++)
+			printf(" %s %.0f", stage_names[i], stage_cpu_s[i] * 1e9 / frames_in);
+		printf("\n");
+	}
+	fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+	const char *device = "hw:0,0", *input = NULL, *ring = NULL, *out_ring = NULL;
+	unsigned period = 256, periods = 4;
+	uint64_t next_report;
+	double lat, t0;
+	pthread_t thread[STAGE_OUTPUT];
+	void *(*stage[STAGE_OUTPUT])(void *) = {input_thread, filter_thread, shift_thread};
+	iqring_t r = {NULL};
+	audio_t a;
+	block_t *b;
+	int i, rc = 0;
+
+	while (1) {
+		int opt;
+		int opt_index;
+
+		opt_index = 0;
+		opt = getopt_long(argc, argv, "d:i:", long_options, &opt_index);
+		if (opt == -1)
+			break;
+		switch (opt) {
+			case 'b':
+				if (sscanf(optarg, "%lf:%lf", &pass_low, &pass_high) != 2 || pass_high <= pass_low) {
+					fprintf(stderr, "transponder: invalid passband %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'd':
+				device = optarg;
+				break;
+			case 'f':
+				if (strcmp(optarg, "s16") == 0)
+					in_format = IQRING_S16;
+				else if (strcmp(optarg, "f32") == 0)
+					in_format = IQRING_F32;
+				else {
+					fprintf(stderr, "transponder: invalid format %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'g':
+				max_gain_db = atof(optarg);
+				break;
+			case 'h':
+				fprintf(stderr,
+					"Usage: transponder --input=<file>|--ring=<path> [options]\n"
+					"Options:\n"
+					"  --device=<dev>      Codec, hw:<card>,<device>, null or file:<path> [hw:0,0]\n"
+					"  --fft=<n>           FFT size of the filter, a power of 2 [512]\n"
+					"  --format=<f>        s16 or f32, of the input file [f32]\n"
+					"  --help              Show this help\n"
+					"  --input=<file>      Read I/Q from the file, - for stdin\n"
+					"  --invert            Invert the spectrum\n"
+					"  --level=<dBFS>      Mean output level [-20]\n"
+					"  --limit=<dBFS>      Peak output level [-1]\n"
+					"  --max-gain=<dB>     Largest gain of the AGC [60]\n"
+					"  --out-rate=<n>      Output samples per second [the input rate]\n"
+					"  --out-ring=<path>   Put the output in a new I/Q ring, not the codec\n"
+					"  --passband=<lo>:<hi> Hz, of the input [-10000:10000]\n"
+					"  --period=<n>        Codec frames per period [256]\n"
+					"  --periods=<n>       Codec periods in the buffer [4]\n"
+					"  --rate=<n>          Input samples per second, of a file [48000]\n"
+					"  --ring=<path>       Read I/Q from the ring\n"
+					"  --shift=<Hz>        Move the passband by this much [0]\n");
+				return 0;
+			case 'i':
+				input = optarg;
+				break;
+			case 'I':
+				ring = optarg;
+				break;
+			case 'l':
+				level_db = atof(optarg);
+				break;
+			case 'L':
+				limit_db = atof(optarg);
+				break;
+			case 'n':
+				periods = strtoul(optarg, NULL, 0);
+				break;
+			case 'N':
+				fft_n = strtoul(optarg, NULL, 0);
+				break;
+			case 'o':
+				out_rate = strtoul(optarg, NULL, 0);
+				break;
+			case 'O':
+				out_ring = optarg;
+				break;
+			case 'p':
+				period = strtoul(optarg, NULL, 0);
+				break;
+			case 'r':
+				in_rate = strtoul(optarg, NULL, 0);
+				break;
+			case 's':
+				shift_hz = atof(optarg);
+				break;
+			case 'v':
+				invert = 1;
+				break;
+			default:
+				fprintf(stderr, "transponder: invalid options\n");
+				return 1;
+		}
+	}
+	if (!input == !ring) {
+		fprintf(stderr, "transponder: --input or --ring\n");
+		return 1;
+	}
+	if (fft_n < 16 || (fft_n & (fft_n - 1))) {
+		fprintf(stderr, "transponder: invalid FFT size %u\n", fft_n);
+		return 1;
+	}
+	if (ring) {
+		if (iqring_attach(&in_ring, ring) < 0) {
+			fprintf(stderr, "transponder: cannot open ring %s: %m\n", ring);
+			return 1;
+		}
+		in_rate = in_ring.hdr->rate;
+		printf("Input:                ring %s, %s, %u Hz\n", ring,
+			in_ring.hdr->format == IQRING_S16 ? "s16" : "f32", in_rate);
+	} else {
+		if ((in_fd = strcmp(input, "-") == 0 ? 0 : open(input, O_RDONLY)) < 0) {
+			fprintf(stderr, "transponder: cannot open %s: %m\n", input);
+			return 1;
+		}
+		printf("Input:                %s, %s, %u Hz\n", input,
+			in_format == IQRING_S16 ? "s16" : "f32", in_rate);
+	}
+	if (!out_rate)
+		out_rate = in_rate;
+	taps = fft_n / 4 + 1;
+	hop = fft_n - taps + 1;
+	printf("Filter:               %.0f to %.0f Hz, %u taps, FFT %u, %.1f ms blocks\n",
+		pass_low, pass_high, taps, fft_n, hop * 1e3 / in_rate);
+	printf("Shift:                %.0f Hz%s\n", shift_hz, invert ? ", inverted" : "");
+	level = pow(10, level_db / 20);
+	limit = pow(10, limit_db / 20);
+	max_gain = pow(10, max_gain_db / 20);
+	printf("Level:                %.1f dBFS mean, %.1f dBFS peak, %.0f dB gain at most\n",
+		level_db, limit_db, max_gain_db);
+
+	if (out_ring) {
+		if (iqring_create(&r, out_ring, IQRING_F32, out_rate, 1 << 16) < 0) {
+			fprintf(stderr, "transponder: cannot create ring %s: %m\n", out_ring);
+			return 1;
+		}
+		printf("Output:               ring %s, f32, %u Hz\n", out_ring, out_rate);
+	} else {
+		if (audio_open(&a, device, out_rate, period, periods) < 0) {
+			fprintf(stderr, "transponder: cannot open %s: %m\n", device);
+			return 1;
+		}
+		printf("Output:               %s, %u Hz, %u frames x %u, %.1f ms\n", device, a.rate,
+			a.period, a.buffer / a.period, a.buffer * 1e3 / a.rate);
+	}
+
+	/* Room for a block after resampling */
+	block_max = hop > (unsigned long long)hop * out_rate / in_rate + 2 ?
+		hop : (unsigned long long)hop * out_rate / in_rate + 2;
+	for (i = 0; i < TP_BLOCKS; i++) {
+		if (!(blocks[i].iq = malloc(block_max * 2 * sizeof(float)))) {
+			fprintf(stderr, "transponder: out of memory\n");
+			return 1;
+		}
+		queue_put(&queue[STAGE_INPUT], &blocks[i]);
+	}
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	signal(SIGPIPE, on_signal);
+	for (i = 0; i < STAGE_OUTPUT; i++)
+		if ((errno = pthread_create(&thread[i], NULL, stage[i], NULL)) != 0) {
+			fprintf(stderr, "transponder: cannot start the %s stage: %m\n", stage_names[i]);
+			return 1;
+		}
+
+	next_report = now_ns() + TP_REPORT_S * 1000000000ULL;
+	while ((b = queue_get(&queue[STAGE_OUTPUT]))) {
+		t0 = cpu_s();
+		if (output(&a, &r, b) < 0) {
+			fprintf(stderr, "transponder: %s: %m\n", device);
+			rc = 2;
+			break;
+		}
+		frames_out += b->n;
+		/* From the read to the codec, and on through it */
+		lat = (now_ns() - b->t_read) / 1e6;
+		if (!r.hdr)
+			lat += a.latency_us / 1e3;
+		latency_sum_ms += lat;
+		latency_count++;
+		if (lat > latency_max_ms)
+			latency_max_ms = lat;
+		stage_cpu_s[STAGE_OUTPUT] += cpu_s() - t0;
+		if (b->last)
+			break;
+		queue_put(&queue[STAGE_INPUT], b);
+		if (now_ns() >= next_report) {
+			report(&a, &r);
+			next_report += TP_REPORT_S * 1000000000ULL;
+		}
+	}
+	stop = 1;
+	for (i = 0; i < STAGE_OUTPUT; i++)
+		pthread_join(thread[i], NULL);
+	report(&a, &r);
+	if (r.hdr)
+		iqring_close(&r);
+	else
+		audio_close(&a);
+	if (in_ring.hdr)
+		iqring_close(&in_ring);
+	return rc;
+}
@@ -0,0 +1,226 @@
+/*
+ * Binary log of everything a transmitter sends. See txlog.h.
+ */
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "txlog.h"
+
+static void put_varint(FILE *f, uint64_t v) {
+	do {
+		putc((v & 0x7f) | (v > 0x7f ? 0x80 : 0), f);
+		v >>= 7;
+	} while (v);
+}
+
+static int get_varint(FILE *f, uint64_t *v) {
+	int c, shift;
+
+	*v = 0;
+	for (shift = 0; shift < 64; shift += 7) {
+		if ((c = getc(f)) == EOF)
+			return -1;
+		*v |= (uint64_t)(c & 0x7f) << shift;
+		if (!(c & 0x80))
+			return 0;
+	}
+	return -1;
+}
+
+// Symbols starting where the previous one ended: 0x80 | (count - 1), then four to a byte
+static void run_flush(txlog_t *l) {
+	uint8_t b;
+	int i;
+
+	if (!l->run_count)
+		return;
+	putc(0x80 | (l->run_count - 1), l->f);
+	for (i = 0, b = 0; i < l->run_count; i++) {
+		b |= l->run[i] << (2 * (i & 3));
+		if ((i & 3) == 3 || i == l->run_count - 1) {
+			putc(b, l->f);
+			b = 0;
+		}
+	}
+	l->run_count = 0;
+}
+
+static void encode(txlog_t *l, const txlog_rec_t *rec) {
+	int64_t delta;
+
+	if (rec->type == TXLOG_SYM && rec->b == 0 && rec->sample == l->next) {
+		l->run[l->run_count++] = rec->a & 3;
+		l->last = l->next;
+		l->next += l->samples;
+		if (l->run_count == TXLOG_RUN_MAX)
+			run_flush(l);
+		return;
+	}
+	run_flush(l);
+	delta = rec->sample - l->last;
+	putc(rec->type, l->f);
+	put_varint(l->f, ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+	l->last = rec->sample;
+	switch (rec->type) {
+		case TXLOG_SYM:
+			putc(rec->a, l->f);
+			put_varint(l->f, rec->b);
+			l->next = rec->sample + l->samples - rec->b;
+			break;
+		case TXLOG_STATE:
+			putc(rec->a, l->f);
+			break;
+		case TXLOG_CHAR:
+		case TXLOG_PTT:
+			putc(rec->a, l->f);
+			put_varint(l->f, rec->b);
+			break;
+		default:
+			put_varint(l->f, rec->b);
+			break;
+	}
+}
+
+static void drain(txlog_t *l) {
+	txlog_rec_t rec;
+	uint32_t head, tail, lost;
+
+	head = __atomic_load_n(&l->head, __ATOMIC_ACQUIRE);
+	for (tail = l->tail; tail != head; tail++)
+		encode(l, &l->ring[tail & (TXLOG_RING - 1)]);
+	__atomic_store_n(&l->tail, tail, __ATOMIC_RELEASE);
+	lost = __atomic_load_n(&l->lost, __ATOMIC_RELAXED);
+	if (lost != l->lost_written) {
+		memset(&rec, 0, sizeof(rec));
+		rec.type = TXLOG_LOST;
+		rec.b = lost - l->lost_written;
+		rec.sample = l->last;
+		encode(l, &rec);
+		l->lost_written = lost;
+	}
+}
+
+static void *txlog_thread(void *arg) {
+	txlog_t *l = (txlog_t *)arg;
+
+	while (!__atomic_load_n(&l->stop, __ATOMIC_ACQUIRE)) {
+		usleep(TXLOG_FLUSH_MS * 1000);
+		drain(l);
+		fflush(l->f);
+	}
+	return NULL;
+}
+
+int txlog_open(txlog_t *l, const char *path, const txlog_hdr_t *hdr) {
+	memset(l, 0, sizeof(*l));
+	if (!(l->f = fopen(path, "w")))
+		return -1;
+	if (fwrite(hdr, sizeof(*hdr), 1, l->f) != 1 || fflush(l->f) != 0)
+		goto fail;
+	l->samples = hdr->samples;
+	l->next = l->last = hdr->start_sample;
+	if (!(l->ring = malloc(TXLOG_RING * sizeof(*l->ring))))
+		goto fail;
+	if ((errno = pthread_create(&l->thread, NULL, txlog_thread, l)) != 0)
+		goto fail;
+	return 0;
+fail:
+	free(l->ring);
+	l->ring = NULL;
+	fclose(l->f);
+	l->f = NULL;
+	return -1;
+}
+
+// The feeder must have stopped putting records
+void txlog_close(txlog_t *l) {
+	if (!l->f)
+		return;
+	__atomic_store_n(&l->stop, 1, __ATOMIC_RELEASE);
+	pthread_join(l->thread, NULL);
+	drain(l);
+	run_flush(l);
+	fclose(l->f);
+	l->f = NULL;
+	free(l->ring);
+	l->ring = NULL;
+}
+
+int txlog_reader_open(txlog_reader_t *r, const char *path) {
+	memset(r, 0, sizeof(*r));
+	if (!(r->f = fopen(path, "r")))
+		return -1;
+	if (fread(&r->hdr, offsetof(txlog_hdr_t, serial), 1, r->f) != 1 ||
+			r->hdr.magic != TXLOG_MAGIC || r->hdr.version < 1 || r->hdr.version > TXLOG_VERSION ||
+			(r->hdr.version > 1 && fread(&r->hdr.serial, sizeof(r->hdr) - offsetof(txlog_hdr_t, serial), 1, r->f) != 1)) {
+		fclose(r->f);
+		errno = EINVAL;
+		return -1;
+	}
+	r->hdr.shape[sizeof(r->hdr.shape) - 1] = 0;
+	r->hdr.predistort[sizeof(r->hdr.predistort) - 1] = 0;
+	r->hdr.name[sizeof(r->hdr.name) - 1] = 0;
+	r->next = r->last = r->hdr.start_sample;
+	return 0;
+}
+
+// Next record, 0 at the end. A record cut short by a crash ends the log.
+int txlog_read(txlog_reader_t *r, txlog_rec_t *rec) {
+	uint64_t v;
+	int c, i;
+
+	memset(rec, 0, sizeof(*rec));
+	while (r->run_pos == r->run_count) {
+		if ((c = getc(r->f)) == EOF)
+			return 0;
+		if (!(c & 0x80))
+			goto record;
+		r->run_count = (c & 0x7f) + 1;
+		if (r->run_count > TXLOG_RUN_MAX)
+			return 0;
+		for (i = 0; i < r->run_count; i++) {
+			if ((i & 3) == 0 && (c = getc(r->f)) == EOF)
+				return 0;
+			r->run[i] = (c >> (2 * (i & 3))) & 3;
+		}
+		r->run_pos = 0;
+	}
+	rec->type = TXLOG_SYM;
+	rec->a = r->run[r->run_pos++];
+	rec->sample = r->last = r->next;
+	r->next += r->hdr.samples;
+	return 1;
+
+record:
+	rec->type = c;
+	if (get_varint(r->f, &v) < 0)
+		return 0;
+	rec->sample = r->last += (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+	switch (rec->type) {
+		case TXLOG_SYM:
+		case TXLOG_STATE:
+		case TXLOG_CHAR:
+		case TXLOG_PTT:
+			if ((c = getc(r->f)) == EOF)
+				return 0;
+			rec->a = c;
+			if (rec->type == TXLOG_STATE)
+				break;
+			/* Fall through */
+		default:
+			if (get_varint(r->f, &v) < 0)
+				return 0;
+			rec->b = v;
+			break;
+	}
+	if (rec->type == TXLOG_SYM)
+		r->next = rec->sample + r->hdr.samples - rec->b;
+	return 1;
+}
+
+void txlog_reader_close(txlog_reader_t *r) {
+	fclose(r->f);
+}
@@ -0,0 +1,115 @@
+/*
+ * Binary log of everything a transmitter sends.
+ *
+ * The feeder puts fixed size records in a ring it shares with a thread of
+ * the log, without locks or system calls; when the ring is full records are
+ * counted as lost rather than waited for. The thread encodes them and writes
+ * them out. Consecutive symbols are packed four to a byte, other records are
+ * a type byte followed by varints, the sample number as a delta.
+ *
+ * The header keeps the settings the symbols were generated with, so the
+ * waveform can be generated again from the log (psk31 --replay).
+ */
+#ifndef TXLOG_H
+#define TXLOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define TXLOG_MAGIC     0x4c4b5350      /* "PSKL" */
+#define TXLOG_VERSION   3               /* 1 has no serial, 2 no PTT */
+#define TXLOG_RING      8192            /* Records, a power of 2 */
+#define TXLOG_FLUSH_MS  200
+#define TXLOG_RUN_MAX   64              /* Symbols packed in one run */
+
+enum {
+	TXLOG_SYM = 1,          /* a: symbol, b: samples skipped */
+	TXLOG_STATE,            /* a: state of the feeder */
+	TXLOG_CHAR,             /* a: character, b: message id, 0 for the FIFO */
+	TXLOG_CLOCK,            /* b: carrier clock divisor */
+	TXLOG_LOST,             /* b: records the ring had no room for */
+	TXLOG_PTT,              /* a: line, on and set, b: GPIO mask */
+};
+
+typedef struct {
+	uint8_t type;
+	uint8_t a;
+	uint16_t pad;
+	uint32_t b;
+	uint64_t sample;        /* Start of the symbol, or when it happened */
+} txlog_rec_t;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t start_ns;      /* CLOCK_REALTIME when the log was opened ... */
+	uint64_t start_sample;  /* ... and the next sample then */
+	uint32_t sample_us;
+	uint32_t samples;       /* Per symbol */
+	double amplitude;
+	double rc;
+	double frequency;
+	uint32_t div;
+	uint32_t mash;
+	char shape[64];
+	char predistort[64];
+	char name[16];
+	uint32_t serial;        /* Serializer bits per sample, 0 for GPIO writes */
+} txlog_hdr_t;
+
+typedef struct {
+	/* Shared with the feeder */
+	txlog_rec_t *ring;      /* NULL when not logging */
+	uint32_t head;
+	uint32_t tail;
+	uint32_t lost;
+	/* Writer thread */
+	FILE *f;
+	pthread_t thread;
+	int stop;
+	uint32_t samples;
+	uint32_t lost_written;
+	uint64_t next;          /* Where a symbol following the last one starts */
+	uint64_t last;          /* Sample of the last record written */
+	uint8_t run[TXLOG_RUN_MAX];
+	int run_count;
+} txlog_t;
+
+typedef struct {
+	FILE *f;
+	txlog_hdr_t hdr;
+	uint64_t next;
+	uint64_t last;
+	uint8_t run[TXLOG_RUN_MAX];
+	int run_count;
+	int run_pos;
+} txlog_reader_t;
+
+int txlog_open(txlog_t *l, const char *path, const txlog_hdr_t *hdr);
+void txlog_close(txlog_t *l);
+int txlog_reader_open(txlog_reader_t *r, const char *path);
+int txlog_read(txlog_reader_t *r, txlog_rec_t *rec);
+void txlog_reader_close(txlog_reader_t *r);
+
+// Called by the feeder only
+static inline void txlog_put(txlog_t *l, int type, int a, uint32_t b, uint64_t sample) {
+	txlog_rec_t *rec;
+	uint32_t head;
+
+	if (!l->ring)
+		return;
+	head = l->head;
+	if (head - __atomic_load_n(&l->tail, __ATOMIC_ACQUIRE) == TXLOG_RING) {
+		__atomic_store_n(&l->lost, l->lost + 1, __ATOMIC_RELAXED);
+		return;
+	}
+	rec = &l->ring[head & (TXLOG_RING - 1)];
+	rec->type = type;
+	rec->a = a;
+	rec->b = b;
+	rec->sample = sample;
+	__atomic_store_n(&l->head, head + 1, __ATOMIC_RELEASE);
+}
+
+#endif
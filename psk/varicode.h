@@ -0,0 +1,272 @@
+/*
+ * PSK31 varicode, as made by the varicode program.
+ */
+#ifndef VARICODE_H
+#define VARICODE_H
+
+typedef struct {
+	int b_len;
+	int b_val;
+} burst_t;
+
+/* Each character is separated by last two zeros. The bits are sent lsbit first. */
+static const burst_t varicode_table[] = {
+	{12, 0x0355}, /* ASCII =   0 101010101100 */
+	{12, 0x036d}, /* ASCII =   1 101101101100 */
+	{12, 0x02dd}, /* ASCII =   2 101110110100 */
+	{12, 0x03bb}, /* ASCII =   3 110111011100 */
+	{12, 0x035d}, /* ASCII =   4 101110101100 */
+	{12, 0x03eb}, /* ASCII =   5 110101111100 */
+	{12, 0x03dd}, /* ASCII =   6 101110111100 */
+	{12, 0x02fd}, /* ASCII =   7 101111110100 */
+	{12, 0x03fd}, /* ASCII =   8 101111111100 */
+	{10, 0x00f7}, /* ASCII =   9 1110111100 */
+	{ 7, 0x0017}, /* ASCII =  10 1110100 */
+	{12, 0x03db}, /* ASCII =  11 110110111100 */
+	{12, 0x02ed}, /* ASCII =  12 101101110100 */
+	{ 7, 0x001f}, /* ASCII =  13 1111100 */
+	{12, 0x02bb}, /* ASCII =  14 110111010100 */
+	{12, 0x0357}, /* ASCII =  15 111010101100 */
+	{12, 0x03bd}, /* ASCII =  16 101111011100 */
+	{12, 0x02bd}, /* ASCII =  17 101111010100 */
+	{12, 0x02d7}, /* ASCII =  18 111010110100 */
+	{12, 0x03d7}, /* ASCII =  19 111010111100 */
+	{12, 0x036b}, /* ASCII =  20 110101101100 */
+	{12, 0x035b}, /* ASCII =  21 110110101100 */
+	{12, 0x02db}, /* ASCII =  22 110110110100 */
+	{12, 0x03ab}, /* ASCII =  23 110101011100 */
+	{12, 0x037b}, /* ASCII =  24 110111101100 */
+	{12, 0x02fb}, /* ASCII =  25 110111110100 */
+	{12, 0x03b7}, /* ASCII =  26 111011011100 */
+	{12, 0x02ab}, /* ASCII =  27 110101010100 */
+	{12, 0x02eb}, /* ASCII =  28 110101110100 */
+	{12, 0x0377}, /* ASCII =  29 111011101100 */
+	{12, 0x037d}, /* ASCII =  30 101111101100 */
+	{12, 0x03fb}, /* ASCII =  31 110111111100 */
+	{ 3, 0x0001}, /* ASCII = ' ' 100 */
+	{11, 0x01ff}, /* ASCII = '!' 11111111100 */
+	{11, 0x01f5}, /* ASCII = '"' 10101111100 */
+	{11, 0x015f}, /* ASCII = '#' 11111010100 */
+	{11, 0x01b7}, /* ASCII = '$' 11101101100 */
+	{12, 0x02ad}, /* ASCII = '%' 101101010100 */
+	{12, 0x0375}, /* ASCII = '&' 101011101100 */
+	{11, 0x01fd}, /* ASCII = ''' 10111111100 */
+	{10, 0x00df}, /* ASCII = '(' 1111101100 */
+	{10, 0x00ef}, /* ASCII = ')' 1111011100 */
+	{11, 0x01ed}, /* ASCII = '*' 10110111100 */
+	{11, 0x01f7}, /* ASCII = '+' 11101111100 */
+	{ 9, 0x0057}, /* ASCII = ',' 111010100 */
+	{ 8, 0x002b}, /* ASCII = '-' 11010100 */
+	{ 9, 0x0075}, /* ASCII = '.' 101011100 */
+	{11, 0x01eb}, /* ASCII = '/' 11010111100 */
+	{10, 0x00ed}, /* ASCII = '0' 1011011100 */
+	{10, 0x00bd}, /* ASCII = '1' 1011110100 */
+	{10, 0x00b7}, /* ASCII = '2' 1110110100 */
+	{10, 0x00ff}, /* ASCII = '3' 1111111100 */
+	{11, 0x01dd}, /* ASCII = '4' 10111011100 */
+	{11, 0x01b5}, /* ASCII = '5' 10101101100 */
+	{11, 0x01ad}, /* ASCII = '6' 10110101100 */
+	{11, 0x016b}, /* ASCII = '7' 11010110100 */
+	{11, 0x01ab}, /* ASCII = '8' 11010101100 */
+	{11, 0x01db}, /* ASCII = '9' 11011011100 */
+	{10, 0x00af}, /* ASCII = ':' 1111010100 */
+	{11, 0x017b}, /* ASCII = ';' 11011110100 */
+	{11, 0x016f}, /* ASCII = '<' 11110110100 */
+	{ 9, 0x0055}, /* ASCII = '=' 101010100 */
+	{11, 0x01d7}, /* ASCII = '>' 11101011100 */
+	{12, 0x03d5}, /* ASCII = '?' 101010111100 */
+	{12, 0x02f5}, /* ASCII = '@' 101011110100 */
+	{ 9, 0x005f}, /* ASCII = 'A' 111110100 */
+	{10, 0x00d7}, /* ASCII = 'B' 1110101100 */
+	{10, 0x00b5}, /* ASCII = 'C' 1010110100 */
+	{10, 0x00ad}, /* ASCII = 'D' 1011010100 */
+	{ 9, 0x0077}, /* ASCII = 'E' 111011100 */
+	{10, 0x00db}, /* ASCII = 'F' 1101101100 */
+	{10, 0x00bf}, /* ASCII = 'G' 1111110100 */
+	{11, 0x0155}, /* ASCII = 'H' 10101010100 */
+	{ 9, 0x007f}, /* ASCII = 'I' 111111100 */
+	{11, 0x017f}, /* ASCII = 'J' 11111110100 */
+	{11, 0x017d}, /* ASCII = 'K' 10111110100 */
+	{10, 0x00eb}, /* ASCII = 'L' 1101011100 */
+	{10, 0x00dd}, /* ASCII = 'M' 1011101100 */
+	{10, 0x00bb}, /* ASCII = 'N' 1101110100 */
+	{10, 0x00d5}, /* ASCII = 'O' 1010101100 */
+	{10, 0x00ab}, /* ASCII = 'P' 1101010100 */
+	{11, 0x0177}, /* ASCII = 'Q' 11101110100 */
+	{10, 0x00f5}, /* ASCII = 'R' 1010111100 */
+	{ 9, 0x007b}, /* ASCII = 'S' 110111100 */
+	{ 9, 0x005b}, /* ASCII = 'T' 110110100 */
+	{11, 0x01d5}, /* ASCII = 'U' 10101011100 */
+	{11, 0x015b}, /* ASCII = 'V' 11011010100 */
+	{11, 0x0175}, /* ASCII = 'W' 10101110100 */
+	{11, 0x015d}, /* ASCII = 'X' 10111010100 */
+	{11, 0x01bd}, /* ASCII = 'Y' 10111101100 */
+	{12, 0x02d5}, /* ASCII = 'Z' 101010110100 */
+	{11, 0x01df}, /* ASCII = '[' 11111011100 */
+	{11, 0x01ef}, /* ASCII = '\' 11110111100 */
+	{11, 0x01bf}, /* ASCII = ']' 11111101100 */
+	{12, 0x03f5}, /* ASCII = '^' 101011111100 */
+	{11, 0x016d}, /* ASCII = '_' 10110110100 */
+	{12, 0x03ed}, /* ASCII = '`' 101101111100 */
+	{ 6, 0x000d}, /* ASCII = 'a' 101100 */
+	{ 9, 0x007d}, /* ASCII = 'b' 101111100 */
+	{ 8, 0x003d}, /* ASCII = 'c' 10111100 */
+	{ 8, 0x002d}, /* ASCII = 'd' 10110100 */
+	{ 4, 0x0003}, /* ASCII = 'e' 1100 */
+	{ 8, 0x002f}, /* ASCII = 'f' 11110100 */
+	{ 9, 0x006d}, /* ASCII = 'g' 101101100 */
+	{ 8, 0x0035}, /* ASCII = 'h' 10101100 */
+	{ 6, 0x000b}, /* ASCII = 'i' 110100 */
+	{11, 0x01af}, /* ASCII = 'j' 11110101100 */
+	{10, 0x00fd}, /* ASCII = 'k' 1011111100 */
+	{ 7, 0x001b}, /* ASCII = 'l' 1101100 */
+	{ 8, 0x0037}, /* ASCII = 'm' 11101100 */
+	{ 6, 0x000f}, /* ASCII = 'n' 111100 */
+	{ 5, 0x0007}, /* ASCII = 'o' 11100 */
+	{ 8, 0x003f}, /* ASCII = 'p' 11111100 */
+	{11, 0x01fb}, /* ASCII = 'q' 11011111100 */
+	{ 7, 0x0015}, /* ASCII = 'r' 1010100 */
+	{ 7, 0x001d}, /* ASCII = 's' 1011100 */
+	{ 5, 0x0005}, /* ASCII = 't' 10100 */
+	{ 8, 0x003b}, /* ASCII = 'u' 11011100 */
+	{ 9, 0x006f}, /* ASCII = 'v' 111101100 */
+	{ 9, 0x006b}, /* ASCII = 'w' 110101100 */
+	{10, 0x00fb}, /* ASCII = 'x' 1101111100 */
+	{ 9, 0x005d}, /* ASCII = 'y' 101110100 */
+	{11, 0x0157}, /* ASCII = 'z' 11101010100 */
+	{12, 0x03b5}, /* ASCII = '{' 101011011100 */
+	{11, 0x01bb}, /* ASCII = '|' 11011101100 */
+	{12, 0x02b5}, /* ASCII = '}' 101011010100 */
+	{12, 0x03ad}, /* ASCII = '~' 101101011100 */
+	{12, 0x02b7}, /* ASCII = 127 111011010100 */
+	{12, 0x02f7}, /* ASCII = 128 111011110100 */
+	{12, 0x03f7}, /* ASCII = 129 111011111100 */
+	{12, 0x02af}, /* ASCII = 130 111101010100 */
+	{12, 0x03af}, /* ASCII = 131 111101011100 */
+	{12, 0x036f}, /* ASCII = 132 111101101100 */
+	{12, 0x02ef}, /* ASCII = 133 111101110100 */
+	{12, 0x03ef}, /* ASCII = 134 111101111100 */
+	{12, 0x035f}, /* ASCII = 135 111110101100 */
+	{12, 0x02df}, /* ASCII = 136 111110110100 */
+	{12, 0x03df}, /* ASCII = 137 111110111100 */
+	{12, 0x02bf}, /* ASCII = 138 111111010100 */
+	{12, 0x03bf}, /* ASCII = 139 111111011100 */
+	{12, 0x037f}, /* ASCII = 140 111111101100 */
+	{12, 0x02ff}, /* ASCII = 141 111111110100 */
+	{12, 0x03ff}, /* ASCII = 142 111111111100 */
+	{13, 0x0555}, /* ASCII = 143 1010101010100 */
+	{13, 0x0755}, /* ASCII = 144 1010101011100 */
+	{13, 0x06d5}, /* ASCII = 145 1010101101100 */
+	{13, 0x05d5}, /* ASCII = 146 1010101110100 */
+	{13, 0x07d5}, /* ASCII = 147 1010101111100 */
+	{13, 0x06b5}, /* ASCII = 148 1010110101100 */
+	{13, 0x05b5}, /* ASCII = 149 1010110110100 */
+	{13, 0x07b5}, /* ASCII = 150 1010110111100 */
+	{13, 0x0575}, /* ASCII = 151 1010111010100 */
+	{13, 0x0775}, /* ASCII = 152 1010111011100 */
+	{13, 0x06f5}, /* ASCII = 153 1010111101100 */
+	{13, 0x05f5}, /* ASCII = 154 1010111110100 */
+	{13, 0x07f5}, /* ASCII = 155 1010111111100 */
+	{13, 0x06ad}, /* ASCII = 156 1011010101100 */
+	{13, 0x05ad}, /* ASCII = 157 1011010110100 */
+	{13, 0x07ad}, /* ASCII = 158 1011010111100 */
+	{13, 0x056d}, /* ASCII = 159 1011011010100 */
+	{13, 0x076d}, /* ASCII = 160 1011011011100 */
+	{13, 0x06ed}, /* ASCII = 161 1011011101100 */
+	{13, 0x05ed}, /* ASCII = 162 1011011110100 */
+	{13, 0x07ed}, /* ASCII = 163 1011011111100 */
+	{13, 0x055d}, /* ASCII = 164 1011101010100 */
+	{13, 0x075d}, /* ASCII = 165 1011101011100 */
+	{13, 0x06dd}, /* ASCII = 166 1011101101100 */
+	{13, 0x05dd}, /* ASCII = 167 1011101110100 */
+	{13, 0x07dd}, /* ASCII = 168 1011101111100 */
+	{13, 0x06bd}, /* ASCII = 169 1011110101100 */
+	{13, 0x05bd}, /* ASCII = 170 1011110110100 */
+	{13, 0x07bd}, /* ASCII = 171 1011110111100 */
+	{13, 0x057d}, /* ASCII = 172 1011111010100 */
+	{13, 0x077d}, /* ASCII = 173 1011111011100 */
+	{13, 0x06fd}, /* ASCII = 174 1011111101100 */
+	{13, 0x05fd}, /* ASCII = 175 1011111110100 */
+	{13, 0x07fd}, /* ASCII = 176 1011111111100 */
+	{13, 0x06ab}, /* ASCII = 177 1101010101100 */
+	{13, 0x05ab}, /* ASCII = 178 1101010110100 */
+	{13, 0x07ab}, /* ASCII = 179 1101010111100 */
+	{13, 0x056b}, /* ASCII = 180 1101011010100 */
+	{13, 0x076b}, /* ASCII = 181 1101011011100 */
+	{13, 0x06eb}, /* ASCII = 182 1101011101100 */
+	{13, 0x05eb}, /* ASCII = 183 1101011110100 */
+	{13, 0x07eb}, /* ASCII = 184 1101011111100 */
+	{13, 0x055b}, /* ASCII = 185 1101101010100 */
+	{13, 0x075b}, /* ASCII = 186 1101101011100 */
+	{13, 0x06db}, /* ASCII = 187 1101101101100 */
+	{13, 0x05db}, /* ASCII = 188 1101101110100 */
+	{13, 0x07db}, /* ASCII = 189 1101101111100 */
+	{13, 0x06bb}, /* ASCII = 190 1101110101100 */
+	{13, 0x05bb}, /* ASCII = 191 1101110110100 */
+	{13, 0x07bb}, /* ASCII = 192 1101110111100 */
+	{13, 0x057b}, /* ASCII = 193 1101111010100 */
+	{13, 0x077b}, /* ASCII = 194 1101111011100 */
+	{13, 0x06fb}, /* ASCII = 195 1101111101100 */
+	{13, 0x05fb}, /* ASCII = 196 1101111110100 */
+	{13, 0x07fb}, /* ASCII = 197 1101111111100 */
+	{13, 0x0557}, /* ASCII = 198 1110101010100 */
+	{13, 0x0757}, /* ASCII = 199 1110101011100 */
+	{13, 0x06d7}, /* ASCII = 200 1110101101100 */
+	{13, 0x05d7}, /* ASCII = 201 1110101110100 */
+	{13, 0x07d7}, /* ASCII = 202 1110101111100 */
+	{13, 0x06b7}, /* ASCII = 203 1110110101100 */
+	{13, 0x05b7}, /* ASCII = 204 1110110110100 */
+	{13, 0x07b7}, /* ASCII = 205 1110110111100 */
+	{13, 0x0577}, /* ASCII = 206 1110111010100 */
+	{13, 0x0777}, /* ASCII = 207 1110111011100 */
+	{13, 0x06f7}, /* ASCII = 208 1110111101100 */
+	{13, 0x05f7}, /* ASCII = 209 1110111110100 */
+	{13, 0x07f7}, /* ASCII = 210 1110111111100 */
+	{13, 0x06af}, /* ASCII = 211 1111010101100 */
+	{13, 0x05af}, /* ASCII = 212 1111010110100 */
+	{13, 0x07af}, /* ASCII = 213 1111010111100 */
+	{13, 0x056f}, /* ASCII = 214 1111011010100 */
+	{13, 0x076f}, /* ASCII = 215 1111011011100 */
+	{13, 0x06ef}, /* ASCII = 216 1111011101100 */
+	{13, 0x05ef}, /* ASCII = 217 1111011110100 */
+	{13, 0x07ef}, /* ASCII = 218 1111011111100 */
+	{13, 0x055f}, /* ASCII = 219 1111101010100 */
+	{13, 0x075f}, /* ASCII = 220 1111101011100 */
+	{13, 0x06df}, /* ASCII = 221 1111101101100 */
+	{13, 0x05df}, /* ASCII = 222 1111101110100 */
+	{13, 0x07df}, /* ASCII = 223 1111101111100 */
+	{13, 0x06bf}, /* ASCII = 224 1111110101100 */
+	{13, 0x05bf}, /* ASCII = 225 1111110110100 */
+	{13, 0x07bf}, /* ASCII = 226 1111110111100 */
+	{13, 0x057f}, /* ASCII = 227 1111111010100 */
+	{13, 0x077f}, /* ASCII = 228 1111111011100 */
+	{13, 0x06ff}, /* ASCII = 229 1111111101100 */
+	{13, 0x05ff}, /* ASCII = 230 1111111110100 */
+	{13, 0x07ff}, /* ASCII = 231 1111111111100 */
+	{14, 0x0d55}, /* ASCII = 232 10101010101100 */
+	{14, 0x0b55}, /* ASCII = 233 10101010110100 */
+	{14, 0x0f55}, /* ASCII = 234 10101010111100 */
+	{14, 0x0ad5}, /* ASCII = 235 10101011010100 */
+	{14, 0x0ed5}, /* ASCII = 236 10101011011100 */
+	{14, 0x0dd5}, /* ASCII = 237 10101011101100 */
+	{14, 0x0bd5}, /* ASCII = 238 10101011110100 */
+	{14, 0x0fd5}, /* ASCII = 239 10101011111100 */
+	{14, 0x0ab5}, /* ASCII = 240 10101101010100 */
+	{14, 0x0eb5}, /* ASCII = 241 10101101011100 */
+	{14, 0x0db5}, /* ASCII = 242 10101101101100 */
+	{14, 0x0bb5}, /* ASCII = 243 10101101110100 */
+	{14, 0x0fb5}, /* ASCII = 244 10101101111100 */
+	{14, 0x0d75}, /* ASCII = 245 10101110101100 */
+	{14, 0x0b75}, /* ASCII = 246 10101110110100 */
+	{14, 0x0f75}, /* ASCII = 247 10101110111100 */
+	{14, 0x0af5}, /* ASCII = 248 10101111010100 */
+	{14, 0x0ef5}, /* ASCII = 249 10101111011100 */
+	{14, 0x0df5}, /* ASCII = 250 10101111101100 */
+	{14, 0x0bf5}, /* ASCII = 251 10101111110100 */
+	{14, 0x0ff5}, /* ASCII = 252 10101111111100 */
+	{14, 0x0aad}, /* ASCII = 253 10110101010100 */
+	{14, 0x0ead}, /* ASCII = 254 10110101011100 */
+	{14, 0x0dad}, /* ASCII = 255 10110101101100 */
+};
+
+#endif